@@ -0,0 +1,158 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// File: gather.cpp
+//
+// Times gather() and scatter() of 4M points on a 256^3 array3d<double>
+// against a plain loop of at() calls, for two index distributions:
+//   random     uniform over the whole grid
+//   clustered  normal around 8 centers, so many points share pages and
+//              some share elements
+// Batches are timed unsorted, sorted with values in BATCH_ORDER (which
+// uses the unsorted offsets) and sorted with values in ADDRESS_ORDER. The
+// one time cost of building each batch is listed separately.
+//
+// Every result is checked against the at() loop; for scatter() the last
+// of several points with the same element must win.
+//
+// g++ -O2 -std=c++11 -fopenmp gather.cpp -o gather
+// ./gather [n points]
+///////////////////////////////////////////////////////////////////////////
+
+#include "../orca_gather.hpp"
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+using namespace orca_array;
+
+typedef std::chrono::steady_clock bench_clock;
+
+int failures = 0;
+
+double seconds_since(bench_clock::time_point start) {
+    std::chrono::duration<double> t = bench_clock::now() - start;
+    return t.count();
+}
+
+void print_time(const char *what, double t, bool ok) {
+    printf("    %-36s %8.4f s  %s\n", what, t, ok ? "ok" : "WRONG");
+    if (!ok) {
+        failures++;
+    }
+}
+
+void run(const char *label, int n, size_t count, bool clustered) {
+    std::mt19937 random(777);
+    std::uniform_int_distribution<int> cell(0, n - 1);
+    std::normal_distribution<double> spread(0.0, n / 64.0);
+    int centers[8][3];
+    for (int c = 0; c < 8; c++) {
+        for (int d = 0; d < 3; d++) {
+            centers[c][d] = cell(random);
+        }
+    }
+    std::vector<int> index(3 * count);
+    for (size_t p = 0; p < count; p++) {
+        for (int d = 0; d < 3; d++) {
+            int x = cell(random);
+            if (clustered) {
+                x = centers[p % 8][d] + (int)spread(random);
+                x = ((x % n) + n) % n;
+            }
+            index[3 * p + d] = x;
+        }
+    }
+
+    array3d<double> grid(n, n, n);
+    for (size_t q = 0; q < grid.num_elements(); q++) {
+        grid.data()[q] = (double)q;
+    }
+    printf("%s: %zu points on %d^3\n", label, count, n);
+
+    std::vector<double> expected(count);
+    std::vector<double> value(count);
+    bench_clock::time_point start = bench_clock::now();
+    for (size_t p = 0; p < count; p++) {
+        const int *x = &index[3 * p];
+        expected[p] = grid.at(x[0], x[1], x[2]);
+    }
+    print_time("gather, at() loop", seconds_since(start), true);
+
+    start = bench_clock::now();
+    access_batch<3> unsorted(grid, count, index.data());
+    print_time("  build unsorted batch", seconds_since(start), true);
+    start = bench_clock::now();
+    access_batch<3> sorted(grid, count, index.data(), true);
+    print_time("  build sorted batch", seconds_since(start), true);
+
+    start = bench_clock::now();
+    gather(grid, unsorted, value.data());
+    print_time("gather, unsorted batch", seconds_since(start),
+               value == expected);
+
+    start = bench_clock::now();
+    gather(grid, sorted, value.data());
+    print_time("gather, sorted batch, BATCH_ORDER", seconds_since(start),
+               value == expected);
+
+    start = bench_clock::now();
+    gather(grid, sorted, value.data(), ADDRESS_ORDER);
+    double t = seconds_since(start);
+    bool ok = true;
+    for (size_t m = 0; m < count; m++) {
+        ok = ok && value[m] == expected[sorted.order_data()[m]];
+    }
+    print_time("gather, sorted batch, ADDRESS_ORDER", t, ok);
+
+    // scatter point numbers, the last point of an element wins
+    std::vector<double> number(count);
+    std::vector<double> number_by_address(count);
+    for (size_t p = 0; p < count; p++) {
+        number[p] = (double)p;
+    }
+    for (size_t m = 0; m < count; m++) {
+        number_by_address[m] = (double)sorted.order_data()[m];
+    }
+
+    start = bench_clock::now();
+    for (size_t p = 0; p < count; p++) {
+        const int *x = &index[3 * p];
+        grid.at(x[0], x[1], x[2]) = number[p];
+    }
+    print_time("scatter, at() loop", seconds_since(start), true);
+    std::vector<double> last(grid.data(), grid.data() + grid.num_elements());
+
+    const char *names[3] = {"scatter, unsorted batch",
+                            "scatter, sorted batch, BATCH_ORDER",
+                            "scatter, sorted batch, ADDRESS_ORDER"};
+    for (int s = 0; s < 3; s++) {
+        for (size_t q = 0; q < grid.num_elements(); q++) {
+            grid.data()[q] = -1.0;
+        }
+        start = bench_clock::now();
+        if (s == 0) {
+            scatter(grid, unsorted, number.data());
+        } else if (s == 1) {
+            scatter(grid, sorted, number.data());
+        } else {
+            scatter(grid, sorted, number_by_address.data(), ADDRESS_ORDER);
+        }
+        t = seconds_since(start);
+        ok = true;
+        for (size_t p = 0; p < count; p++) {
+            const int *x = &index[3 * p];
+            size_t q = grid.offset(x[0], x[1], x[2]);
+            ok = ok && grid.data()[q] == last[q];
+        }
+        print_time(names[s], t, ok);
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t count = (argc > 1) ? (size_t)atol(argv[1]) : (size_t)4 << 20;
+    printf("max_threads()=%d\n", max_threads());
+    run("random", 256, count, false);
+    run("clustered", 256, count, true);
+    return (failures == 0) ? 0 : 1;
+}
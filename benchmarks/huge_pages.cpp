@@ -0,0 +1,93 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// File: huge_pages.cpp
+//
+// Strided sweeps over a 256 MB array3d<double> allocated with
+// ALLOC_DEFAULT and with ALLOC_HUGE_PAGES. Each sweep sums the array with
+// a different loop order:
+//   contiguous   the fastest dimension innermost
+//   one stride   a slow dimension innermost, the fastest one next, so
+//                only a few hundred pages are in use at a time
+//   two strides  both slow dimensions innermost, so every page of the
+//                array is touched before an element is reused
+// With 4 KB pages the last sweep misses the TLB on nearly every access;
+// 2 MB pages cover the array with a few hundred TLB entries.
+//
+// g++ -O2 -std=c++11 huge_pages.cpp -o huge_pages
+// ./huge_pages [n1 n2 n3]
+///////////////////////////////////////////////////////////////////////////
+
+#include "../orca_array.hpp"
+
+#include <chrono>
+
+using namespace orca_array;
+
+typedef std::chrono::steady_clock bench_clock;
+
+// sum of all elements, loops over dimensions outer, middle, inner (1 to 3)
+double sweep(const array3d<double> &a, int outer, int middle, int inner) {
+    int n[3] = {a.length1(), a.length2(), a.length3()};
+    outer--;
+    middle--;
+    inner--;
+    int i[3];
+    double sum = 0;
+    for (i[outer] = 0; i[outer] < n[outer]; i[outer]++) {
+        for (i[middle] = 0; i[middle] < n[middle]; i[middle]++) {
+            for (i[inner] = 0; i[inner] < n[inner]; i[inner]++) {
+                sum += a.at(i[0], i[1], i[2]);
+            }
+        }
+    }
+    return sum;
+}
+
+void run(const char *label, int n1, int n2, int n3,
+         allocation_option option) {
+    array3d<double> a(n1, n2, n3, option);
+    double *p = a.data();
+    size_t count = a.num_elements();
+    for (size_t q = 0; q < count; q++) {
+        p[q] = (double)(q % 1000);
+    }
+
+    // fastest, middle and slowest dimension
+    const int fast = fastest_dimension<3>();
+    const int slow = 4 - fast;
+    const int orders[3][3] = {
+        {slow, 2, fast}, {slow, fast, 2}, {fast, slow, 2}};
+    const char *names[3] = {"contiguous", "one stride", "two strides"};
+
+    printf("%-16s uses_huge_pages()=%d\n", label, (int)a.uses_huge_pages());
+    for (int s = 0; s < 3; s++) {
+        // best of three
+        double best = 1e30;
+        double sum = 0;
+        for (int rep = 0; rep < 3; rep++) {
+            bench_clock::time_point start = bench_clock::now();
+            sum = sweep(a, orders[s][0], orders[s][1], orders[s][2]);
+            std::chrono::duration<double> t = bench_clock::now() - start;
+            best = (t.count() < best) ? t.count() : best;
+        }
+        printf("    %-12s inner stride %9td bytes  %8.4f s  (sum %.0f)\n",
+               names[s], a.stride(orders[s][2]) * (ptrdiff_t)sizeof(double),
+               best, sum);
+    }
+}
+
+int main(int argc, char **argv) {
+    int n1 = 256, n2 = 256, n3 = 512;
+    if (argc == 4) {
+        n1 = atoi(argv[1]);
+        n2 = atoi(argv[2]);
+        n3 = atoi(argv[3]);
+    }
+    printf("array3d<double>(%d, %d, %d), %.0f MB, FORTRAN_ORDER=%d\n", n1, n2,
+           n3, (double)n1 * n2 * n3 * sizeof(double) / (1024 * 1024),
+           FORTRAN_ORDER);
+
+    run("ALLOC_DEFAULT", n1, n2, n3, ALLOC_DEFAULT);
+    run("ALLOC_HUGE_PAGES", n1, n2, n3, ALLOC_HUGE_PAGES);
+    return 0;
+}
@@ -0,0 +1,113 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// File: scatter_add.cpp
+//
+// Times scatter_add() with every scatter_strategy on batches of particle
+// deposits into array3d<double> grids:
+//   spread      uniform random cells of a large grid
+//   small grid  uniform random cells of a grid that fits in L2
+//   clustered   cells drawn around a few centers of a large grid
+//   big batch   four updates per cell of a large grid
+// Every strategy must give the same sums as SCATTER_SERIAL; the values are
+// small integers, so the sums are exact in any order.
+//
+// g++ -O2 -std=c++11 -fopenmp scatter_add.cpp -o scatter_add
+// OMP_NUM_THREADS=8 ./scatter_add
+///////////////////////////////////////////////////////////////////////////
+
+#include "../orca_scatter.hpp"
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+using namespace orca_array;
+
+typedef std::chrono::steady_clock bench_clock;
+
+enum distribution { UNIFORM = 0, CLUSTERED = 1 };
+
+// count cells of an n^3 grid, 3 indices per cell
+std::vector<int> make_indices(int n, size_t count, distribution shape) {
+    std::mt19937 random(12345);
+    std::uniform_int_distribution<int> cell(0, n - 1);
+    std::normal_distribution<double> spread(0.0, n / 64.0);
+    int centers[8][3];
+    for (int c = 0; c < 8; c++) {
+        for (int d = 0; d < 3; d++) {
+            centers[c][d] = cell(random);
+        }
+    }
+
+    std::vector<int> index(3 * count);
+    for (size_t p = 0; p < count; p++) {
+        const int *center = centers[p % 8];
+        for (int d = 0; d < 3; d++) {
+            int x = cell(random);
+            if (shape == CLUSTERED) {
+                // periodic around the center
+                x = center[d] + (int)spread(random);
+                x = ((x % n) + n) % n;
+            }
+            index[3 * p + d] = x;
+        }
+    }
+    return index;
+}
+
+void run(const char *label, int n, size_t count, distribution shape) {
+    std::vector<int> index = make_indices(n, count, shape);
+    std::vector<double> value(count);
+    for (size_t p = 0; p < count; p++) {
+        value[p] = (double)(p % 7 + 1);
+    }
+
+    array3d<double> grid(n, n, n);
+    size_t elements = grid.num_elements();
+    printf("%-11s grid %d^3 (%6.1f MB)  %zu updates\n", label, n,
+           elements * sizeof(double) / (1024.0 * 1024.0), count);
+
+    const scatter_strategy strategies[4] = {SCATTER_SERIAL, SCATTER_ATOMIC,
+                                            SCATTER_PRIVATIZED, SCATTER_TILED};
+    const char *names[4] = {"SCATTER_SERIAL", "SCATTER_ATOMIC",
+                            "SCATTER_PRIVATIZED", "SCATTER_TILED"};
+    std::vector<double> expected;
+
+    for (int s = 0; s < 4; s++) {
+        // best of three
+        double best = 1e30;
+        for (int rep = 0; rep < 3; rep++) {
+            double *p = grid.data();
+            for (size_t i = 0; i < elements; i++) {
+                p[i] = 0;
+            }
+            bench_clock::time_point start = bench_clock::now();
+            scatter_add(grid, count, index.data(), value.data(),
+                        strategies[s]);
+            std::chrono::duration<double> t = bench_clock::now() - start;
+            best = (t.count() < best) ? t.count() : best;
+        }
+
+        const char *check = "ok";
+        if (s == 0) {
+            expected.assign(grid.data(), grid.data() + elements);
+        } else {
+            for (size_t i = 0; i < elements; i++) {
+                if (grid.data()[i] != expected[i]) {
+                    check = "WRONG SUMS";
+                    break;
+                }
+            }
+        }
+        printf("    %-18s %8.4f s  %s\n", names[s], best, check);
+    }
+}
+
+int main(void) {
+    printf("max_threads()=%d\n", max_threads());
+    run("spread", 128, (size_t)4 << 20, UNIFORM);
+    run("small grid", 32, (size_t)4 << 20, UNIFORM);
+    run("clustered", 128, (size_t)4 << 20, CLUSTERED);
+    run("big batch", 128, (size_t)8 << 20, UNIFORM);
+    return 0;
+}
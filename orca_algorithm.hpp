@@ -0,0 +1,473 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// File: orca_algorithm.hpp
+//
+// Whole array algorithms for orca_array arrays: fill, copy, transform,
+// for_each (with or without the indices of the element), count_if,
+// copy_if, and inclusive and exclusive scans along one dimension.
+//
+// Every algorithm takes an execution_policy as its first argument:
+//
+// EXEC_SERIAL               one thread, plain loop
+// EXEC_THREADED             split over the OpenMP threads
+// EXEC_VECTORIZED           one thread, loop marked omp simd
+// EXEC_THREADED_VECTORIZED  both
+//
+// The element order is fixed for the whole program by FORTRAN_ORDER, so
+// arrays of equal extents always have equal layouts and the elementwise
+// algorithms walk their memory linearly, whatever the element types.
+// Functions that receive indices get them as x1 ... xN, independent of
+// the order. Functions passed to the threaded or vectorized algorithms
+// must be safe to call concurrently and in any order.
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef ORCA_ALGORITHM
+#define ORCA_ALGORITHM
+
+#include "orca_array.hpp"
+
+#include <vector>
+
+namespace orca_array {
+
+enum execution_policy {
+    EXEC_SERIAL = 0,
+    EXEC_THREADED = 1,
+    EXEC_VECTORIZED = 2,
+    EXEC_THREADED_VECTORIZED = 3
+};
+
+//////////////// start algorithm helpers /////////////////////
+
+// Calls body(i) for i = 0 ... count-1 as the policy says.
+template <class Body>
+inline void run_elements(execution_policy policy, size_t count, Body body) {
+    bool threaded = (policy & EXEC_THREADED) != 0;
+    (void)threaded;
+    if (policy & EXEC_VECTORIZED) {
+        ORCA_OMP_SIMD(omp parallel for simd schedule(static) if (threaded))
+        for (long i = 0; i < (long)count; i++) {
+            body(i);
+        }
+    } else {
+        ORCA_OMP(omp parallel for schedule(static) if (threaded))
+        for (long i = 0; i < (long)count; i++) {
+            body(i);
+        }
+    }
+}
+
+// f(element, index[0], ..., index[N-1]) expanded at compile time
+template <int K> struct index_call {
+    template <class Function, class T, class... Index>
+    static inline void call(Function &f, T &element, const int *index,
+                            Index... x) {
+        index_call<K - 1>::call(f, element, index, index[K - 1], x...);
+    }
+};
+
+template <> struct index_call<0> {
+    template <class Function, class T, class... Index>
+    static inline void call(Function &f, T &element, const int *,
+                            Index... x) {
+        f(element, x...);
+    }
+};
+
+// Scan of outer contiguous lines of n elements from from to to, see
+// parallel_inclusive_scan() and parallel_exclusive_scan(). With fewer lines
+// than threads every line is cut into parts and scanned in two passes: the
+// totals of the parts first, then the parts again, each starting from the
+// op of the totals before it. That needs op to be associative.
+template <class T, class BinaryOp>
+void scan_contiguous_lines(bool threaded, T *to, const T *from, size_t n,
+                           size_t outer, BinaryOp op, bool exclusive,
+                           T init) {
+    // shortest part worth a thread of its own
+    const size_t least = 4096;
+    size_t threads = (size_t)max_threads();
+    size_t parts = 1;
+    if (threaded && outer < threads) {
+        parts = (threads + outer - 1) / outer;
+        size_t most = (n / least > 1) ? n / least : 1;
+        parts = (parts < most) ? parts : most;
+    }
+    size_t part_length = (n + parts - 1) / parts;
+    long tasks = outer * parts;
+
+    // the op of everything in a line before each part
+    std::vector<T> carry(tasks);
+    if (parts > 1) {
+        ORCA_OMP(omp parallel for schedule(static) if (threaded))
+        for (long t = 0; t < tasks; t++) {
+            size_t p = t % parts;
+            if (p + 1 == parts) {
+                continue;
+            }
+            const T *in = from + (t / parts) * n + p * part_length;
+            T total = in[0];
+            for (size_t k = 1; k < part_length; k++) {
+                total = op(total, in[k]);
+            }
+            carry[t] = total;
+        }
+
+        for (size_t line = 0; line < outer; line++) {
+            T *c = &carry[line * parts];
+            T before = exclusive ? op(init, c[0]) : c[0];
+            for (size_t p = 1; p < parts; p++) {
+                T total = c[p];
+                c[p] = before;
+                before = op(before, total);
+            }
+        }
+    }
+
+    ORCA_OMP(omp parallel for schedule(static) if (threaded))
+    for (long t = 0; t < tasks; t++) {
+        size_t p = t % parts;
+        size_t first = p * part_length;
+        size_t last = (first + part_length < n) ? first + part_length : n;
+        if (first >= last) {
+            continue;
+        }
+        T *out = to + (t / parts) * n;
+        const T *in = from + (t / parts) * n;
+
+        if (exclusive) {
+            T sum = (p == 0) ? init : carry[t];
+            for (size_t k = first; k < last; k++) {
+                T value = in[k];
+                out[k] = sum;
+                sum = op(sum, value);
+            }
+        } else {
+            T sum = (p == 0) ? in[first] : op(carry[t], in[first]);
+            out[first] = sum;
+            for (size_t k = first + 1; k < last; k++) {
+                sum = op(sum, in[k]);
+                out[k] = sum;
+            }
+        }
+    }
+}
+
+// Scan along dimension dim of y and x, see parallel_inclusive_scan() and
+// parallel_exclusive_scan(). Along a strided dimension the innermost loop
+// runs over neighboring lines, which are contiguous in memory.
+template <class T, int N, class BinaryOp>
+void scan_dispatch(execution_policy policy, arraynd<T, N> &y,
+                   const arraynd<T, N> &x, int dim, BinaryOp op,
+                   bool exclusive, T init) {
+    check_same_shape(y, x);
+
+    // the array is outer blocks of n slices of inner contiguous elements
+    size_t n = y.length(dim);
+    size_t inner = y.stride(dim);
+    size_t outer = y.num_elements() / (n * inner);
+
+    T *to = y.data();
+    const T *from = x.data();
+    bool threaded = (policy & EXEC_THREADED) != 0;
+    (void)threaded;
+
+    if (inner == 1) {
+        scan_contiguous_lines(threaded, to, from, n, outer, op, exclusive,
+                              init);
+        return;
+    }
+
+    // every task is one block of up to 256 neighboring lines
+    const size_t width = 256;
+    size_t chunks = (inner + width - 1) / width;
+    long tasks = outer * chunks;
+
+    ORCA_OMP(omp parallel for schedule(static) if (threaded))
+    for (long t = 0; t < tasks; t++) {
+        size_t base = (t / chunks) * n * inner + (t % chunks) * width;
+        size_t lines = inner - (t % chunks) * width;
+        lines = (lines < width) ? lines : width;
+
+        T *out = to + base;
+        const T *in = from + base;
+
+        if (exclusive) {
+            // running sums of the lines, x may be y
+            T sum[width];
+            for (size_t j = 0; j < lines; j++) {
+                sum[j] = init;
+            }
+            for (size_t k = 0; k < n; k++) {
+                T *row = out + k * inner;
+                const T *row_in = in + k * inner;
+                if (policy & EXEC_VECTORIZED) {
+                    ORCA_OMP_SIMD(omp simd)
+                    for (size_t j = 0; j < lines; j++) {
+                        T value = row_in[j];
+                        row[j] = sum[j];
+                        sum[j] = op(sum[j], value);
+                    }
+                } else {
+                    for (size_t j = 0; j < lines; j++) {
+                        T value = row_in[j];
+                        row[j] = sum[j];
+                        sum[j] = op(sum[j], value);
+                    }
+                }
+            }
+            continue;
+        }
+
+        for (size_t j = 0; j < lines; j++) {
+            out[j] = in[j];
+        }
+        for (size_t k = 1; k < n; k++) {
+            T *row = out + k * inner;
+            const T *prev = out + (k - 1) * inner;
+            const T *row_in = in + k * inner;
+            if (policy & EXEC_VECTORIZED) {
+                ORCA_OMP_SIMD(omp simd)
+                for (size_t j = 0; j < lines; j++) {
+                    row[j] = op(prev[j], row_in[j]);
+                }
+            } else {
+                for (size_t j = 0; j < lines; j++) {
+                    row[j] = op(prev[j], row_in[j]);
+                }
+            }
+        }
+    }
+}
+
+////////////// end algorithm helpers /////////////////////
+
+// every element of a = value
+template <class T, int N>
+void parallel_fill(execution_policy policy, arraynd<T, N> &a, T value) {
+    T *x = a.data();
+    run_elements(policy, a.num_elements(), [=](size_t i) { x[i] = value; });
+}
+
+// y = x, converting the element type if needed
+template <class T, class U, int N>
+void parallel_copy(execution_policy policy, arraynd<T, N> &y,
+                   const arraynd<U, N> &x) {
+    check_same_shape(y, x);
+    T *to = y.data();
+    const U *from = x.data();
+    run_elements(policy, y.num_elements(),
+                 [=](size_t i) { to[i] = (T)from[i]; });
+}
+
+// y = f(x) elementwise, y and x may be the same array
+template <class T, class U, int N, class Function>
+void parallel_transform(execution_policy policy, arraynd<T, N> &y,
+                        const arraynd<U, N> &x, Function f) {
+    check_same_shape(y, x);
+    T *to = y.data();
+    const U *from = x.data();
+    run_elements(policy, y.num_elements(),
+                 [=](size_t i) { to[i] = f(from[i]); });
+}
+
+// z = f(x, y) elementwise
+template <class T, class U, class V, int N, class Function>
+void parallel_transform(execution_policy policy, arraynd<T, N> &z,
+                        const arraynd<U, N> &x, const arraynd<V, N> &y,
+                        Function f) {
+    check_same_shape(z, x);
+    check_same_shape(z, y);
+    T *to = z.data();
+    const U *a = x.data();
+    const V *b = y.data();
+    run_elements(policy, z.num_elements(),
+                 [=](size_t i) { to[i] = f(a[i], b[i]); });
+}
+
+// f(element) for every element of a
+template <class T, int N, class Function>
+void parallel_for_each(execution_policy policy, arraynd<T, N> &a,
+                       Function f) {
+    T *x = a.data();
+    run_elements(policy, a.num_elements(), [=](size_t i) { f(x[i]); });
+}
+
+// f(element, x1, ..., xN) for every element of a. Every thread walks its
+// share in memory order and steps the indices like an odometer, so no
+// index is ever divided out of an offset. Never vectorized.
+template <class T, int N, class Function>
+void parallel_for_each_index(execution_policy policy, arraynd<T, N> &a,
+                             Function f) {
+    T *x = a.data();
+    size_t count = a.num_elements();
+    int size[N];
+    for (int d = 0; d < N; d++) {
+        size[d] = a.length(d + 1);
+    }
+    bool threaded = (policy & EXEC_THREADED) != 0;
+    (void)threaded;
+
+    ORCA_OMP(omp parallel if (threaded))
+    {
+        int threads = 1;
+#if defined(_OPENMP)
+        threads = omp_get_num_threads();
+#endif
+        size_t first = count * thread_num() / threads;
+        size_t last = count * (thread_num() + 1) / threads;
+
+        // indices of element first
+        int index[N];
+        for (int d = 0; d < N; d++) {
+            index[d] = (int)(first / a.stride(d + 1) % size[d]);
+        }
+
+        for (size_t i = first; i < last; i++) {
+            index_call<N>::call(f, x[i], index);
+
+            for (int k = 0; k < N; k++) {
+#if FORTRAN_ORDER == 1
+                int d = k;
+#else
+                int d = N - 1 - k;
+#endif
+                if (++index[d] < size[d]) {
+                    break;
+                }
+                index[d] = 0;
+            }
+        }
+    }
+}
+
+// number of elements of a for which pred(element) is true
+template <class T, int N, class Predicate>
+size_t parallel_count_if(execution_policy policy, const arraynd<T, N> &a,
+                         Predicate pred) {
+    const T *x = a.data();
+    long count = a.num_elements();
+    bool threaded = (policy & EXEC_THREADED) != 0;
+    (void)threaded;
+    size_t total = 0;
+
+    if (policy & EXEC_VECTORIZED) {
+        ORCA_OMP_SIMD(omp parallel for simd schedule(static)
+                          reduction(+ : total) if (threaded))
+        for (long i = 0; i < count; i++) {
+            total += pred(x[i]) ? 1 : 0;
+        }
+    } else {
+        ORCA_OMP(omp parallel for schedule(static) reduction(+ : total)
+                     if (threaded))
+        for (long i = 0; i < count; i++) {
+            total += pred(x[i]) ? 1 : 0;
+        }
+    }
+    return total;
+}
+
+// Inclusive scan along dimension dim (counted from 1):
+//   y(.., 0, ..) = x(.., 0, ..)
+//   y(.., k, ..) = op(y(.., k-1, ..), x(.., k, ..))
+// y and x may be the same array. op must be associative: along the
+// contiguous dimension long lines are split between threads.
+template <class T, int N, class BinaryOp>
+void parallel_inclusive_scan(execution_policy policy, arraynd<T, N> &y,
+                             const arraynd<T, N> &x, int dim, BinaryOp op) {
+    scan_dispatch(policy, y, x, dim, op, false, T());
+}
+
+// inclusive scan with addition, e.g. a column density along dim
+template <class T, int N>
+void parallel_inclusive_scan(execution_policy policy, arraynd<T, N> &y,
+                             const arraynd<T, N> &x, int dim) {
+    parallel_inclusive_scan(policy, y, x, dim,
+                            [](const T &a, const T &b) { return a + b; });
+}
+
+// Exclusive scan along dimension dim (counted from 1):
+//   y(.., 0, ..) = init
+//   y(.., k, ..) = op(y(.., k-1, ..), x(.., k-1, ..))
+// y and x may be the same array, op must be associative.
+template <class T, int N, class BinaryOp>
+void parallel_exclusive_scan(execution_policy policy, arraynd<T, N> &y,
+                             const arraynd<T, N> &x, int dim, T init,
+                             BinaryOp op) {
+    scan_dispatch(policy, y, x, dim, op, true, init);
+}
+
+// exclusive scan with addition starting from zero, e.g. the offsets of
+// variable length records from their lengths
+template <class T, int N>
+void parallel_exclusive_scan(execution_policy policy, arraynd<T, N> &y,
+                             const arraynd<T, N> &x, int dim) {
+    parallel_exclusive_scan(policy, y, x, dim, T(),
+                            [](const T &a, const T &b) { return a + b; });
+}
+
+// Stream compaction: copies the elements of x for which pred(element) is
+// true, in memory order, to y(0), y(1), ... and returns their number. The
+// other elements of y are left alone. y needs room for all of x and must
+// not be x. pred is called twice for every element.
+template <class T, int N, class Predicate>
+size_t parallel_copy_if(execution_policy policy, arraynd<T, 1> &y,
+                        const arraynd<T, N> &x, Predicate pred) {
+    if (y.num_elements() < x.num_elements()) {
+        printf("copy_if needs room for every element\n");
+        printf("room=%lu elements=%lu \n", (unsigned long)y.num_elements(),
+               (unsigned long)x.num_elements());
+        printf("file %s, line %d.\n", __FILE__, __LINE__);
+        raise(SIGSEGV);
+    }
+
+    const T *from = x.data();
+    T *to = y.data();
+    size_t count = x.num_elements();
+    bool threaded = (policy & EXEC_THREADED) != 0;
+
+    // one block per thread: count, exclusive scan of the counts, copy
+    size_t blocks = threaded ? (size_t)max_threads() : 1;
+    blocks = (blocks < count) ? blocks : 1;
+    size_t block_length = (count + blocks - 1) / blocks;
+    std::vector<size_t> start(blocks + 1, 0);
+
+    ORCA_OMP(omp parallel if (threaded))
+    {
+        ORCA_OMP(omp for schedule(static))
+        for (long b = 0; b < (long)blocks; b++) {
+            size_t first = b * block_length;
+            size_t last = first + block_length;
+            last = (last < count) ? last : count;
+            size_t kept = 0;
+            for (size_t i = first; i < last; i++) {
+                kept += pred(from[i]) ? 1 : 0;
+            }
+            start[b + 1] = kept;
+        }
+
+        ORCA_OMP(omp single)
+        for (size_t b = 0; b < blocks; b++) {
+            start[b + 1] += start[b];
+        }
+
+        ORCA_OMP(omp for schedule(static))
+        for (long b = 0; b < (long)blocks; b++) {
+            size_t first = b * block_length;
+            size_t last = first + block_length;
+            last = (last < count) ? last : count;
+            T *out = to + start[b];
+            for (size_t i = first; i < last; i++) {
+                if (pred(from[i])) {
+                    *out++ = from[i];
+                }
+            }
+        }
+    }
+
+    return start[blocks];
+}
+
+} // namespace orca_array
+
+// endif ORCA_ALGORITHM
+#endif
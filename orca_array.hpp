@@ -4,7 +4,8 @@
 // Author: Pramod Gupta, Department of Astronomy, University of Washington
 // Last Modified: 2020 Oct 26
 //
-// Multi-dimensional array template classes array1d<T> to array7d<T>
+// Multi-dimensional array template class arraynd<T, N> with the aliases
+// array1d<T> to array7d<T>
 // Compile time option for array bounds checking and
 // for accessing array elements via Fortran order or C order.
 //
@@ -18,11 +19,17 @@
 #define ARRAY_BOUNDS_CHECK 0
 #define FORTRAN_ORDER 0
 
+// Arrays constructed with ALLOC_HUGE_PAGES are backed by 2 MB transparent
+// huge pages only if they occupy at least this many bytes.
+#define HUGE_PAGE_THRESHOLD (32 * 1024 * 1024)
+
 //////////////////////////////////////////////////////////////////////////////
 // Notes:
 // Copy constructor and assignment operator are private.
 // Hence pass all orca_arrays to a function by reference .
 
+// arraynd uses variadic templates, so compile with C++11 or later.
+
 // All member functions are defined within the class so they are inline
 // by default. However, we still label the at() function inline as a
 // reminder.
@@ -30,1511 +37,871 @@
 
 #include <new>
 #include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <type_traits>
+#include <utility>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
 
 using namespace std;
 
 namespace orca_array {
 
-//////////////// start class array1d /////////////////////
-template <class array_element_type> class array1d {
-
-  private:
-    int size1;
-    array_element_type *internal_array;
+//////////////// start allocation helpers /////////////////////
+
+// options accepted as the last argument of the array constructors
+enum allocation_option {
+    // allocate with new[]
+    ALLOC_DEFAULT = 0,
+    // back arrays of at least HUGE_PAGE_THRESHOLD bytes with 2 MB
+    // transparent huge pages, fall back to new[] if that is not possible
+    ALLOC_HUGE_PAGES = 1,
+    // Start with every element zero. The elements live in fresh anonymous
+    // pages that the kernel only backs with memory when they are first
+    // written, so regions that are never touched cost nothing. Only for
+    // element types whose zero value is all zero bits.
+    ALLOC_ZERO = 2
+};
 
-  public:
-    inline int length1(void) const { return size1; }
+// size of a transparent huge page on x86-64 and aarch64 Linux
+const size_t huge_page_size = 2 * 1024 * 1024;
+
+// describes how the memory behind internal_array was obtained
+struct allocation_record {
+    // start and length of the mmap region, map_base is 0 for new[]
+    void *map_base;
+    size_t map_bytes;
+    // true if madvise(MADV_HUGEPAGE) was accepted for the region
+    bool huge_pages;
+    // option the memory was requested with, reused when reallocating
+    allocation_option option;
+    // number of constructed elements, at least the product of the extents
+    size_t capacity;
+};
 
-    inline array_element_type &at(int x1) {
-#if ARRAY_BOUNDS_CHECK == 1
+// Returns the number of bytes of [base, base+bytes) currently backed by
+// transparent huge pages, as reported by the AnonHugePages lines of
+// /proc/self/smaps. Returns 0 where smaps is not available.
+inline size_t huge_page_bytes(const void *base, size_t bytes) {
+    size_t total = 0;
+#if defined(__linux__)
+    FILE *smaps = fopen("/proc/self/smaps", "r");
+    if (smaps == NULL) {
+        return 0;
+    }
 
-        if ((x1 < 0) || (x1 >= size1)) {
+    uintptr_t first = (uintptr_t)base;
+    uintptr_t last = first + bytes;
+    bool inside = false;
+    char line[256];
 
-            printf("index x1 is less than 0 or  equal to size1 or greater than "
-                   "size1\n");
-            printf("x1=%d \n", x1);
-            printf("size1=%d \n", size1);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
+    while (fgets(line, sizeof(line), smaps) != NULL) {
+        unsigned long start, end, kb;
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+            // header line of a new mapping
+            inside = (start < last) && (end > first);
+        } else if (inside &&
+                   sscanf(line, "AnonHugePages: %lu kB", &kb) == 1) {
+            total += (size_t)kb * 1024;
         }
+    }
+    fclose(smaps);
+#else
+    (void)base;
+    (void)bytes;
 #endif
-
-        return internal_array[x1];
+    return total;
+}
+
+// Allocates and default constructs count elements, like new T[count].
+// With ALLOC_HUGE_PAGES large arrays get an anonymous mapping aligned to
+// huge_page_size and marked with madvise(MADV_HUGEPAGE). With ALLOC_ZERO
+// the elements get a page aligned anonymous mapping, or new T[count]().
+template <class T>
+T *allocate_elements(size_t count, allocation_option option,
+                     allocation_record &record) {
+    record.map_base = 0;
+    record.map_bytes = 0;
+    record.huge_pages = false;
+    record.option = option;
+    record.capacity = count;
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    size_t bytes = count * sizeof(T);
+
+    if (option == ALLOC_HUGE_PAGES && bytes >= HUGE_PAGE_THRESHOLD) {
+        // round up to whole huge pages and over-allocate by one huge page
+        // so that the start can be aligned
+        size_t map_bytes =
+            (bytes + huge_page_size - 1) / huge_page_size * huge_page_size;
+        size_t raw_bytes = map_bytes + huge_page_size;
+
+        void *raw = mmap(0, raw_bytes, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (raw != MAP_FAILED) {
+            uintptr_t raw_start = (uintptr_t)raw;
+            uintptr_t start = (raw_start + huge_page_size - 1) /
+                              huge_page_size * huge_page_size;
+
+            // give back the unaligned head and the unused tail
+            size_t head = start - raw_start;
+            size_t tail = raw_bytes - head - map_bytes;
+            if (head > 0) {
+                munmap(raw, head);
+            }
+            if (tail > 0) {
+                munmap((void *)(start + map_bytes), tail);
+            }
+
+            record.map_base = (void *)start;
+            record.map_bytes = map_bytes;
+            record.huge_pages =
+                (madvise(record.map_base, map_bytes, MADV_HUGEPAGE) == 0);
+
+            T *elements = (T *)record.map_base;
+            for (size_t i = 0; i < count; i++) {
+                new (elements + i) T;
+            }
+            return elements;
+        }
     }
+#endif
 
-    // overloaded at() const
-    inline const array_element_type &at(int x1) const {
-#if ARRAY_BOUNDS_CHECK == 1
+#if defined(__linux__)
+    if (option == ALLOC_ZERO) {
+        size_t page = sysconf(_SC_PAGESIZE);
+        size_t map_bytes = (count * sizeof(T) + page - 1) / page * page;
 
-        if ((x1 < 0) || (x1 >= size1)) {
+        void *raw = mmap(0, map_bytes, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
 
-            printf("index x1 is less than 0 or  equal to size1 or greater than "
-                   "size1\n");
-            printf("x1=%d \n", x1);
-            printf("size1=%d \n", size1);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
+        if (raw != MAP_FAILED) {
+#if defined(MADV_NOHUGEPAGE)
+            // one written element should make one page resident, not 2 MB
+            madvise(raw, map_bytes, MADV_NOHUGEPAGE);
 #endif
+            record.map_base = raw;
+            record.map_bytes = map_bytes;
 
-        return internal_array[x1];
+            // a no-op for plain element types, which leaves the pages
+            // untouched
+            T *elements = (T *)raw;
+            for (size_t i = 0; i < count; i++) {
+                new (elements + i) T;
+            }
+            return elements;
+        }
     }
+#endif
 
-    // constructor
-    array1d(int dim1) {
+    if (option == ALLOC_ZERO) {
+        return new T[count]();
+    }
+    return new T[count];
+}
+
+// Destroys and releases elements obtained from allocate_elements().
+template <class T> void free_elements(T *elements, allocation_record &record) {
+#if defined(__linux__)
+    if (record.map_base != 0) {
+        for (size_t i = 0; i < record.capacity; i++) {
+            elements[i].~T();
+        }
+        munmap(record.map_base, record.map_bytes);
+        record.map_base = 0;
+        record.map_bytes = 0;
+        record.huge_pages = false;
+        return;
+    }
+#endif
+    delete[] elements;
+}
+
+// Returns true if the memory in record is backed by huge pages right now.
+// Pages are only assigned on first touch, so call this after the array
+// has been written.
+inline bool huge_pages_in_use(const allocation_record &record) {
+    return record.huge_pages &&
+           huge_page_bytes(record.map_base, record.map_bytes) > 0;
+}
+
+// Returns the number of bytes of [base, base+bytes) currently in physical
+// memory, counted in whole pages with mincore(). Returns bytes where
+// mincore() is not available.
+inline size_t resident_bytes(const void *base, size_t bytes) {
+#if defined(__linux__)
+    size_t page = sysconf(_SC_PAGESIZE);
+    uintptr_t first = (uintptr_t)base / page * page;
+    uintptr_t last = ((uintptr_t)base + bytes + page - 1) / page * page;
+    size_t pages = (last - first) / page;
+
+    unsigned char *in_core = new unsigned char[pages];
+    size_t total = bytes;
+    if (mincore((void *)first, last - first, in_core) == 0) {
+        total = 0;
+        for (size_t p = 0; p < pages; p++) {
+            if (in_core[p] & 1) {
+                total += page;
+            }
+        }
+        // the first and last page may extend beyond the range
+        total = (total < bytes) ? total : bytes;
+    }
+    delete[] in_core;
+    return total;
+#else
+    (void)base;
+    return bytes;
+#endif
+}
 
-        if (dim1 <= 0) {
-            printf("dim1 is less than or equal to 0\n");
-            printf("dim1=%d \n", dim1);
+// Stops the program if one of the rank extents in dims is not positive.
+inline void check_extents(int rank, const int *dims) {
+    for (int d = 0; d < rank; d++) {
+        if (dims[d] <= 0) {
+            printf("dim%d is less than or equal to 0\n", d + 1);
+            printf("dim%d=%d \n", d + 1, dims[d]);
             printf("file %s, line %d.\n", __FILE__, __LINE__);
             raise(SIGSEGV);
-        } else {
-            size1 = dim1;
-            internal_array = new array_element_type[size1];
         }
     }
+}
 
-    // destructor
-    ~array1d() { delete[] internal_array; }
-
-    // note that even though array1d is a template, inside defintion of array1d
-    // array1d means same as array1d<array_element_type>
-  private:
-    // prohibit copy constructor
-    array1d(array1d &);
-
-    // prohibit assignment operator
-    array1d &operator=(array1d &);
-};
+// product of the rank extents in dims
+inline size_t count_elements(int rank, const int *dims) {
+    size_t count = 1;
+    for (int d = 0; d < rank; d++) {
+        count *= dims[d];
+    }
+    return count;
+}
+
+// Grows the capacity of elements to at least count elements, moving the
+// first used elements to the new block. Never shrinks.
+template <class T>
+void reserve_elements(T *&elements, allocation_record &record, size_t used,
+                      size_t count) {
+    if (count <= record.capacity) {
+        return;
+    }
 
-////////////// end class array1d /////////////////////
+#if defined(__linux__) && defined(MREMAP_MAYMOVE)
+    // let the kernel grow or move an ALLOC_ZERO mapping, pages that were
+    // never written stay without memory
+    if (record.option == ALLOC_ZERO && record.map_base != 0 &&
+        std::is_trivially_copyable<T>::value) {
+        size_t page = sysconf(_SC_PAGESIZE);
+        size_t map_bytes = (count * sizeof(T) + page - 1) / page * page;
+        void *moved = mremap(record.map_base, record.map_bytes, map_bytes,
+                             MREMAP_MAYMOVE);
+        if (moved != MAP_FAILED) {
+            elements = (T *)moved;
+            record.map_base = moved;
+            record.map_bytes = map_bytes;
+            record.capacity = count;
+            return;
+        }
+    }
+#endif
 
-//////////////// start class array2d /////////////////////
+    allocation_record new_record;
+    T *new_elements = allocate_elements<T>(count, record.option, new_record);
 
-template <class array_element_type> class array2d {
+    for (size_t i = 0; i < used; i++) {
+        new_elements[i] = std::move(elements[i]);
+    }
 
-  private:
-    // number of rows
-    int size1;
-    // number of columns
-    int size2;
+    free_elements(elements, record);
+    elements = new_elements;
+    record = new_record;
+}
 
-    array_element_type *internal_array;
+// Changes the extents of an N dimensional array from old_dims to
+// new_dims, keeping the elements whose indices are valid in both.
+//
+// If only the slowest dimension changes (the last one for FORTRAN_ORDER 1,
+// the first one otherwise) the existing elements already sit at their new
+// offsets, so nothing moves unless the capacity has to grow. Otherwise the
+// overlapping region is moved once, run by run along the fastest
+// dimension, into a new block. Elements outside the overlap have
+// unspecified values, as after new[].
+template <int N, class T>
+void resize_elements(T *&elements, allocation_record &record,
+                     const int *old_dims, const int *new_dims) {
+    const int rank = N;
+#if FORTRAN_ORDER == 1
+    const int fastest = 0;
+    const int slowest = rank - 1;
+#else
+    const int fastest = rank - 1;
+    const int slowest = 0;
+#endif
 
-  public:
-    inline int length1(void) const { return size1; }
+    size_t old_count = count_elements(rank, old_dims);
+    size_t new_count = count_elements(rank, new_dims);
 
-    inline int length2(void) const { return size2; }
+    bool only_slowest = true;
+    for (int d = 0; d < rank; d++) {
+        if (d != slowest && old_dims[d] != new_dims[d]) {
+            only_slowest = false;
+        }
+    }
 
-    inline array_element_type &at(int x1, int x2) {
+    if (only_slowest) {
+        size_t kept = (old_count < new_count) ? old_count : new_count;
+        reserve_elements(elements, record, kept, new_count);
+        return;
+    }
 
-#if ARRAY_BOUNDS_CHECK == 1
+    // strides of both layouts and extents of the overlapping region
+    size_t old_stride[N], new_stride[N];
+    int overlap[N], index[N];
+#if FORTRAN_ORDER == 1
+    old_stride[0] = 1;
+    new_stride[0] = 1;
+    for (int d = 1; d < rank; d++) {
+        old_stride[d] = old_stride[d - 1] * old_dims[d - 1];
+        new_stride[d] = new_stride[d - 1] * new_dims[d - 1];
+    }
+#else
+    old_stride[rank - 1] = 1;
+    new_stride[rank - 1] = 1;
+    for (int d = rank - 2; d >= 0; d--) {
+        old_stride[d] = old_stride[d + 1] * old_dims[d + 1];
+        new_stride[d] = new_stride[d + 1] * new_dims[d + 1];
+    }
+#endif
+    for (int d = 0; d < rank; d++) {
+        overlap[d] = (old_dims[d] < new_dims[d]) ? old_dims[d] : new_dims[d];
+        index[d] = 0;
+    }
 
-        if ((x1 < 0) || (x1 >= size1)) {
+    size_t capacity = (new_count > record.capacity) ? new_count
+                                                    : record.capacity;
+    allocation_record new_record;
+    T *new_elements =
+        allocate_elements<T>(capacity, record.option, new_record);
 
-            printf("index x1 is less than 0 or  equal to size1 or greater than "
-                   "size1\n");
-            printf("x1=%d \n", x1);
-            printf("size1=%d \n", size1);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
+    // walk the overlap with an odometer over every dimension but the
+    // fastest one, moving one contiguous run per step
+    int run = overlap[fastest];
+    bool done = false;
+    while (!done) {
+        size_t from = 0, to = 0;
+        for (int d = 0; d < rank; d++) {
+            from += index[d] * old_stride[d];
+            to += index[d] * new_stride[d];
         }
-
-        if ((x2 < 0) || (x2 >= size2)) {
-
-            printf("index x2 is less than 0 or  equal to size2 or greater than "
-                   "size2\n");
-            printf("x2=%d \n", x2);
-            printf("size2=%d \n", size2);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
+        for (int i = 0; i < run; i++) {
+            new_elements[to + i] = std::move(elements[from + i]);
         }
 
-#endif
-
-        // x1 is row number and x2 is column number
-
+        done = true;
+        for (int k = 0; k < rank; k++) {
 #if FORTRAN_ORDER == 1
-        // fortran convention
-        // first index changes fastest
-        return internal_array[x2 * size1 + x1];
+            int d = k;
 #else
-        // C convention
-        // last index changes fastest
-        return internal_array[x1 * size2 + x2];
+            int d = rank - 1 - k;
 #endif
+            if (d == fastest) {
+                continue;
+            }
+            if (++index[d] < overlap[d]) {
+                done = false;
+                break;
+            }
+            index[d] = 0;
+        }
     }
 
-    // overloaded at() const
-    inline const array_element_type &at(int x1, int x2) const {
-
-#if ARRAY_BOUNDS_CHECK == 1
-
-        if ((x1 < 0) || (x1 >= size1)) {
+    free_elements(elements, record);
+    elements = new_elements;
+    record = new_record;
+}
 
-            printf("index x1 is less than 0 or  equal to size1 or greater than "
-                   "size1\n");
-            printf("x1=%d \n", x1);
-            printf("size1=%d \n", size1);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
+////////////// end allocation helpers /////////////////////
 
-        if ((x2 < 0) || (x2 >= size2)) {
+//////////////// start thread helpers /////////////////////
 
-            printf("index x2 is less than 0 or  equal to size2 or greater than "
-                   "size2\n");
-            printf("x2=%d \n", x2);
-            printf("size2=%d \n", size2);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
+// Parallel code in orca_array uses OpenMP. Its pragmas are written as
+// ORCA_OMP(omp ...), which expands to nothing without -fopenmp, so that
+// everything runs on the calling thread and no unknown pragma warnings
+// are given. ORCA_OMP_SIMD(omp ...) is for loops marked omp simd, which
+// -fopenmp-simd enables without defining _OPENMP: compile with
+// -fopenmp-simd -DORCA_OPENMP_SIMD=1 to get only those.
+#if defined(_OPENMP)
+#define ORCA_OMP(directive) _Pragma(#directive)
+#else
+#define ORCA_OMP(directive)
+#endif
 
+#if defined(_OPENMP) || (defined(ORCA_OPENMP_SIMD) && ORCA_OPENMP_SIMD == 1)
+#define ORCA_OMP_SIMD(directive) _Pragma(#directive)
+#else
+#define ORCA_OMP_SIMD(directive)
 #endif
 
-        // x1 is row number and x2 is column number
+// number of threads a parallel region started now would use
+inline int max_threads(void) {
+#if defined(_OPENMP)
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
 
-#if FORTRAN_ORDER == 1
-        // fortran convention
-        // first index changes fastest
-        return internal_array[x2 * size1 + x1];
+// number of the calling thread inside a parallel region, 0 outside
+inline int thread_num(void) {
+#if defined(_OPENMP)
+    return omp_get_thread_num();
 #else
-        // C convention
-        // last index changes fastest
-        return internal_array[x1 * size2 + x2];
+    return 0;
 #endif
+}
+
+////////////// end thread helpers /////////////////////
+
+//////////////// start index helpers /////////////////////
+
+// x1*factor[0] + x2*factor[1] + ... expanded at compile time. Offsets are
+// computed in size_t, arrays may have more than 2^31 elements.
+inline size_t dot_factors(const size_t *) { return 0; }
+
+template <class... Rest>
+inline size_t dot_factors(const size_t *factor, int x, Rest... rest) {
+    return (size_t)x * factor[0] + dot_factors(factor + 1, rest...);
+}
+
+// C order offset, the factor of the last index is always 1
+inline size_t c_offset(const size_t *, int x) { return (size_t)x; }
+
+template <class... Rest>
+inline size_t c_offset(const size_t *factor, int x, Rest... rest) {
+    return (size_t)x * factor[0] + c_offset(factor + 1, rest...);
+}
+
+// Fortran order offset, the factor of the first index is always 1
+template <class... Rest>
+inline size_t fortran_offset(const size_t *factor, int x1, Rest... rest) {
+    return (size_t)x1 + dot_factors(factor + 1, rest...);
+}
+
+// Fortran order factors F and C order factors C of an array with the
+// given rank and sizes
+inline void compute_factors(int rank, const int *size, size_t *F,
+                            size_t *C) {
+    // Fortran convention
+    F[0] = 1;
+    for (int d = 1; d < rank; d++) {
+        F[d] = F[d - 1] * (size_t)size[d - 1];
     }
 
-    // constructor
-    array2d(int dim1, int dim2) {
+    // C convention
+    // last index changes fastest
+    C[rank - 1] = 1;
+    for (int d = rank - 2; d >= 0; d--) {
+        C[d] = C[d + 1] * (size_t)size[d + 1];
+    }
+}
 
-        if (dim1 <= 0) {
-            printf("dim1 is less than or  equal to 0\n");
-            printf("dim1=%d \n", dim1);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        } else if (dim2 <= 0) {
-            printf("dim2 is less than or equal to 0\n");
-            printf("dim2=%d \n", dim2);
+// the fastest dimension of a rank N array, the one with unit stride,
+// counted from 1 like length()
+template <int N> inline int fastest_dimension(void) {
+#if FORTRAN_ORDER == 1
+    return 1;
+#else
+    return N;
+#endif
+}
+
+// Store constructor arguments of a rank N container: N extents optionally
+// followed by an allocation_option. D extents have been read so far.
+template <int N, int D>
+inline void read_extents(int *, allocation_option &) {
+    static_assert(D == N, "expected N extents");
+}
+
+template <int N, int D>
+inline void read_extents(int *, allocation_option &option,
+                         allocation_option last) {
+    static_assert(D == N, "allocation_option must follow all N extents");
+    option = last;
+}
+
+template <int N, int D, class... Rest>
+inline void read_extents(int *size, allocation_option &option, int dim,
+                         Rest... rest) {
+    static_assert(D < N, "got more than N extents");
+    size[D] = dim;
+    read_extents<N, D + 1>(size, option, rest...);
+}
+
+// Stops the program if one of the rank indices is outside 0 ... size-1.
+inline void check_indices(int rank, const int *index, const int *size) {
+    for (int d = 0; d < rank; d++) {
+        if ((index[d] < 0) || (index[d] >= size[d])) {
+
+            printf("index x%d is less than 0 or  equal to size%d or "
+                   "greater than size%d\n",
+                   d + 1, d + 1, d + 1);
+            printf("x%d=%d \n", d + 1, index[d]);
+            printf("size%d=%d \n", d + 1, size[d]);
             printf("file %s, line %d.\n", __FILE__, __LINE__);
             raise(SIGSEGV);
-        } else {
-            size1 = dim1;
-            size2 = dim2;
-            internal_array = new array_element_type[size1 * size2];
         }
     }
+}
+
+// Stops the program unless offset is less than the number of elements.
+inline void check_offset(size_t offset, size_t elements) {
+    if (offset >= elements) {
+        printf("offset is equal to or greater than the number of "
+               "elements\n");
+        printf("offset=%lu \n", (unsigned long)offset);
+        printf("elements=%lu \n", (unsigned long)elements);
+        printf("file %s, line %d.\n", __FILE__, __LINE__);
+        raise(SIGSEGV);
+    }
+}
 
-    // destructor
-    ~array2d() { delete[] internal_array; }
-
-    // note that even though array2d is a template, inside defintion of array2d
-    // array2d means same as array2d<array_element_type>
-  private:
-    // prohibit copy constructor
-    array2d(array2d &);
+////////////// end index helpers /////////////////////
 
-    // prohibit assignment operator
-    array2d &operator=(array2d &);
-};
+//////////////// start class arraynd /////////////////////
 
-////////////// end class array2d /////////////////////
+// N dimensional array. array1d<T> to array7d<T> are aliases of
+// arraynd<T, 1> to arraynd<T, 7>, and higher ranks work the same way.
+template <class array_element_type, int N> class arraynd {
 
-//////////////// start class array3d /////////////////////
-template <class array_element_type> class array3d {
+    static_assert(N >= 1, "arraynd needs at least one dimension");
 
   private:
-    // x-axis
-    int size1;
-    // y-axis
-    int size2;
-    // z-axis (think of like floor in a building)
-    int size3;
-
-    // size2size1 and size2size3 did not improve performance
-    ////but this approach may improve performance for higher dimensions
-    // size2size1=size2*size1 in constructor
-    //  int size2size1;
-
-    // size2size3=size2*size3 in constructor
-    //  int size2size3;
+    // size[0] is size1, size[1] is size2 ...
+    int size[N];
 
     array_element_type *internal_array;
 
+    // how internal_array was allocated
+    allocation_record record;
+
     // factors for Fortran order
-    int F1, F2, F3;
+    size_t F[N];
 
     // factors for C order
-    int C1, C2, C3;
+    size_t C[N];
 
   public:
-    inline int length1(void) const { return size1; }
+    // rank of the array
+    static const int rank = N;
 
-    inline int length2(void) const { return size2; }
+    // extent of dimension dim, counted from 1 like length1() ... lengthN()
+    inline int length(int dim) const { return size[dim - 1]; }
 
-    inline int length3(void) const { return size3; }
+    inline int length1(void) const { return size[0]; }
 
-    inline array_element_type &at(int x1, int x2, int x3) {
+    inline int length2(void) const {
+        static_assert(N >= 2, "length2() needs at least 2 dimensions");
+        return size[1];
+    }
 
-#if ARRAY_BOUNDS_CHECK == 1
+    inline int length3(void) const {
+        static_assert(N >= 3, "length3() needs at least 3 dimensions");
+        return size[2];
+    }
 
-        if ((x1 < 0) || (x1 >= size1)) {
+    inline int length4(void) const {
+        static_assert(N >= 4, "length4() needs at least 4 dimensions");
+        return size[3];
+    }
 
-            printf("index x1 is less than 0 or  equal to size1 or greater than "
-                   "size1\n");
-            printf("x1=%d \n", x1);
-            printf("size1=%d \n", size1);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
+    inline int length5(void) const {
+        static_assert(N >= 5, "length5() needs at least 5 dimensions");
+        return size[4];
+    }
 
-        if ((x2 < 0) || (x2 >= size2)) {
+    inline int length6(void) const {
+        static_assert(N >= 6, "length6() needs at least 6 dimensions");
+        return size[5];
+    }
 
-            printf("index x2 is less than 0 or  equal to size2 or greater than "
-                   "size2\n");
-            printf("x2=%d \n", x2);
-            printf("size2=%d \n", size2);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
+    inline int length7(void) const {
+        static_assert(N >= 7, "length7() needs at least 7 dimensions");
+        return size[6];
+    }
 
-        if ((x3 < 0) || (x3 >= size3)) {
+    // number of elements, product of the extents
+    inline size_t num_elements(void) const { return count_elements(N, size); }
 
-            printf("index x3 is less than 0 or  equal to size3 or greater than "
-                   "size3\n");
-            printf("x3=%d \n", x3);
-            printf("size3=%d \n", size3);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
+    // first element, the others follow in Fortran or C order
+    inline array_element_type *data(void) { return internal_array; }
 
-#endif
+    inline const array_element_type *data(void) const { return internal_array; }
 
+    // Distance in elements between index x and x+1 of dimension dim, the
+    // form FFT and BLAS libraries take together with data().
+    inline ptrdiff_t stride(int dim) const {
 #if FORTRAN_ORDER == 1
-        // fortran convention
-        // first index changes fastest
-        //   return  internal_array[x3*size2*size1 + x2*size1 + x1];
-        return internal_array[x3 * F3 + x2 * F2 + x1 * F1];
+        return F[dim - 1];
 #else
-        // C convention
-        // last index changes fastest
-        //  return  internal_array[x1*size2*size3 + x2*size3 + x3];
-        return internal_array[x1 * C1 + x2 * C2 + x3 * C3];
-
+        return C[dim - 1];
 #endif
     }
 
-    // overloaded at() const
-    inline const array_element_type &at(int x1, int x2, int x3) const {
-
-#if ARRAY_BOUNDS_CHECK == 1
-
-        if ((x1 < 0) || (x1 >= size1)) {
-
-            printf("index x1 is less than 0 or  equal to size1 or greater than "
-                   "size1\n");
-            printf("x1=%d \n", x1);
-            printf("size1=%d \n", size1);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
+    // true if the array is currently backed by transparent huge pages
+    inline bool uses_huge_pages(void) const {
+        return huge_pages_in_use(record);
+    }
 
-        if ((x2 < 0) || (x2 >= size2)) {
+    // True if the elements lie in pages of their own, mapped with mmap
+    // (ALLOC_ZERO, or ALLOC_HUGE_PAGES for large arrays), rather than in
+    // heap memory they may share a page with.
+    inline bool owns_pages(void) const { return record.map_base != 0; }
 
-            printf("index x2 is less than 0 or  equal to size2 or greater than "
-                   "size2\n");
-            printf("x2=%d \n", x2);
-            printf("size2=%d \n", size2);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
+    // bytes of address space held for the elements, see capacity()
+    inline size_t virtual_bytes(void) const {
+        return record.capacity * sizeof(array_element_type);
+    }
 
-        if ((x3 < 0) || (x3 >= size3)) {
+    // Bytes of the elements currently in physical memory, in whole pages.
+    // With ALLOC_ZERO only the pages written so far count.
+    inline size_t resident_bytes(void) const {
+        return orca_array::resident_bytes(internal_array, virtual_bytes());
+    }
 
-            printf("index x3 is less than 0 or  equal to size3 or greater than "
-                   "size3\n");
-            printf("x3=%d \n", x3);
-            printf("size3=%d \n", size3);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
+    template <class... Index> inline array_element_type &at(Index... x) {
+        static_assert(sizeof...(Index) == N, "at() needs N indices");
 
+#if ARRAY_BOUNDS_CHECK == 1
+        check_indices(x...);
 #endif
 
 #if FORTRAN_ORDER == 1
         // fortran convention
         // first index changes fastest
-        //   return  internal_array[x3*size2*size1 + x2*size1 + x1];
-        return internal_array[x3 * F3 + x2 * F2 + x1 * F1];
+        //   return  internal_array[xN*FN + ... + x2*F2 + x1];
+        return internal_array[fortran_offset(F, x...)];
 #else
         // C convention
         // last index changes fastest
-        //  return  internal_array[x1*size2*size3 + x2*size3 + x3];
-        return internal_array[x1 * C1 + x2 * C2 + x3 * C3];
-
+        //   return  internal_array[x1*C1 + x2*C2 + ... + xN];
+        return internal_array[c_offset(C, x...)];
 #endif
     }
 
-    // constructor
-    array3d(int dim1, int dim2, int dim3) {
-
-        if (dim1 <= 0) {
-            printf("dim1 is less than or  equal to 0\n");
-            printf("dim1=%d \n", dim1);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        } else if (dim2 <= 0) {
-            printf("dim2 is less than or equal to 0\n");
-            printf("dim2=%d \n", dim2);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        } else if (dim3 <= 0) {
-            printf("dim3 is less than or equal to 0\n");
-            printf("dim3=%d \n", dim3);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        } else {
-            size1 = dim1;
-            size2 = dim2;
-            size3 = dim3;
-
-            F3 = size2 * size1;
-            F2 = size1;
-            F1 = 1;
+    // overloaded at() const
+    template <class... Index>
+    inline const array_element_type &at(Index... x) const {
+        static_assert(sizeof...(Index) == N, "at() needs N indices");
 
-            C1 = size2 * size3;
-            C2 = size3;
-            C3 = 1;
+#if ARRAY_BOUNDS_CHECK == 1
+        check_indices(x...);
+#endif
 
-            internal_array = new array_element_type[size1 * size2 * size3];
-        }
+#if FORTRAN_ORDER == 1
+        return internal_array[fortran_offset(F, x...)];
+#else
+        return internal_array[c_offset(C, x...)];
+#endif
     }
 
-    // destructor
-    ~array3d() { delete[] internal_array; }
-
-    // note that even though array3d is a template, inside defintion of array3d
-    // array3d means same as array3d<array_element_type>
-  private:
-    // prohibit copy constructor
-    array3d(array3d &);
+    // Linear offset of element x1 ... xN from data(), the position in
+    // Fortran or C order. at_offset(offset(x...) + stride(d)) is the
+    // neighbor at index xd+1 of dimension d.
+    template <class... Index> inline size_t offset(Index... x) const {
+        static_assert(sizeof...(Index) == N, "offset() needs N indices");
 
-    // prohibit assignment operator
-    array3d &operator=(array3d &);
-};
+#if ARRAY_BOUNDS_CHECK == 1
+        check_indices(x...);
+#endif
 
-////////////// end class array3d /////////////////////
+#if FORTRAN_ORDER == 1
+        return fortran_offset(F, x...);
+#else
+        return c_offset(C, x...);
+#endif
+    }
 
-//////////////// start class array4d /////////////////////
-template <class array_element_type> class array4d {
+    // indices x1 ... xN of the element at the given offset into index[0]
+    // ... index[N-1]
+    void index_of(size_t offset, int *index) const {
+#if ARRAY_BOUNDS_CHECK == 1
+        check_offset(offset, num_elements());
+#endif
 
-  private:
-    // x-axis
-    int size1;
-    // y-axis
-    int size2;
-    // z-axis (think of like floor in a building)
-    int size3;
-    // t-axis
-    int size4;
+        for (int d = 0; d < N; d++) {
+#if FORTRAN_ORDER == 1
+            index[d] = (int)(offset / F[d] % size[d]);
+#else
+            index[d] = (int)(offset / C[d] % size[d]);
+#endif
+        }
+    }
 
-    array_element_type *internal_array;
+    // element at linear offset, see offset()
+    inline array_element_type &at_offset(size_t offset) {
+#if ARRAY_BOUNDS_CHECK == 1
+        check_offset(offset, num_elements());
+#endif
+        return internal_array[offset];
+    }
 
-    // factors for Fortran order
-    int F1, F2, F3, F4;
+    // overloaded at_offset() const
+    inline const array_element_type &at_offset(size_t offset) const {
+#if ARRAY_BOUNDS_CHECK == 1
+        check_offset(offset, num_elements());
+#endif
+        return internal_array[offset];
+    }
 
-    // factors for C order
-    int C1, C2, C3, C4;
+    // constructor
+    // takes N extents optionally followed by an allocation_option
+    template <class... Args> explicit arraynd(Args... args) {
+        static_assert(sizeof...(Args) == N || sizeof...(Args) == N + 1,
+                      "arraynd needs N extents and an optional "
+                      "allocation_option");
+
+        allocation_option option = ALLOC_DEFAULT;
+        read_extents<N, 0>(size, option, args...);
+        check_extents(N, size);
+
+        compute_factors();
+        internal_array = allocate_elements<array_element_type>(
+            count_elements(N, size), option, record);
+    }
 
-  public:
-    inline int length1(void) const { return size1; }
+    // constructor from an array of N extents, for code that is generic in N
+    explicit arraynd(const int (&dims)[N],
+                     allocation_option option = ALLOC_DEFAULT) {
+        for (int d = 0; d < N; d++) {
+            size[d] = dims[d];
+        }
+        check_extents(N, size);
 
-    inline int length2(void) const { return size2; }
+        compute_factors();
+        internal_array = allocate_elements<array_element_type>(
+            count_elements(N, size), option, record);
+    }
 
-    inline int length3(void) const { return size3; }
+    // destructor
+    ~arraynd() { free_elements(internal_array, record); }
 
-    inline int length4(void) const { return size4; }
+    // number of elements the array can hold without reallocating
+    inline size_t capacity(void) const { return record.capacity; }
 
-    inline array_element_type &at(int x1, int x2, int x3, int x4) {
+    // Change the extents without moving any element. The new extents must
+    // give the same number of elements as the current ones.
+    template <class... Dims> void reshape(Dims... dims) {
+        static_assert(sizeof...(Dims) == N, "reshape() needs N extents");
 
-#if ARRAY_BOUNDS_CHECK == 1
+        int new_dims[N] = {static_cast<int>(dims)...};
+        check_extents(N, new_dims);
 
-        if ((x1 < 0) || (x1 >= size1)) {
+        size_t old_count = count_elements(N, size);
+        size_t new_count = count_elements(N, new_dims);
 
-            printf("index x1 is less than 0 or  equal to size1 or greater than "
-                   "size1\n");
-            printf("x1=%d \n", x1);
-            printf("size1=%d \n", size1);
+        if (new_count != old_count) {
+            printf("reshape() must keep the number of elements\n");
+            printf("old count=%lu new count=%lu \n", (unsigned long)old_count,
+                   (unsigned long)new_count);
             printf("file %s, line %d.\n", __FILE__, __LINE__);
             raise(SIGSEGV);
         }
 
-        if ((x2 < 0) || (x2 >= size2)) {
-
-            printf("index x2 is less than 0 or  equal to size2 or greater than "
-                   "size2\n");
-            printf("x2=%d \n", x2);
-            printf("size2=%d \n", size2);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
+        for (int d = 0; d < N; d++) {
+            size[d] = new_dims[d];
         }
+        compute_factors();
+    }
 
-        if ((x3 < 0) || (x3 >= size3)) {
+    // Change the extents keeping the elements whose indices are valid
+    // before and after. Changing only the slowest dimension within
+    // capacity() moves nothing.
+    template <class... Dims> void resize(Dims... dims) {
+        static_assert(sizeof...(Dims) == N, "resize() needs N extents");
 
-            printf("index x3 is less than 0 or  equal to size3 or greater than "
-                   "size3\n");
-            printf("x3=%d \n", x3);
-            printf("size3=%d \n", size3);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
+        int new_dims[N] = {static_cast<int>(dims)...};
+        check_extents(N, new_dims);
 
-        if ((x4 < 0) || (x4 >= size4)) {
+        resize_elements<N>(internal_array, record, size, new_dims);
 
-            printf("index x4 is less than 0 or  equal to size4 or greater than "
-                   "size4\n");
-            printf("x4=%d \n", x4);
-            printf("size4=%d \n", size4);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-            exit(1);
+        for (int d = 0; d < N; d++) {
+            size[d] = new_dims[d];
         }
-
-#endif
-
-#if FORTRAN_ORDER == 1
-        // fortran convention
-        // first index changes fastest
-        //   return  internal_array[x4*size3*size2*size1 + x3*size2*size1 +
-        //   x2*size1 + x1];
-
-        return internal_array[x4 * F4 + x3 * F3 + x2 * F2 + x1 * F1];
-#else
-        // C convention
-        // last index changes fastest
-        //  return  internal_array[x1*size2*size3*size4 + x2*size3*size4
-        //  +x3*size4 + x4];
-
-        return internal_array[x1 * C1 + x2 * C2 + x3 * C3 + x4 * C4];
-#endif
+        compute_factors();
     }
 
-    // overloaded at() const
-    inline const array_element_type &at(int x1, int x2, int x3, int x4) const {
-
-#if ARRAY_BOUNDS_CHECK == 1
+    // make room for count elements so that later calls to resize() that
+    // grow the slowest dimension do not reallocate
+    void reserve(size_t count) {
+        reserve_elements(internal_array, record, count_elements(N, size),
+                         count);
+    }
 
-        if ((x1 < 0) || (x1 >= size1)) {
+    // note that even though arraynd is a template, inside defintion of arraynd
+    // arraynd means same as arraynd<array_element_type, N>
+  private:
+    // recompute the Fortran order and C order factors from the sizes
+    void compute_factors(void) { orca_array::compute_factors(N, size, F, C); }
 
-            printf("index x1 is less than 0 or  equal to size1 or greater than "
-                   "size1\n");
-            printf("x1=%d \n", x1);
-            printf("size1=%d \n", size1);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
+    template <class... Index> void check_indices(Index... x) const {
+        int index[N] = {static_cast<int>(x)...};
+        orca_array::check_indices(N, index, size);
+    }
 
-        if ((x2 < 0) || (x2 >= size2)) {
+    // prohibit copy constructor
+    arraynd(arraynd &);
 
-            printf("index x2 is less than 0 or  equal to size2 or greater than "
-                   "size2\n");
-            printf("x2=%d \n", x2);
-            printf("size2=%d \n", size2);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
+    // prohibit assignment operator
+    arraynd &operator=(arraynd &);
+};
 
-        if ((x3 < 0) || (x3 >= size3)) {
+////////////// end class arraynd /////////////////////
 
-            printf("index x3 is less than 0 or  equal to size3 or greater than "
-                   "size3\n");
-            printf("x3=%d \n", x3);
-            printf("size3=%d \n", size3);
+// Stops the program unless a and b have the same extents.
+template <class T, class U, int N>
+void check_same_shape(const arraynd<T, N> &a, const arraynd<U, N> &b) {
+    for (int d = 1; d <= N; d++) {
+        if (a.length(d) != b.length(d)) {
+            printf("arrays have different extents\n");
+            printf("length%d=%d and length%d=%d \n", d, a.length(d), d,
+                   b.length(d));
             printf("file %s, line %d.\n", __FILE__, __LINE__);
             raise(SIGSEGV);
         }
+    }
+}
 
-        if ((x4 < 0) || (x4 >= size4)) {
+// the fixed rank names used throughout orca_array
+template <class array_element_type>
+using array1d = arraynd<array_element_type, 1>;
 
-            printf("index x4 is less than 0 or  equal to size4 or greater than "
-                   "size4\n");
-            printf("x4=%d \n", x4);
-            printf("size4=%d \n", size4);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-            exit(1);
-        }
+template <class array_element_type>
+using array2d = arraynd<array_element_type, 2>;
 
-#endif
+template <class array_element_type>
+using array3d = arraynd<array_element_type, 3>;
 
-#if FORTRAN_ORDER == 1
-        // fortran convention
-        // first index changes fastest
-        //   return  internal_array[x4*size3*size2*size1 + x3*size2*size1 +
-        //   x2*size1 + x1];
+template <class array_element_type>
+using array4d = arraynd<array_element_type, 4>;
 
-        return internal_array[x4 * F4 + x3 * F3 + x2 * F2 + x1 * F1];
-#else
-        // C convention
-        // last index changes fastest
-        //  return  internal_array[x1*size2*size3*size4 + x2*size3*size4
-        //  +x3*size4 + x4];
+template <class array_element_type>
+using array5d = arraynd<array_element_type, 5>;
 
-        return internal_array[x1 * C1 + x2 * C2 + x3 * C3 + x4 * C4];
-#endif
-    }
-
-    // constructor
-    array4d(int dim1, int dim2, int dim3, int dim4) {
-
-        if (dim1 <= 0) {
-            printf("dim1 is less than or  equal to 0\n");
-            printf("dim1=%d \n", dim1);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        } else if (dim2 <= 0) {
-            printf("dim2 is less than or equal to 0\n");
-            printf("dim2=%d \n", dim2);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        } else if (dim3 <= 0) {
-            printf("dim3 is less than or equal to 0\n");
-            printf("dim3=%d \n", dim3);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        } else if (dim4 <= 0) {
-            printf("dim4 is less than or equal to 0\n");
-            printf("dim4=%d \n", dim4);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        } else {
-            size1 = dim1;
-            size2 = dim2;
-            size3 = dim3;
-            size4 = dim4;
-
-            internal_array =
-                new array_element_type[size1 * size2 * size3 * size4];
-
-            F4 = size3 * size2 * size1;
-            F3 = size2 * size1;
-            F2 = size1;
-            F1 = 1;
-
-            C1 = size2 * size3 * size4;
-            C2 = size3 * size4;
-            C3 = size4;
-            C4 = 1;
-        }
-    }
-
-    // destructor
-    ~array4d() { delete[] internal_array; }
-
-    // note that even though array4d is a template, inside defintion of array4d
-    // array4d means same as array4d<array_element_type>
-  private:
-    // prohibit copy constructor
-    array4d(array4d &);
-
-    // prohibit assignment operator
-    array4d &operator=(array4d &);
-};
-
-////////////// end class array4d /////////////////////
-
-//////////////// start class array5d /////////////////////
-template <class array_element_type> class array5d {
-
-  private:
-    // x-axis
-    int size1;
-    // y-axis
-    int size2;
-    // z-axis (think of like floor in a building)
-    int size3;
-    // t-axis
-    int size4;
-    //
-    int size5;
-
-    array_element_type *internal_array;
-
-    // factors for Fortran order
-    int F1, F2, F3, F4, F5;
-
-    // factors for C order
-    int C1, C2, C3, C4, C5;
-
-  public:
-    inline int length1(void) const { return size1; }
-
-    inline int length2(void) const { return size2; }
-
-    inline int length3(void) const { return size3; }
-
-    inline int length4(void) const { return size4; }
-
-    inline int length5(void) const { return size5; }
-
-    inline array_element_type &at(int x1, int x2, int x3, int x4, int x5) {
-
-#if ARRAY_BOUNDS_CHECK == 1
-
-        if ((x1 < 0) || (x1 >= size1)) {
-
-            printf("index x1 is less than 0 or  equal to size1 or greater than "
-                   "size1\n");
-            printf("x1=%d \n", x1);
-            printf("size1=%d \n", size1);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
-
-        if ((x2 < 0) || (x2 >= size2)) {
-
-            printf("index x2 is less than 0 or  equal to size2 or greater than "
-                   "size2\n");
-            printf("x2=%d \n", x2);
-            printf("size2=%d \n", size2);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
-
-        if ((x3 < 0) || (x3 >= size3)) {
-
-            printf("index x3 is less than 0 or  equal to size3 or greater than "
-                   "size3\n");
-            printf("x3=%d \n", x3);
-            printf("size3=%d \n", size3);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
-
-        if ((x4 < 0) || (x4 >= size4)) {
-
-            printf("index x4 is less than 0 or  equal to size4 or greater than "
-                   "size4\n");
-            printf("x4=%d \n", x4);
-            printf("size4=%d \n", size4);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
-
-        if ((x5 < 0) || (x5 >= size5)) {
-
-            printf("index x5 is less than 0 or  equal to size5 or greater than "
-                   "size5\n");
-            printf("x5=%d \n", x5);
-            printf("size5=%d \n", size5);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
-#endif
-
-#if FORTRAN_ORDER == 1
-        // fortran convention
-        // first index changes fastest
-        //   return  internal_array[x5*size4*size3*size2*size1 +
-        //   x4*size3*size2*size1 + x3*size2*size1 + x2*size1 + x1];
-
-        return internal_array[x5 * F5 + x4 * F4 + x3 * F3 + x2 * F2 + x1 * F1];
-
-#else
-        // C convention
-        // last index changes fastest
-        //  return  internal_array[x1*size2*size3*size4*size5 +
-        //                               x2*size3*size4*size5 +
-        //                                     x3*size4*size5 +
-        //                                           x4*size5 + x5];
-
-        return internal_array[x1 * C1 + x2 * C2 + x3 * C3 + x4 * C4 + x5 * C5];
-
-#endif
-    }
-
-    // overloaded at() const
-    inline const array_element_type &at(int x1, int x2, int x3, int x4,
-                                        int x5) const {
-
-#if ARRAY_BOUNDS_CHECK == 1
-
-        if ((x1 < 0) || (x1 >= size1)) {
-
-            printf("index x1 is less than 0 or  equal to size1 or greater than "
-                   "size1\n");
-            printf("x1=%d \n", x1);
-            printf("size1=%d \n", size1);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
-
-        if ((x2 < 0) || (x2 >= size2)) {
-
-            printf("index x2 is less than 0 or  equal to size2 or greater than "
-                   "size2\n");
-            printf("x2=%d \n", x2);
-            printf("size2=%d \n", size2);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
-
-        if ((x3 < 0) || (x3 >= size3)) {
-
-            printf("index x3 is less than 0 or  equal to size3 or greater than "
-                   "size3\n");
-            printf("x3=%d \n", x3);
-            printf("size3=%d \n", size3);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
-
-        if ((x4 < 0) || (x4 >= size4)) {
-
-            printf("index x4 is less than 0 or  equal to size4 or greater than "
-                   "size4\n");
-            printf("x4=%d \n", x4);
-            printf("size4=%d \n", size4);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
-
-        if ((x5 < 0) || (x5 >= size5)) {
-
-            printf("index x5 is less than 0 or  equal to size5 or greater than "
-                   "size5\n");
-            printf("x5=%d \n", x5);
-            printf("size5=%d \n", size5);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
-#endif
-
-#if FORTRAN_ORDER == 1
-        // fortran convention
-        // first index changes fastest
-        //   return  internal_array[x5*size4*size3*size2*size1 +
-        //   x4*size3*size2*size1 + x3*size2*size1 + x2*size1 + x1];
-
-        return internal_array[x5 * F5 + x4 * F4 + x3 * F3 + x2 * F2 + x1 * F1];
-
-#else
-        // C convention
-        // last index changes fastest
-        //  return  internal_array[x1*size2*size3*size4*size5 +
-        //                               x2*size3*size4*size5 +
-        //                                     x3*size4*size5 +
-        //                                           x4*size5 + x5];
-
-        return internal_array[x1 * C1 + x2 * C2 + x3 * C3 + x4 * C4 + x5 * C5];
-
-#endif
-    }
-
-    // constructor
-    array5d(int dim1, int dim2, int dim3, int dim4, int dim5) {
-
-        if (dim1 <= 0) {
-            printf("dim1 is less than or  equal to 0\n");
-            printf("dim1=%d \n", dim1);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        } else if (dim2 <= 0) {
-            printf("dim2 is less than or equal to 0\n");
-            printf("dim2=%d \n", dim2);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        } else if (dim3 <= 0) {
-            printf("dim3 is less than or equal to 0\n");
-            printf("dim3=%d \n", dim3);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        } else if (dim4 <= 0) {
-            printf("dim4 is less than or equal to 0\n");
-            printf("dim4=%d \n", dim4);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        } else if (dim5 <= 0) {
-            printf("dim5 is less than or equal to 0\n");
-            printf("dim5=%d \n", dim5);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        } else {
-            size1 = dim1;
-            size2 = dim2;
-            size3 = dim3;
-            size4 = dim4;
-            size5 = dim5;
-
-            internal_array =
-                new array_element_type[size1 * size2 * size3 * size4 * size5];
-
-            F5 = size4 * size3 * size2 * size1;
-            F4 = size3 * size2 * size1;
-            F3 = size2 * size1;
-            F2 = size1;
-            F1 = 1;
-
-            C1 = size2 * size3 * size4 * size5;
-            C2 = size3 * size4 * size5;
-            C3 = size4 * size5;
-            C4 = size5;
-            C5 = 1;
-        }
-    }
-    // destructor
-    ~array5d() { delete[] internal_array; }
-
-    // note that even though array5d is a template, inside defintion of array5d
-    // array5d means same as array5d<array_element_type>
-  private:
-    // prohibit copy constructor
-    array5d(array5d &);
-
-    // prohibit assignment operator
-    array5d &operator=(array5d &);
-};
-
-////////////// end class array5d /////////////////////
-
-//////////////// start class array6d /////////////////////
-template <class array_element_type> class array6d {
-
-  private:
-    // x-axis
-    int size1;
-    // y-axis
-    int size2;
-    // z-axis (think of like floor in a building)
-    int size3;
-    // t-axis
-    int size4;
-    //
-    int size5;
-
-    int size6;
-
-    array_element_type *internal_array;
-
-    // factors for Fortran order
-    int F1, F2, F3, F4, F5, F6;
-
-    // factors for C order
-    int C1, C2, C3, C4, C5, C6;
-
-  public:
-    inline int length1(void) const { return size1; }
-
-    inline int length2(void) const { return size2; }
-
-    inline int length3(void) const { return size3; }
-
-    inline int length4(void) const { return size4; }
-
-    inline int length5(void) const { return size5; }
-
-    inline int length6(void) const { return size6; }
-
-    inline array_element_type &at(int x1, int x2, int x3, int x4, int x5,
-                                  int x6) {
-
-#if ARRAY_BOUNDS_CHECK == 1
-
-        if ((x1 < 0) || (x1 >= size1)) {
-
-            printf("index x1 is less than 0 or  equal to size1 or greater than "
-                   "size1\n");
-            printf("x1=%d \n", x1);
-            printf("size1=%d \n", size1);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
-
-        if ((x2 < 0) || (x2 >= size2)) {
-
-            printf("index x2 is less than 0 or  equal to size2 or greater than "
-                   "size2\n");
-            printf("x2=%d \n", x2);
-            printf("size2=%d \n", size2);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
-
-        if ((x3 < 0) || (x3 >= size3)) {
-
-            printf("index x3 is less than 0 or  equal to size3 or greater than "
-                   "size3\n");
-            printf("x3=%d \n", x3);
-            printf("size3=%d \n", size3);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
-
-        if ((x4 < 0) || (x4 >= size4)) {
-
-            printf("index x4 is less than 0 or  equal to size4 or greater than "
-                   "size4\n");
-            printf("x4=%d \n", x4);
-            printf("size4=%d \n", size4);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
-
-        if ((x5 < 0) || (x5 >= size5)) {
-
-            printf("index x5 is less than 0 or  equal to size5 or greater than "
-                   "size5\n");
-            printf("x5=%d \n", x5);
-            printf("size5=%d \n", size5);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
-
-        if ((x6 < 0) || (x6 >= size6)) {
-
-            printf("index x6 is less than 0 or  equal to size6 or greater than "
-                   "size6\n");
-            printf("x6=%d \n", x6);
-            printf("size6=%d \n", size6);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
-
-#endif
-
-#if FORTRAN_ORDER == 1
-        // fortran convention
-        // first index changes fastest
-        //   return  internal_array[x6*size5*size4*size3*size2*size1 +
-        //   x5*size4*size3*size2*size1 +
-        //                          x4*size3*size2*size1 + x3*size2*size1 +
-        //                          x2*size1 + x1];
-
-        return internal_array[x6 * F6 + x5 * F5 + x4 * F4 + x3 * F3 + x2 * F2 +
-                              x1 * F1];
-
-#else
-        // C convention
-        // last index changes fastest
-        //  return  internal_array[x1*size2*size3*size4*size5*size6 +
-        //                               x2*size3*size4*size5*size6 +
-        //                                     x3*size4*size5*size6 +
-        //                                           x4*size5*size6 +
-        //                                                 x5*size6 + x6];
-
-        return internal_array[x1 * C1 + x2 * C2 + x3 * C3 + x4 * C4 + x5 * C5 +
-                              x6 * C6];
-
-#endif
-    }
-
-    // overloaded at() const
-    inline const array_element_type &at(int x1, int x2, int x3, int x4, int x5,
-                                        int x6) const {
-
-#if ARRAY_BOUNDS_CHECK == 1
-
-        if ((x1 < 0) || (x1 >= size1)) {
-
-            printf("index x1 is less than 0 or  equal to size1 or greater than "
-                   "size1\n");
-            printf("x1=%d \n", x1);
-            printf("size1=%d \n", size1);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
-
-        if ((x2 < 0) || (x2 >= size2)) {
-
-            printf("index x2 is less than 0 or  equal to size2 or greater than "
-                   "size2\n");
-            printf("x2=%d \n", x2);
-            printf("size2=%d \n", size2);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
-
-        if ((x3 < 0) || (x3 >= size3)) {
-
-            printf("index x3 is less than 0 or  equal to size3 or greater than "
-                   "size3\n");
-            printf("x3=%d \n", x3);
-            printf("size3=%d \n", size3);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
-
-        if ((x4 < 0) || (x4 >= size4)) {
-
-            printf("index x4 is less than 0 or  equal to size4 or greater than "
-                   "size4\n");
-            printf("x4=%d \n", x4);
-            printf("size4=%d \n", size4);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
-
-        if ((x5 < 0) || (x5 >= size5)) {
-
-            printf("index x5 is less than 0 or  equal to size5 or greater than "
-                   "size5\n");
-            printf("x5=%d \n", x5);
-            printf("size5=%d \n", size5);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
-
-        if ((x6 < 0) || (x6 >= size6)) {
-
-            printf("index x6 is less than 0 or  equal to size6 or greater than "
-                   "size6\n");
-            printf("x6=%d \n", x6);
-            printf("size6=%d \n", size6);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
-
-#endif
-
-#if FORTRAN_ORDER == 1
-        // fortran convention
-        // first index changes fastest
-        //   return  internal_array[x6*size5*size4*size3*size2*size1 +
-        //   x5*size4*size3*size2*size1 +
-        //                          x4*size3*size2*size1 + x3*size2*size1 +
-        //                          x2*size1 + x1];
-
-        return internal_array[x6 * F6 + x5 * F5 + x4 * F4 + x3 * F3 + x2 * F2 +
-                              x1 * F1];
-
-#else
-        // C convention
-        // last index changes fastest
-        //  return  internal_array[x1*size2*size3*size4*size5*size6 +
-        //                               x2*size3*size4*size5*size6 +
-        //                                     x3*size4*size5*size6 +
-        //                                           x4*size5*size6 +
-        //                                                 x5*size6 + x6];
-
-        return internal_array[x1 * C1 + x2 * C2 + x3 * C3 + x4 * C4 + x5 * C5 +
-                              x6 * C6];
-
-#endif
-    }
-
-    // constructor
-    array6d(int dim1, int dim2, int dim3, int dim4, int dim5, int dim6) {
-
-        if (dim1 <= 0) {
-            printf("dim1 is less than or  equal to 0\n");
-            printf("dim1=%d \n", dim1);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        } else if (dim2 <= 0) {
-            printf("dim2 is less than or equal to 0\n");
-            printf("dim2=%d \n", dim2);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        } else if (dim3 <= 0) {
-            printf("dim3 is less than or equal to 0\n");
-            printf("dim3=%d \n", dim3);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        } else if (dim4 <= 0) {
-            printf("dim4 is less than or equal to 0\n");
-            printf("dim4=%d \n", dim4);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        } else if (dim5 <= 0) {
-            printf("dim5 is less than or equal to 0\n");
-            printf("dim5=%d \n", dim5);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        } else if (dim6 <= 0) {
-            printf("dim6 is less than or equal to 0\n");
-            printf("dim6=%d \n", dim6);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        } else {
-            size1 = dim1;
-            size2 = dim2;
-            size3 = dim3;
-            size4 = dim4;
-            size5 = dim5;
-            size6 = dim6;
-
-            internal_array = new array_element_type[size1 * size2 * size3 *
-                                                    size4 * size5 * size6];
-
-            F6 = size5 * size4 * size3 * size2 * size1;
-            F5 = size4 * size3 * size2 * size1;
-            F4 = size3 * size2 * size1;
-            F3 = size2 * size1;
-            F2 = size1;
-            F1 = 1;
-
-            C1 = size2 * size3 * size4 * size5 * size6;
-            C2 = size3 * size4 * size5 * size6;
-            C3 = size4 * size5 * size6;
-            C4 = size5 * size6;
-            C5 = size6;
-            C6 = 1;
-        }
-    }
-
-    // destructor
-    ~array6d() { delete[] internal_array; }
-
-    // note that even though array6d is a template, inside defintion of array6d
-    // array6d means same as array6d<array_element_type>
-  private:
-    // prohibit copy constructor
-    array6d(array6d &);
-
-    // prohibit assignment operator
-    array6d &operator=(array6d &);
-};
-
-////////////// end class array6d /////////////////////
-
-//////////////// start class array7d /////////////////////
-template <class array_element_type> class array7d {
-
-  private:
-    // x-axis
-    int size1;
-    // y-axis
-    int size2;
-    // z-axis (think of like floor in a building)
-    int size3;
-    // t-axis
-    int size4;
-    //
-    int size5;
-
-    int size6;
-
-    int size7;
-
-    array_element_type *internal_array;
-
-    // factors for Fortran order
-    int F1, F2, F3, F4, F5, F6, F7;
-
-    // factors for C order
-    int C1, C2, C3, C4, C5, C6, C7;
-
-  public:
-    inline int length1(void) const { return size1; }
-
-    inline int length2(void) const { return size2; }
-
-    inline int length3(void) const { return size3; }
-
-    inline int length4(void) const { return size4; }
-
-    inline int length5(void) const { return size5; }
-
-    inline int length6(void) const { return size6; }
-
-    inline int length7(void) const { return size7; }
-
-    inline array_element_type &at(int x1, int x2, int x3, int x4, int x5,
-                                  int x6, int x7) {
-
-#if ARRAY_BOUNDS_CHECK == 1
-
-        if ((x1 < 0) || (x1 >= size1)) {
-
-            printf("index x1 is less than 0 or  equal to size1 or greater than "
-                   "size1\n");
-            printf("x1=%d \n", x1);
-            printf("size1=%d \n", size1);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
-
-        if ((x2 < 0) || (x2 >= size2)) {
-
-            printf("index x2 is less than 0 or  equal to size2 or greater than "
-                   "size2\n");
-            printf("x2=%d \n", x2);
-            printf("size2=%d \n", size2);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
-
-        if ((x3 < 0) || (x3 >= size3)) {
-
-            printf("index x3 is less than 0 or  equal to size3 or greater than "
-                   "size3\n");
-            printf("x3=%d \n", x3);
-            printf("size3=%d \n", size3);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
-
-        if ((x4 < 0) || (x4 >= size4)) {
-
-            printf("index x4 is less than 0 or  equal to size4 or greater than "
-                   "size4\n");
-            printf("x4=%d \n", x4);
-            printf("size4=%d \n", size4);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
-
-        if ((x5 < 0) || (x5 >= size5)) {
-
-            printf("index x5 is less than 0 or  equal to size5 or greater than "
-                   "size5\n");
-            printf("x5=%d \n", x5);
-            printf("size5=%d \n", size5);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
-
-        if ((x6 < 0) || (x6 >= size6)) {
-
-            printf("index x6 is less than 0 or  equal to size6 or greater than "
-                   "size6\n");
-            printf("x6=%d \n", x6);
-            printf("size6=%d \n", size6);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
-
-        if ((x7 < 0) || (x7 >= size7)) {
-
-            printf("index x7 is less than 0 or  equal to size7 or greater than "
-                   "size7\n");
-            printf("x7=%d \n", x7);
-            printf("size7=%d \n", size7);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
-
-#endif
-
-#if FORTRAN_ORDER == 1
-        // fortran convention
-        // first index changes fastest
-        //   return  internal_array[x7*size6*size5*size4*size3*size2*size1 +
-        //   x6*size5*size4*size3*size2*size1 +
-        //                          x5*size4*size3*size2*size1 +
-        //                          x4*size3*size2*size1 + x3*size2*size1 +
-        //                          x2*size1 + x1];
-
-        return internal_array[x7 * F7 + x6 * F6 + x5 * F5 + x4 * F4 + x3 * F3 +
-                              x2 * F2 + x1 * F1];
-#else
-        // C convention
-        // last index changes fastest
-        //  return  internal_array[x1*size2*size3*size4*size5*size6*size7 +
-        //                               x2*size3*size4*size5*size6*size7 +
-        //                                     x3*size4*size5*size6*size7 +
-        //                                           x4*size5*size6*size7 +
-        //                                                 x5*size6*size7 +
-        //                                                       x6*size7 + x7];
-
-        return internal_array[x1 * C1 + x2 * C2 + x3 * C3 + x4 * C4 + x5 * C5 +
-                              x6 * C6 + x7 * C7];
-#endif
-    }
-
-    // overloaded at() const
-    inline const array_element_type &at(int x1, int x2, int x3, int x4, int x5,
-                                        int x6, int x7) const {
-
-#if ARRAY_BOUNDS_CHECK == 1
-
-        if ((x1 < 0) || (x1 >= size1)) {
-
-            printf("index x1 is less than 0 or  equal to size1 or greater than "
-                   "size1\n");
-            printf("x1=%d \n", x1);
-            printf("size1=%d \n", size1);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
-
-        if ((x2 < 0) || (x2 >= size2)) {
-
-            printf("index x2 is less than 0 or  equal to size2 or greater than "
-                   "size2\n");
-            printf("x2=%d \n", x2);
-            printf("size2=%d \n", size2);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
-
-        if ((x3 < 0) || (x3 >= size3)) {
-
-            printf("index x3 is less than 0 or  equal to size3 or greater than "
-                   "size3\n");
-            printf("x3=%d \n", x3);
-            printf("size3=%d \n", size3);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
-
-        if ((x4 < 0) || (x4 >= size4)) {
-
-            printf("index x4 is less than 0 or  equal to size4 or greater than "
-                   "size4\n");
-            printf("x4=%d \n", x4);
-            printf("size4=%d \n", size4);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
-
-        if ((x5 < 0) || (x5 >= size5)) {
-
-            printf("index x5 is less than 0 or  equal to size5 or greater than "
-                   "size5\n");
-            printf("x5=%d \n", x5);
-            printf("size5=%d \n", size5);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
-
-        if ((x6 < 0) || (x6 >= size6)) {
-
-            printf("index x6 is less than 0 or  equal to size6 or greater than "
-                   "size6\n");
-            printf("x6=%d \n", x6);
-            printf("size6=%d \n", size6);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
-
-        if ((x7 < 0) || (x7 >= size7)) {
-
-            printf("index x7 is less than 0 or  equal to size7 or greater than "
-                   "size7\n");
-            printf("x7=%d \n", x7);
-            printf("size7=%d \n", size7);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        }
-
-#endif
-
-#if FORTRAN_ORDER == 1
-        // fortran convention
-        // first index changes fastest
-        //   return  internal_array[x7*size6*size5*size4*size3*size2*size1 +
-        //   x6*size5*size4*size3*size2*size1 +
-        //                          x5*size4*size3*size2*size1 +
-        //                          x4*size3*size2*size1 + x3*size2*size1 +
-        //                          x2*size1 + x1];
-
-        return internal_array[x7 * F7 + x6 * F6 + x5 * F5 + x4 * F4 + x3 * F3 +
-                              x2 * F2 + x1 * F1];
-#else
-        // C convention
-        // last index changes fastest
-        //  return  internal_array[x1*size2*size3*size4*size5*size6*size7 +
-        //                               x2*size3*size4*size5*size6*size7 +
-        //                                     x3*size4*size5*size6*size7 +
-        //                                           x4*size5*size6*size7 +
-        //                                                 x5*size6*size7 +
-        //                                                       x6*size7 + x7];
-
-        return internal_array[x1 * C1 + x2 * C2 + x3 * C3 + x4 * C4 + x5 * C5 +
-                              x6 * C6 + x7 * C7];
-#endif
-    }
-
-    // constructor
-    array7d(int dim1, int dim2, int dim3, int dim4, int dim5, int dim6,
-            int dim7) {
-
-        if (dim1 <= 0) {
-            printf("dim1 is less than or  equal to 0\n");
-            printf("dim1=%d \n", dim1);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        } else if (dim2 <= 0) {
-            printf("dim2 is less than or equal to 0\n");
-            printf("dim2=%d \n", dim2);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        } else if (dim3 <= 0) {
-            printf("dim3 is less than or equal to 0\n");
-            printf("dim3=%d \n", dim3);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        } else if (dim4 <= 0) {
-            printf("dim4 is less than or equal to 0\n");
-            printf("dim4=%d \n", dim4);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        } else if (dim5 <= 0) {
-            printf("dim5 is less than or equal to 0\n");
-            printf("dim5=%d \n", dim5);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        } else if (dim6 <= 0) {
-            printf("dim6 is less than or equal to 0\n");
-            printf("dim6=%d \n", dim6);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        } else if (dim7 <= 0) {
-            printf("dim7 is less than or equal to 0\n");
-            printf("dim7=%d \n", dim7);
-            printf("file %s, line %d.\n", __FILE__, __LINE__);
-            raise(SIGSEGV);
-        } else {
-            size1 = dim1;
-            size2 = dim2;
-            size3 = dim3;
-            size4 = dim4;
-            size5 = dim5;
-            size6 = dim6;
-            size7 = dim7;
-
-            // Fortran convention
-            F7 = size6 * size5 * size4 * size3 * size2 * size1;
-            F6 = size5 * size4 * size3 * size2 * size1;
-            F5 = size4 * size3 * size2 * size1;
-            F4 = size3 * size2 * size1;
-            F3 = size2 * size1;
-            F2 = size1;
-            F1 = 1;
-
-            // C convention
-            // last index changes fastest
-            C1 = size2 * size3 * size4 * size5 * size6 * size7;
-            C2 = size3 * size4 * size5 * size6 * size7;
-            C3 = size4 * size5 * size6 * size7;
-            C4 = size5 * size6 * size7;
-            C5 = size6 * size7;
-            C6 = size7;
-            C7 = 1;
-
-            internal_array =
-                new array_element_type[size1 * size2 * size3 * size4 * size5 *
-                                       size6 * size7];
-        }
-    }
-
-    // destructor
-    ~array7d() { delete[] internal_array; }
-
-    // note that even though array7d is a template, inside defintion of array7d
-    // array7d means same as array7d<array_element_type>
-  private:
-    // prohibit copy constructor
-    array7d(array7d &);
-
-    // prohibit assignment operator
-    array7d &operator=(array7d &);
-};
+template <class array_element_type>
+using array6d = arraynd<array_element_type, 6>;
 
-////////////// end class array7d /////////////////////
+template <class array_element_type>
+using array7d = arraynd<array_element_type, 7>;
 
 } // namespace orca_array
 
@@ -0,0 +1,429 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// File: orca_batched.hpp
+//
+// batched_array<T, N, Layout> holds a batch of same shape small rank N
+// arrays (e.g. one 5x5 Jacobian per cell) in a single allocation instead
+// of one new[] per array.
+//
+// BATCH_CONTIGUOUS   array b is one contiguous block, like a lone arraynd
+// BATCH_INTERLEAVED  element e of all arrays is contiguous across the
+//                    batch, so batched kernels vectorize across arrays
+//
+// Batched kernels: batched_fill(), batched_matvec() and batched_lu_solve().
+// Threading uses OpenMP.
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef ORCA_BATCHED
+#define ORCA_BATCHED
+
+#include "orca_array.hpp"
+
+#include <math.h>
+
+namespace orca_array {
+
+enum batch_layout { BATCH_CONTIGUOUS = 0, BATCH_INTERLEAVED = 1 };
+
+template <class array_element_type, int N, int Layout> class batched_array;
+
+//////////////// start class batch_element /////////////////////
+
+// One array of a batched_array, with the usual at(), length(dim) and
+// length1() ... length7().
+template <class array_element_type, int N, int Layout> class batch_element {
+
+  private:
+    batched_array<array_element_type, N, Layout> &batch;
+    int b;
+
+  public:
+    batch_element(batched_array<array_element_type, N, Layout> &owner,
+                  int which)
+        : batch(owner), b(which) {}
+
+    inline int length(int dim) const { return batch.length(dim); }
+
+    inline int length1(void) const { return batch.length(1); }
+
+    inline int length2(void) const {
+        static_assert(N >= 2, "length2() needs at least 2 dimensions");
+        return batch.length(2);
+    }
+
+    inline int length3(void) const {
+        static_assert(N >= 3, "length3() needs at least 3 dimensions");
+        return batch.length(3);
+    }
+
+    inline int length4(void) const {
+        static_assert(N >= 4, "length4() needs at least 4 dimensions");
+        return batch.length(4);
+    }
+
+    inline int length5(void) const {
+        static_assert(N >= 5, "length5() needs at least 5 dimensions");
+        return batch.length(5);
+    }
+
+    inline int length6(void) const {
+        static_assert(N >= 6, "length6() needs at least 6 dimensions");
+        return batch.length(6);
+    }
+
+    inline int length7(void) const {
+        static_assert(N >= 7, "length7() needs at least 7 dimensions");
+        return batch.length(7);
+    }
+
+    template <class... Index>
+    inline array_element_type &at(Index... x) const {
+        return batch.at(b, x...);
+    }
+};
+
+////////////// end class batch_element /////////////////////
+
+//////////////// start class batched_array /////////////////////
+
+template <class array_element_type, int N, int Layout = BATCH_INTERLEAVED>
+class batched_array {
+
+    static_assert(Layout == BATCH_CONTIGUOUS || Layout == BATCH_INTERLEAVED,
+                  "Layout must be BATCH_CONTIGUOUS or BATCH_INTERLEAVED");
+
+  private:
+    int batch;
+    int size[N];
+
+    // factors for Fortran order
+    size_t F[N];
+
+    // factors for C order
+    size_t C[N];
+
+    // number of elements of one array
+    size_t elements;
+
+    // distance between element e and e+1 of one array, and between the
+    // same element of array b and b+1
+    size_t element_step;
+    size_t batch_step;
+
+    array_element_type *internal_array;
+
+    // how internal_array was allocated
+    allocation_record record;
+
+  public:
+    static const int rank = N;
+    static const int layout = Layout;
+
+    // constructor
+    // takes the batch size, N extents and an optional allocation_option
+    template <class... Args> batched_array(int count, Args... args) {
+        static_assert(sizeof...(Args) == N || sizeof...(Args) == N + 1,
+                      "batched_array needs a batch size, N extents and an "
+                      "optional allocation_option");
+
+        allocation_option option = ALLOC_DEFAULT;
+        read_extents<N, 0>(size, option, args...);
+        check_extents(N, size);
+        check_extents(1, &count);
+        compute_factors(N, size, F, C);
+
+        batch = count;
+        elements = count_elements(N, size);
+
+        if (Layout == BATCH_INTERLEAVED) {
+            // pad the batch to whole 64 byte lines
+            size_t line = (sizeof(array_element_type) < 64)
+                              ? 64 / sizeof(array_element_type)
+                              : 1;
+            element_step = ((size_t)batch + line - 1) / line * line;
+            batch_step = 1;
+        } else {
+            element_step = 1;
+            batch_step = elements;
+        }
+
+        internal_array = allocate_elements<array_element_type>(
+            (Layout == BATCH_INTERLEAVED) ? elements * element_step
+                                          : elements * batch,
+            option, record);
+    }
+
+    // destructor
+    ~batched_array() { free_elements(internal_array, record); }
+
+    // number of arrays in the batch
+    inline int batch_size(void) const { return batch; }
+
+    inline int length(int dim) const { return size[dim - 1]; }
+
+    // number of elements of one array
+    inline size_t num_elements(void) const { return elements; }
+
+    inline size_t element_stride(void) const { return element_step; }
+
+    inline size_t batch_stride(void) const { return batch_step; }
+
+    inline array_element_type *data(void) { return internal_array; }
+
+    inline const array_element_type *data(void) const {
+        return internal_array;
+    }
+
+    // element x1 ... xN of array b
+    template <class... Index>
+    inline array_element_type &at(int b, Index... x) {
+        return internal_array[element_offset(b, x...)];
+    }
+
+    // overloaded at() const
+    template <class... Index>
+    inline const array_element_type &at(int b, Index... x) const {
+        return internal_array[element_offset(b, x...)];
+    }
+
+    // array b of the batch
+    inline batch_element<array_element_type, N, Layout> operator[](int b) {
+        return batch_element<array_element_type, N, Layout>(*this, b);
+    }
+
+    // position of element x1 ... xN inside one array, in Fortran or C
+    // order
+    template <class... Index> inline size_t local_offset(Index... x) const {
+#if FORTRAN_ORDER == 1
+        return fortran_offset(F, x...);
+#else
+        return c_offset(C, x...);
+#endif
+    }
+
+    // note that even though batched_array is a template, inside defintion
+    // of batched_array batched_array means same as
+    // batched_array<array_element_type, N, Layout>
+  private:
+    template <class... Index>
+    inline size_t element_offset(int b, Index... x) const {
+        static_assert(sizeof...(Index) == N, "batched_array needs N indices");
+
+#if ARRAY_BOUNDS_CHECK == 1
+        int index[N] = {static_cast<int>(x)...};
+        check_indices(1, &b, &batch);
+        check_indices(N, index, size);
+#endif
+
+        return local_offset(x...) * element_step + (size_t)b * batch_step;
+    }
+
+    // prohibit copy constructor
+    batched_array(batched_array &);
+
+    // prohibit assignment operator
+    batched_array &operator=(batched_array &);
+};
+
+////////////// end class batched_array /////////////////////
+
+//////////////// start batched kernels /////////////////////
+
+// Kernels work on chunks of lanes (arrays of the batch). With the
+// interleaved layout a chunk is batched_chunk consecutive arrays and every
+// innermost loop runs over the chunk with unit stride; with the contiguous
+// layout a chunk is one array.
+const int batched_chunk = 256;
+
+template <int Layout> inline int chunk_lanes(void) {
+    return (Layout == BATCH_INTERLEAVED) ? batched_chunk : 1;
+}
+
+template <class T, int N, int Layout>
+inline size_t batch_stride_of(const batched_array<T, N, Layout> &a) {
+    return (Layout == BATCH_INTERLEAVED) ? 1 : a.batch_stride();
+}
+
+// Stops the program unless the three batch sizes agree and the two pairs
+// of extents n1 == n2 and m1 == m2 match.
+inline void check_batch_shapes(int batch1, int batch2, int batch3, int n1,
+                               int n2, int m1, int m2) {
+    if ((batch1 != batch2) || (batch1 != batch3) || (n1 != n2) ||
+        (m1 != m2)) {
+        printf("batched arrays have different batch sizes or shapes\n");
+        printf("batch sizes %d %d %d, extents %d %d and %d %d \n", batch1,
+               batch2, batch3, n1, n2, m1, m2);
+        printf("file %s, line %d.\n", __FILE__, __LINE__);
+        raise(SIGSEGV);
+    }
+}
+
+// set every element of every array to value
+template <class T, int N, int Layout>
+void batched_fill(batched_array<T, N, Layout> &a, T value) {
+    size_t total = (Layout == BATCH_INTERLEAVED)
+                       ? a.num_elements() * a.element_stride()
+                       : a.num_elements() * a.batch_size();
+    T *p = a.data();
+
+    ORCA_OMP(omp parallel for schedule(static))
+    for (long i = 0; i < (long)total; i++) {
+        p[i] = value;
+    }
+}
+
+// y_b = A_b x_b for every array b, A is n x m, x has m and y has n elements
+template <class T, int Layout>
+void batched_matvec(const batched_array<T, 2, Layout> &A,
+                    const batched_array<T, 1, Layout> &x,
+                    batched_array<T, 1, Layout> &y) {
+    int n = A.length(1);
+    int m = A.length(2);
+    check_batch_shapes(A.batch_size(), x.batch_size(), y.batch_size(), m,
+                       x.length(1), n, y.length(1));
+
+    // offsets of A(i, j) inside one array
+    size_t row = A.local_offset(1, 0);
+    size_t col = A.local_offset(0, 1);
+
+    size_t as = A.element_stride(), xs = x.element_stride(),
+           ys = y.element_stride();
+    // the batch stride is the constant 1 for the interleaved layout, which
+    // lets the compiler vectorize the lane loops without runtime checks
+    const size_t ab = batch_stride_of(A), xb = batch_stride_of(x),
+                 yb = batch_stride_of(y);
+    int lanes = chunk_lanes<Layout>();
+    int batch = A.batch_size();
+
+    ORCA_OMP(omp parallel for schedule(static))
+    for (int b0 = 0; b0 < batch; b0 += lanes) {
+        int count = (batch - b0 < lanes) ? batch - b0 : lanes;
+        const T *a = A.data() + b0 * ab;
+        const T *xv = x.data() + b0 * xb;
+        T *yv = y.data() + b0 * yb;
+
+        for (int i = 0; i < n; i++) {
+            T *yi = yv + i * ys;
+            for (int l = 0; l < count; l++) {
+                yi[l * yb] = T();
+            }
+            for (int j = 0; j < m; j++) {
+                const T *aij = a + (i * row + j * col) * as;
+                const T *xj = xv + j * xs;
+                for (int l = 0; l < count; l++) {
+                    yi[l * yb] += aij[l * ab] * xj[l * xb];
+                }
+            }
+        }
+    }
+}
+
+// Solve A_b x_b = r_b for every array b by LU decomposition with partial
+// pivoting. A is overwritten by its factors and r by the solution.
+template <class T, int Layout>
+void batched_lu_solve(batched_array<T, 2, Layout> &A,
+                      batched_array<T, 1, Layout> &r) {
+    int n = A.length(1);
+    check_batch_shapes(A.batch_size(), r.batch_size(), r.batch_size(),
+                       A.length(2), n, n, r.length(1));
+
+    size_t row = A.local_offset(1, 0);
+    size_t col = A.local_offset(0, 1);
+    size_t as = A.element_stride(), rs = r.element_stride();
+    const size_t ab = batch_stride_of(A), rb = batch_stride_of(r);
+    int lanes = chunk_lanes<Layout>();
+    int batch = A.batch_size();
+
+    ORCA_OMP(omp parallel for schedule(static))
+    for (int b0 = 0; b0 < batch; b0 += lanes) {
+        int count = (batch - b0 < lanes) ? batch - b0 : lanes;
+        T *a = A.data() + b0 * ab;
+        T *rv = r.data() + b0 * rb;
+
+        int pivot[batched_chunk];
+        T largest[batched_chunk];
+        T factor[batched_chunk];
+
+        for (int k = 0; k < n; k++) {
+            // pivot row of every lane, compare and select only
+            const T *akk = a + (k * row + k * col) * as;
+            for (int l = 0; l < count; l++) {
+                pivot[l] = k;
+                largest[l] = fabs(akk[l * ab]);
+            }
+            for (int i = k + 1; i < n; i++) {
+                const T *aik = a + (i * row + k * col) * as;
+                for (int l = 0; l < count; l++) {
+                    T v = fabs(aik[l * ab]);
+                    bool larger = v > largest[l];
+                    largest[l] = larger ? v : largest[l];
+                    pivot[l] = larger ? i : pivot[l];
+                }
+            }
+
+            // row swaps differ per lane and are rare, do them lane by lane
+            for (int l = 0; l < count; l++) {
+                int p = pivot[l];
+                if (p == k) {
+                    continue;
+                }
+                for (int j = 0; j < n; j++) {
+                    T *x = a + (k * row + j * col) * as + l * ab;
+                    T *y = a + (p * row + j * col) * as + l * ab;
+                    T t = *x;
+                    *x = *y;
+                    *y = t;
+                }
+                T *x = rv + k * rs + l * rb;
+                T *y = rv + p * rs + l * rb;
+                T t = *x;
+                *x = *y;
+                *y = t;
+            }
+
+            // eliminate below the diagonal
+            for (int i = k + 1; i < n; i++) {
+                T *aik = a + (i * row + k * col) * as;
+                for (int l = 0; l < count; l++) {
+                    factor[l] = aik[l * ab] / akk[l * ab];
+                    aik[l * ab] = factor[l];
+                }
+                for (int j = k + 1; j < n; j++) {
+                    T *aij = a + (i * row + j * col) * as;
+                    const T *akj = a + (k * row + j * col) * as;
+                    for (int l = 0; l < count; l++) {
+                        aij[l * ab] -= factor[l] * akj[l * ab];
+                    }
+                }
+                T *ri = rv + i * rs;
+                const T *rk = rv + k * rs;
+                for (int l = 0; l < count; l++) {
+                    ri[l * rb] -= factor[l] * rk[l * rb];
+                }
+            }
+        }
+
+        // back substitution
+        for (int i = n - 1; i >= 0; i--) {
+            T *ri = rv + i * rs;
+            for (int j = i + 1; j < n; j++) {
+                const T *aij = a + (i * row + j * col) * as;
+                const T *rj = rv + j * rs;
+                for (int l = 0; l < count; l++) {
+                    ri[l * rb] -= aij[l * ab] * rj[l * rb];
+                }
+            }
+            const T *aii = a + (i * row + i * col) * as;
+            for (int l = 0; l < count; l++) {
+                ri[l * rb] /= aii[l * ab];
+            }
+        }
+    }
+}
+
+////////////// end batched kernels /////////////////////
+
+} // namespace orca_array
+
+// endif ORCA_BATCHED
+#endif
@@ -0,0 +1,256 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// File: orca_cursor.hpp
+//
+// Cursors that walk an orca_array array along one dimension, e.g. for
+// implicit solves along the slow dimension.
+//
+// A line_cursor moves by adding the precomputed stride of its dimension
+// to a pointer, so no offset is recomputed from the indices, and asks the
+// CPU to prefetch the element a chosen number of steps ahead. Along a
+// slow dimension every step lands on a new cache line far from the last
+// one, which the hardware prefetchers often do not follow.
+//
+// A pencil_cursor walks several neighboring lines at once: lanes lines
+// that are adjacent along the fastest dimension, so that every step
+// reads one contiguous row of lanes elements and uses whole cache lines
+// instead of one element of each.
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef ORCA_CURSOR
+#define ORCA_CURSOR
+
+#include "orca_array.hpp"
+
+namespace orca_array {
+
+// hint that the cache line of p will be read soon, e.g. by a cursor on a
+// const array, which need not get the line in exclusive state
+inline void prefetch_element(const void *p) {
+#if defined(__GNUC__)
+    __builtin_prefetch(p, 0, 3);
+#else
+    (void)p;
+#endif
+}
+
+// hint that the cache line of p will be written soon
+inline void prefetch_element(void *p) {
+#if defined(__GNUC__)
+    __builtin_prefetch(p, 1, 3);
+#else
+    (void)p;
+#endif
+}
+
+//////////////// start class line_cursor /////////////////////
+
+template <class array_element_type> class line_cursor {
+
+  private:
+    array_element_type *element;
+
+    // distance in elements between two steps
+    ptrdiff_t step;
+
+    // current position along the line and number of positions
+    int position;
+    int count;
+
+    // steps ahead to prefetch, 0 for none
+    int ahead;
+
+  public:
+    line_cursor(array_element_type *start, ptrdiff_t stride, int start_index,
+                int length, int prefetch_distance)
+        : element(start), step(stride), position(start_index), count(length),
+          ahead(prefetch_distance) {}
+
+    inline array_element_type &operator*() const { return *element; }
+
+    // element k steps from the current one, k may be negative
+    inline array_element_type &operator[](int k) const {
+        return element[k * step];
+    }
+
+    // index along the line of the current element
+    inline int index(void) const { return position; }
+
+    inline int length(void) const { return count; }
+
+    // true while the cursor is on an element of the line
+    inline bool valid(void) const {
+        return (position >= 0) && (position < count);
+    }
+
+    inline void next(void) {
+        element += step;
+        position++;
+        if (ahead > 0 && position + ahead < count) {
+            prefetch_element(element + ahead * step);
+        }
+    }
+
+    inline void prev(void) {
+        element -= step;
+        position--;
+        if (ahead > 0 && position - ahead >= 0) {
+            prefetch_element(element - ahead * step);
+        }
+    }
+};
+
+////////////// end class line_cursor /////////////////////
+
+//////////////// start class pencil_cursor /////////////////////
+
+template <class array_element_type> class pencil_cursor {
+
+  private:
+    // first element of the current row of lanes contiguous elements
+    array_element_type *row;
+
+    ptrdiff_t step;
+    int lanes;
+
+    int position;
+    int count;
+    int ahead;
+
+  public:
+    pencil_cursor(array_element_type *start, ptrdiff_t stride, int num_lanes,
+                  int start_index, int length, int prefetch_distance)
+        : row(start), step(stride), lanes(num_lanes), position(start_index),
+          count(length), ahead(prefetch_distance) {}
+
+    // the current element of line w = 0 ... num_lanes()-1
+    inline array_element_type &operator[](int w) const { return row[w]; }
+
+    // the num_lanes() current elements, contiguous
+    inline array_element_type *data(void) const { return row; }
+
+    // the row k steps from the current one, k may be negative
+    inline array_element_type *data(int k) const { return row + k * step; }
+
+    inline int num_lanes(void) const { return lanes; }
+
+    inline int index(void) const { return position; }
+
+    inline int length(void) const { return count; }
+
+    inline bool valid(void) const {
+        return (position >= 0) && (position < count);
+    }
+
+    inline void next(void) {
+        row += step;
+        position++;
+        if (ahead > 0 && position + ahead < count) {
+            prefetch_row(row + ahead * step);
+        }
+    }
+
+    inline void prev(void) {
+        row -= step;
+        position--;
+        if (ahead > 0 && position - ahead >= 0) {
+            prefetch_row(row - ahead * step);
+        }
+    }
+
+  private:
+    // a row may cross a cache line boundary
+    inline void prefetch_row(array_element_type *p) const {
+        prefetch_element(p);
+        prefetch_element(p + lanes - 1);
+    }
+};
+
+////////////// end class pencil_cursor /////////////////////
+
+//////////////// start cursor helpers /////////////////////
+
+// Stops the program unless dim is a dimension of a rank N array.
+inline void check_cursor_dim(int rank, int dim) {
+    if ((dim < 1) || (dim > rank)) {
+        printf("dim is less than 1 or greater than the rank\n");
+        printf("dim=%d rank=%d \n", dim, rank);
+        printf("file %s, line %d.\n", __FILE__, __LINE__);
+        raise(SIGSEGV);
+    }
+}
+
+// Stops the program unless the lanes lines starting at index lie along the
+// fastest dimension of a, which differs from dim.
+template <class T, int N>
+inline void check_pencil_lanes(const arraynd<T, N> &a, int dim, int lanes,
+                               const int *index) {
+    check_cursor_dim(N, dim);
+
+    int fast = fastest_dimension<N>();
+    if (dim == fast || lanes < 1 ||
+        index[fast - 1] + lanes > a.length(fast)) {
+        printf("pencil lanes must lie along the fastest dimension, which "
+               "must differ from dim\n");
+        printf("dim=%d lanes=%d x%d=%d length%d=%d \n", dim, lanes, fast,
+               index[fast - 1], fast, a.length(fast));
+        printf("file %s, line %d.\n", __FILE__, __LINE__);
+        raise(SIGSEGV);
+    }
+}
+
+////////////// end cursor helpers /////////////////////
+
+// Cursor on element x1 ... xN of a that moves along dimension dim
+// (counted from 1) and prefetches prefetch_distance steps ahead.
+template <class T, int N, class... Index>
+line_cursor<T> make_line_cursor(arraynd<T, N> &a, int dim,
+                                int prefetch_distance, Index... x) {
+    static_assert(sizeof...(Index) == N, "make_line_cursor() needs N indices");
+    check_cursor_dim(N, dim);
+    int index[N] = {static_cast<int>(x)...};
+    return line_cursor<T>(&a.at(x...), a.stride(dim), index[dim - 1],
+                          a.length(dim), prefetch_distance);
+}
+
+template <class T, int N, class... Index>
+line_cursor<const T> make_line_cursor(const arraynd<T, N> &a, int dim,
+                                      int prefetch_distance, Index... x) {
+    static_assert(sizeof...(Index) == N, "make_line_cursor() needs N indices");
+    check_cursor_dim(N, dim);
+    int index[N] = {static_cast<int>(x)...};
+    return line_cursor<const T>(&a.at(x...), a.stride(dim), index[dim - 1],
+                                a.length(dim), prefetch_distance);
+}
+
+// Cursor on the lanes lines that start at x1 ... xN and at the next
+// lanes-1 indices of the fastest dimension, moving along dimension dim,
+// which must not be the fastest one.
+template <class T, int N, class... Index>
+pencil_cursor<T> make_pencil_cursor(arraynd<T, N> &a, int dim, int lanes,
+                                    int prefetch_distance, Index... x) {
+    static_assert(sizeof...(Index) == N,
+                  "make_pencil_cursor() needs N indices");
+    int index[N] = {static_cast<int>(x)...};
+    check_pencil_lanes(a, dim, lanes, index);
+    return pencil_cursor<T>(&a.at(x...), a.stride(dim), lanes,
+                            index[dim - 1], a.length(dim), prefetch_distance);
+}
+
+template <class T, int N, class... Index>
+pencil_cursor<const T> make_pencil_cursor(const arraynd<T, N> &a, int dim,
+                                          int lanes, int prefetch_distance,
+                                          Index... x) {
+    static_assert(sizeof...(Index) == N,
+                  "make_pencil_cursor() needs N indices");
+    int index[N] = {static_cast<int>(x)...};
+    check_pencil_lanes(a, dim, lanes, index);
+    return pencil_cursor<const T>(&a.at(x...), a.stride(dim), lanes,
+                                  index[dim - 1], a.length(dim),
+                                  prefetch_distance);
+}
+
+} // namespace orca_array
+
+// endif ORCA_CURSOR
+#endif
@@ -0,0 +1,439 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// File: orca_fft.hpp
+//
+// Layouts that FFT libraries (FFTW, MKL, cuFFT style planners) can use in
+// place, without copying into a separate buffer.
+//
+// r2c_array<T, N> is a real array whose fastest dimension (the last one
+// in C order, the first one in Fortran order) is padded from n to
+// 2*(n/2+1) elements, so that the n/2+1 complex outputs of an in-place
+// real to complex transform fit into the same memory.
+//
+// complex_array<T, N, Layout> stores complex elements either interleaved
+// (re, im, re, im ... like std::complex<T> and fftw_complex) or split
+// into a block of real parts followed by a block of imaginary parts.
+//
+// fft_dims() and the embed functions return the extents slowest first,
+// which is the order FFT planners take. With FORTRAN_ORDER 1 they are
+// therefore reversed, lengthN() first.
+//
+// Both constructors zero the elements with all threads, so that with a
+// static schedule every thread owns the pages it later transforms. With
+// ALLOC_ZERO they are zero already and stay untouched until the first
+// write, so pages are placed by whichever thread writes them first.
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef ORCA_FFT
+#define ORCA_FFT
+
+#include "orca_array.hpp"
+
+#include <complex>
+
+namespace orca_array {
+
+enum complex_layout { COMPLEX_INTERLEAVED = 0, COMPLEX_SPLIT = 1 };
+
+// zero count elements with all threads
+template <class T> void parallel_zero(T *elements, size_t count) {
+    ORCA_OMP(omp parallel for schedule(static))
+    for (long i = 0; i < (long)count; i++) {
+        elements[i] = T();
+    }
+}
+
+// extents slowest first
+template <int N> void planner_order(const int *size, int *n) {
+    for (int d = 0; d < N; d++) {
+#if FORTRAN_ORDER == 1
+        n[d] = size[N - 1 - d];
+#else
+        n[d] = size[d];
+#endif
+    }
+}
+
+//////////////// start class r2c_array /////////////////////
+
+template <class array_element_type, int N> class r2c_array {
+
+  private:
+    // logical extents of the real data
+    int size[N];
+
+    // extents with the fastest dimension padded to 2*(n/2+1)
+    int padded_size[N];
+
+    // extents of the complex half spectrum, fastest dimension n/2+1
+    int complex_size[N];
+
+    // factors of the real and of the complex layout
+    size_t F[N];
+    size_t C[N];
+    size_t complex_F[N];
+    size_t complex_C[N];
+
+    array_element_type *internal_array;
+
+    // how internal_array was allocated
+    allocation_record record;
+
+  public:
+    static const int rank = N;
+
+    // constructor
+    // takes N extents optionally followed by an allocation_option
+    template <class... Args> explicit r2c_array(Args... args) {
+        static_assert(sizeof...(Args) == N || sizeof...(Args) == N + 1,
+                      "r2c_array needs N extents and an optional "
+                      "allocation_option");
+
+        allocation_option option = ALLOC_DEFAULT;
+        read_extents<N, 0>(size, option, args...);
+        check_extents(N, size);
+
+        for (int d = 0; d < N; d++) {
+            padded_size[d] = size[d];
+            complex_size[d] = size[d];
+        }
+        int f = fastest_dimension<N>() - 1;
+        complex_size[f] = size[f] / 2 + 1;
+        padded_size[f] = 2 * complex_size[f];
+
+        compute_factors(N, padded_size, F, C);
+        compute_factors(N, complex_size, complex_F, complex_C);
+
+        size_t count = count_elements(N, padded_size);
+        internal_array =
+            allocate_elements<array_element_type>(count, option, record);
+        // ALLOC_ZERO elements are zero already, and writing them would make
+        // every page resident
+        if (option != ALLOC_ZERO) {
+            parallel_zero(internal_array, count);
+        }
+    }
+
+    // destructor
+    ~r2c_array() { free_elements(internal_array, record); }
+
+    // extent of the real data in dimension dim, counted from 1
+    inline int length(int dim) const { return size[dim - 1]; }
+
+    // extent in dimension dim including the padding
+    inline int padded_length(int dim) const { return padded_size[dim - 1]; }
+
+    // extent of the complex half spectrum in dimension dim
+    inline int complex_length(int dim) const { return complex_size[dim - 1]; }
+
+    // number of real elements including the padding
+    inline size_t num_elements(void) const {
+        return count_elements(N, padded_size);
+    }
+
+    inline array_element_type *data(void) { return internal_array; }
+
+    inline const array_element_type *data(void) const {
+        return internal_array;
+    }
+
+    // the same memory as n/2+1 complex elements along the fastest dimension
+    inline std::complex<array_element_type> *complex_data(void) {
+        return (std::complex<array_element_type> *)internal_array;
+    }
+
+    inline const std::complex<array_element_type> *complex_data(void) const {
+        return (const std::complex<array_element_type> *)internal_array;
+    }
+
+    // distance in real elements between x and x+1 of dimension dim
+    inline ptrdiff_t stride(int dim) const {
+#if FORTRAN_ORDER == 1
+        return F[dim - 1];
+#else
+        return C[dim - 1];
+#endif
+    }
+
+    // distance in complex elements between x and x+1 of dimension dim
+    inline ptrdiff_t complex_stride(int dim) const {
+#if FORTRAN_ORDER == 1
+        return complex_F[dim - 1];
+#else
+        return complex_C[dim - 1];
+#endif
+    }
+
+    // real extents, padded extents and complex extents, slowest first
+    inline void fft_dims(int *n) const { planner_order<N>(size, n); }
+
+    inline void fft_real_embed(int *n) const {
+        planner_order<N>(padded_size, n);
+    }
+
+    inline void fft_complex_embed(int *n) const {
+        planner_order<N>(complex_size, n);
+    }
+
+    // real element x1 ... xN, before a forward or after a backward
+    // transform
+    template <class... Index> inline array_element_type &at(Index... x) {
+        static_assert(sizeof...(Index) == N, "at() needs N indices");
+
+#if ARRAY_BOUNDS_CHECK == 1
+        int index[N] = {static_cast<int>(x)...};
+        check_indices(N, index, size);
+#endif
+
+#if FORTRAN_ORDER == 1
+        return internal_array[fortran_offset(F, x...)];
+#else
+        return internal_array[c_offset(C, x...)];
+#endif
+    }
+
+    template <class... Index>
+    inline const array_element_type &at(Index... x) const {
+        static_assert(sizeof...(Index) == N, "at() needs N indices");
+
+#if ARRAY_BOUNDS_CHECK == 1
+        int index[N] = {static_cast<int>(x)...};
+        check_indices(N, index, size);
+#endif
+
+#if FORTRAN_ORDER == 1
+        return internal_array[fortran_offset(F, x...)];
+#else
+        return internal_array[c_offset(C, x...)];
+#endif
+    }
+
+    // complex element x1 ... xN of the half spectrum, after a forward or
+    // before a backward transform
+    template <class... Index>
+    inline std::complex<array_element_type> &complex_at(Index... x) {
+        static_assert(sizeof...(Index) == N, "complex_at() needs N indices");
+
+#if ARRAY_BOUNDS_CHECK == 1
+        int index[N] = {static_cast<int>(x)...};
+        check_indices(N, index, complex_size);
+#endif
+
+#if FORTRAN_ORDER == 1
+        return complex_data()[fortran_offset(complex_F, x...)];
+#else
+        return complex_data()[c_offset(complex_C, x...)];
+#endif
+    }
+
+    template <class... Index>
+    inline const std::complex<array_element_type> &
+    complex_at(Index... x) const {
+        static_assert(sizeof...(Index) == N, "complex_at() needs N indices");
+
+#if ARRAY_BOUNDS_CHECK == 1
+        int index[N] = {static_cast<int>(x)...};
+        check_indices(N, index, complex_size);
+#endif
+
+#if FORTRAN_ORDER == 1
+        return complex_data()[fortran_offset(complex_F, x...)];
+#else
+        return complex_data()[c_offset(complex_C, x...)];
+#endif
+    }
+
+    // note that even though r2c_array is a template, inside defintion of
+    // r2c_array r2c_array means same as r2c_array<array_element_type, N>
+  private:
+    // prohibit copy constructor
+    r2c_array(r2c_array &);
+
+    // prohibit assignment operator
+    r2c_array &operator=(r2c_array &);
+};
+
+////////////// end class r2c_array /////////////////////
+
+//////////////// start class complex_array /////////////////////
+
+template <class array_element_type, int N,
+          complex_layout Layout = COMPLEX_INTERLEAVED>
+class complex_array {
+
+  private:
+    int size[N];
+
+    // factors for Fortran order
+    size_t F[N];
+
+    // factors for C order
+    size_t C[N];
+
+    // first real and first imaginary part, the parts of the next element
+    // are component_step further
+    array_element_type *re;
+    array_element_type *im;
+
+    static const int component_step = (Layout == COMPLEX_INTERLEAVED) ? 2 : 1;
+
+    array_element_type *internal_array;
+
+    // how internal_array was allocated
+    allocation_record record;
+
+  public:
+    static const int rank = N;
+    static const complex_layout layout = Layout;
+
+    // constructor
+    // takes N extents optionally followed by an allocation_option
+    template <class... Args> explicit complex_array(Args... args) {
+        static_assert(sizeof...(Args) == N || sizeof...(Args) == N + 1,
+                      "complex_array needs N extents and an optional "
+                      "allocation_option");
+
+        allocation_option option = ALLOC_DEFAULT;
+        read_extents<N, 0>(size, option, args...);
+        check_extents(N, size);
+        compute_factors(N, size, F, C);
+
+        size_t count = count_elements(N, size);
+        internal_array =
+            allocate_elements<array_element_type>(2 * count, option, record);
+        // ALLOC_ZERO elements are zero already, see r2c_array
+        if (option != ALLOC_ZERO) {
+            parallel_zero(internal_array, 2 * count);
+        }
+
+        re = internal_array;
+        im = (Layout == COMPLEX_INTERLEAVED) ? internal_array + 1
+                                             : internal_array + count;
+    }
+
+    // destructor
+    ~complex_array() { free_elements(internal_array, record); }
+
+    inline int length(int dim) const { return size[dim - 1]; }
+
+    // number of complex elements, product of the extents
+    inline size_t num_elements(void) const { return count_elements(N, size); }
+
+    // Real and imaginary part of the first element. The parts of element
+    // at linear offset k are real_data()[k * component_stride()] and
+    // imag_data()[k * component_stride()], the form of split array
+    // planners such as fftw_plan_guru_split_dft.
+    inline array_element_type *real_data(void) { return re; }
+
+    inline array_element_type *imag_data(void) { return im; }
+
+    inline const array_element_type *real_data(void) const { return re; }
+
+    inline const array_element_type *imag_data(void) const { return im; }
+
+    inline int component_stride(void) const { return component_step; }
+
+    // the elements as std::complex, only for the interleaved layout
+    inline std::complex<array_element_type> *data(void) {
+        static_assert(Layout == COMPLEX_INTERLEAVED,
+                      "data() needs the interleaved layout");
+        return (std::complex<array_element_type> *)internal_array;
+    }
+
+    inline const std::complex<array_element_type> *data(void) const {
+        static_assert(Layout == COMPLEX_INTERLEAVED,
+                      "data() needs the interleaved layout");
+        return (const std::complex<array_element_type> *)internal_array;
+    }
+
+    // distance in complex elements between x and x+1 of dimension dim
+    inline ptrdiff_t stride(int dim) const {
+#if FORTRAN_ORDER == 1
+        return F[dim - 1];
+#else
+        return C[dim - 1];
+#endif
+    }
+
+    // extents slowest first
+    inline void fft_dims(int *n) const { planner_order<N>(size, n); }
+
+    template <class... Index>
+    inline array_element_type &real(Index... x) {
+        return re[offset(x...) * component_step];
+    }
+
+    template <class... Index>
+    inline array_element_type &imag(Index... x) {
+        return im[offset(x...) * component_step];
+    }
+
+    // overloaded real() const and imag() const
+    template <class... Index>
+    inline const array_element_type &real(Index... x) const {
+        return re[offset(x...) * component_step];
+    }
+
+    template <class... Index>
+    inline const array_element_type &imag(Index... x) const {
+        return im[offset(x...) * component_step];
+    }
+
+    template <class... Index>
+    inline std::complex<array_element_type> get(Index... x) const {
+        size_t k = offset(x...) * component_step;
+        return std::complex<array_element_type>(re[k], im[k]);
+    }
+
+    template <class... Index>
+    inline void put(const std::complex<array_element_type> &value,
+                    Index... x) {
+        size_t k = offset(x...) * component_step;
+        re[k] = value.real();
+        im[k] = value.imag();
+    }
+
+    // element x1 ... xN as std::complex, only for the interleaved layout
+    template <class... Index>
+    inline std::complex<array_element_type> &at(Index... x) {
+        return data()[offset(x...)];
+    }
+
+    // overloaded at() const
+    template <class... Index>
+    inline const std::complex<array_element_type> &at(Index... x) const {
+        return data()[offset(x...)];
+    }
+
+    // note that even though complex_array is a template, inside defintion
+    // of complex_array complex_array means same as
+    // complex_array<array_element_type, N, Layout>
+  private:
+    template <class... Index> inline size_t offset(Index... x) const {
+        static_assert(sizeof...(Index) == N, "complex_array needs N indices");
+
+#if ARRAY_BOUNDS_CHECK == 1
+        int index[N] = {static_cast<int>(x)...};
+        check_indices(N, index, size);
+#endif
+
+#if FORTRAN_ORDER == 1
+        return fortran_offset(F, x...);
+#else
+        return c_offset(C, x...);
+#endif
+    }
+
+    // prohibit copy constructor
+    complex_array(complex_array &);
+
+    // prohibit assignment operator
+    complex_array &operator=(complex_array &);
+};
+
+////////////// end class complex_array /////////////////////
+
+} // namespace orca_array
+
+// endif ORCA_FFT
+#endif
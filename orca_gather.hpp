@@ -0,0 +1,486 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// File: orca_gather.hpp
+//
+// Batched reads and writes of orca_array arrays at scattered positions,
+// e.g. interpolating fields to particles and writing them back:
+//
+// gather()   value[n] = element n of the batch
+// scatter()  element n of the batch = value[n]
+//
+// Positions are given as count*N indices or as linear offsets. The offsets
+// of a batch of indices are computed in one vectorized loop instead of
+// one at() call each. Gathers of float and double elements use the
+// AVX2 or AVX-512 gather instructions when the CPU has them.
+//
+// An access_batch keeps the offsets of a batch so that a batch used every
+// step (or for several arrays of the same extents) is set up once. A
+// batch can also be sorted by address; values passed in that order (see
+// value_order) then visit the array page by page, which turns random
+// accesses into nearly sequential ones when the batch is large. Values in
+// batch order always use the unsorted offsets, because putting them back
+// in batch order costs more than the sort saves.
+//
+// scatter() writes every element from one thread only; of several
+// positions with the same element the last one in batch order wins.
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef ORCA_GATHER
+#define ORCA_GATHER
+
+#include "orca_array.hpp"
+#include "orca_simd.hpp"
+
+namespace orca_array {
+
+// order of the values passed to gather() and scatter() with a sorted
+// access_batch: value[n] for batch position n, or value[m] for the m-th
+// position in address order, which is batch position order_data()[m]
+enum value_order { BATCH_ORDER = 0, ADDRESS_ORDER = 1 };
+
+//////////////// start gather helpers /////////////////////
+
+// offset[n] = linear offset of the N indices index[n*N] ... index[n*N+N-1]
+template <class T, int N>
+void compute_offsets(const arraynd<T, N> &a, size_t count, const int *index,
+                     size_t *offset) {
+    long factor[N];
+    for (int d = 0; d < N; d++) {
+        factor[d] = a.stride(d + 1);
+    }
+
+#if ARRAY_BOUNDS_CHECK == 1
+    int size[N];
+    for (int d = 0; d < N; d++) {
+        size[d] = a.length(d + 1);
+    }
+    for (size_t n = 0; n < count; n++) {
+        check_indices(N, index + n * N, size);
+    }
+#endif
+
+    ORCA_OMP_SIMD(omp parallel for simd schedule(static))
+    for (long n = 0; n < (long)count; n++) {
+        const int *x = index + n * N;
+        long o = 0;
+        for (int d = 0; d < N; d++) {
+            o += (long)x[d] * factor[d];
+        }
+        offset[n] = (size_t)o;
+    }
+}
+
+inline void check_offsets(size_t count, const size_t *offset,
+                          size_t elements) {
+    for (size_t n = 0; n < count; n++) {
+        check_offset(offset[n], elements);
+    }
+}
+
+// value[n] = base[offset[n]], n = 0 ... count-1, on one thread
+template <class T>
+inline void scalar_gather(T *value, const T *base, const size_t *offset,
+                          size_t count) {
+    for (size_t n = 0; n < count; n++) {
+        value[n] = base[offset[n]];
+    }
+}
+
+#if ORCA_SIMD_X86 == 1
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+__attribute__((target("avx2"))) inline void
+avx2_gather(double *value, const double *base, const size_t *offset,
+            size_t count) {
+    size_t n = 0;
+    for (; n + 4 <= count; n += 4) {
+        __m256i o = _mm256_loadu_si256((const __m256i *)(offset + n));
+        _mm256_storeu_pd(value + n, _mm256_i64gather_pd(base, o, 8));
+    }
+    scalar_gather(value + n, base, offset + n, count - n);
+}
+
+__attribute__((target("avx2"))) inline void
+avx2_gather(float *value, const float *base, const size_t *offset,
+            size_t count) {
+    size_t n = 0;
+    for (; n + 4 <= count; n += 4) {
+        __m256i o = _mm256_loadu_si256((const __m256i *)(offset + n));
+        _mm_storeu_ps(value + n, _mm256_i64gather_ps(base, o, 4));
+    }
+    scalar_gather(value + n, base, offset + n, count - n);
+}
+
+__attribute__((target("avx512f"))) inline void
+avx512_gather(double *value, const double *base, const size_t *offset,
+              size_t count) {
+    size_t n = 0;
+    for (; n + 8 <= count; n += 8) {
+        __m512i o = _mm512_loadu_si512((const void *)(offset + n));
+        _mm512_storeu_pd(value + n, _mm512_i64gather_pd(o, base, 8));
+    }
+    scalar_gather(value + n, base, offset + n, count - n);
+}
+
+__attribute__((target("avx512f"))) inline void
+avx512_gather(float *value, const float *base, const size_t *offset,
+              size_t count) {
+    size_t n = 0;
+    for (; n + 8 <= count; n += 8) {
+        __m512i o = _mm512_loadu_si512((const void *)(offset + n));
+        _mm256_storeu_ps(value + n, _mm512_i64gather_ps(o, base, 4));
+    }
+    scalar_gather(value + n, base, offset + n, count - n);
+}
+
+#pragma GCC diagnostic pop
+
+#endif
+
+template <class T>
+inline void simd_gather(T *value, const T *base, const size_t *offset,
+                        size_t count) {
+    scalar_gather(value, base, offset, count);
+}
+
+#if ORCA_SIMD_X86 == 1
+
+#define ORCA_GATHER_DISPATCH(T)                                               \
+    inline void simd_gather(T *value, const T *base, const size_t *offset,    \
+                            size_t count) {                                   \
+        switch (current_simd_level()) {                                       \
+        case SIMD_AVX512:                                                     \
+            avx512_gather(value, base, offset, count);                        \
+            break;                                                            \
+        case SIMD_AVX2:                                                       \
+            avx2_gather(value, base, offset, count);                          \
+            break;                                                            \
+        default:                                                              \
+            scalar_gather(value, base, offset, count);                        \
+            break;                                                            \
+        }                                                                     \
+    }
+
+ORCA_GATHER_DISPATCH(double)
+ORCA_GATHER_DISPATCH(float)
+
+#undef ORCA_GATHER_DISPATCH
+
+#endif
+
+// elements per block of a threaded gather or scatter, small enough for
+// the values of a block to stay in L1
+const size_t gather_block = 1024;
+
+// value[n] = base[offset[n]] split over the OpenMP threads
+template <class T>
+void gather_offsets(T *value, const T *base, const size_t *offset,
+                    size_t count) {
+    long blocks = (count + gather_block - 1) / gather_block;
+    ORCA_OMP(omp parallel for schedule(static))
+    for (long b = 0; b < blocks; b++) {
+        size_t first = b * gather_block;
+        size_t n = (count - first < gather_block) ? count - first
+                                                  : gather_block;
+        simd_gather(value + first, base, offset + first, n);
+    }
+}
+
+// base[offset[n]] = value[n] for n = 0 ... count-1. Every OpenMP thread
+// reads all offsets and writes only those in its own range of the
+// elements, so no element is written by two threads and the last of
+// several positions with the same element wins.
+template <class T>
+void scatter_offsets(T *base, size_t elements, const size_t *offset,
+                     const T *value, size_t count) {
+    int threads = max_threads();
+    size_t share = elements / threads;
+    size_t extra = elements % threads;
+
+    ORCA_OMP(omp parallel for schedule(static, 1))
+    for (int t = 0; t < threads; t++) {
+        size_t first = share * t + ((size_t)t < extra ? t : extra);
+        size_t range = share + ((size_t)t < extra ? 1 : 0);
+        for (size_t n = 0; n < count; n++) {
+            // unsigned, so offsets below first wrap around to large values
+            if (offset[n] - first < range) {
+                base[offset[n]] = value[n];
+            }
+        }
+    }
+}
+
+////////////// end gather helpers /////////////////////
+
+//////////////// start class access_batch /////////////////////
+
+// The positions of a batch of gathers or scatters in arrays of one shape.
+template <int N> class access_batch {
+
+  private:
+    size_t count;
+    size_t elements;
+    int size[N];
+
+    // offsets in batch order
+    size_t *offsets;
+
+    // offsets in address order, NULL if not sorted
+    size_t *sorted_offsets;
+
+    // order[m] is the batch position of sorted_offsets[m], NULL if not
+    // sorted
+    size_t *order;
+
+    // sorted_offsets[m] >> shift is the bin of position m, see sort()
+    int shift;
+
+  public:
+    // count*N indices, index[n*N] ... index[n*N+N-1] for position n
+    template <class T>
+    access_batch(const arraynd<T, N> &a, size_t num_positions,
+                 const int *index, bool sort_by_address = false)
+        : count(num_positions), elements(a.num_elements()),
+          sorted_offsets(NULL), order(NULL), shift(0) {
+        set_size(a);
+        offsets = new size_t[count];
+        compute_offsets(a, count, index, offsets);
+        if (sort_by_address) {
+            sort(sizeof(T));
+        }
+    }
+
+    // linear offsets, position in Fortran or C order
+    template <class T>
+    access_batch(const arraynd<T, N> &a, size_t num_positions,
+                 const size_t *offset, bool sort_by_address = false)
+        : count(num_positions), elements(a.num_elements()),
+          sorted_offsets(NULL), order(NULL), shift(0) {
+        set_size(a);
+        offsets = new size_t[count];
+#if ARRAY_BOUNDS_CHECK == 1
+        check_offsets(count, offset, elements);
+#endif
+        for (size_t n = 0; n < count; n++) {
+            offsets[n] = offset[n];
+        }
+        if (sort_by_address) {
+            sort(sizeof(T));
+        }
+    }
+
+    ~access_batch() {
+        delete[] order;
+        delete[] sorted_offsets;
+        delete[] offsets;
+    }
+
+    inline size_t num_positions(void) const { return count; }
+
+    inline size_t num_elements(void) const { return elements; }
+
+    inline bool sorted(void) const { return order != NULL; }
+
+    // offsets in batch order
+    inline const size_t *offset_data(void) const { return offsets; }
+
+    // offsets in address order, NULL if not sorted
+    inline const size_t *sorted_offset_data(void) const {
+        return sorted_offsets;
+    }
+
+    // batch positions in address order, NULL if not sorted
+    inline const size_t *order_data(void) const { return order; }
+
+    // The first address order position m >= p that starts a new bin, or
+    // count. All positions of one element are in one bin, so the ranges
+    // between bin_begin() of different p can be written independently.
+    size_t bin_begin(size_t p) const {
+        if (p == 0 || p >= count) {
+            return (p < count) ? p : count;
+        }
+        size_t bin = sorted_offsets[p - 1] >> shift;
+        size_t lo = p;
+        size_t hi = count;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if ((sorted_offsets[mid] >> shift) == bin) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+    // Stops the program unless a has the extents the batch was made for.
+    template <class T> void check_shape(const arraynd<T, N> &a) const {
+        for (int d = 0; d < N; d++) {
+            if (a.length(d + 1) != size[d]) {
+                printf("array extents differ from those of the batch\n");
+                printf("dim=%d %d != %d \n", d + 1, a.length(d + 1), size[d]);
+                printf("file %s, line %d.\n", __FILE__, __LINE__);
+                raise(SIGSEGV);
+            }
+        }
+    }
+
+  private:
+    template <class T> void set_size(const arraynd<T, N> &a) {
+        for (int d = 0; d < N; d++) {
+            size[d] = a.length(d + 1);
+        }
+    }
+
+    // Stable counting sort by bins of at least one 4 KB page, and at least
+    // elements/count elements so the histograms stay no larger than the
+    // batch. One histogram per thread as in scatter_add_tiled().
+    void sort(size_t element_bytes) {
+        shift = 0;
+        size_t page = 4096 / element_bytes;
+        size_t target = (count > 0) ? elements / count : elements;
+        while (((size_t)1 << shift) < page ||
+               ((size_t)1 << shift) < target) {
+            shift++;
+        }
+        size_t bins = ((elements - 1) >> shift) + 1;
+
+        int threads = max_threads();
+        size_t *histogram = new size_t[(size_t)threads * bins];
+        for (size_t k = 0; k < (size_t)threads * bins; k++) {
+            histogram[k] = 0;
+        }
+        sorted_offsets = new size_t[count];
+        order = new size_t[count];
+
+        ORCA_OMP(omp parallel)
+        {
+            size_t *mine = histogram + (size_t)thread_num() * bins;
+
+            ORCA_OMP(omp for schedule(static))
+            for (long n = 0; n < (long)count; n++) {
+                mine[offsets[n] >> shift]++;
+            }
+
+            // exclusive prefix sum in bin major, thread minor order
+            ORCA_OMP(omp single)
+            {
+                size_t sum = 0;
+                for (size_t k = 0; k < bins; k++) {
+                    for (int u = 0; u < threads; u++) {
+                        size_t c = histogram[(size_t)u * bins + k];
+                        histogram[(size_t)u * bins + k] = sum;
+                        sum += c;
+                    }
+                }
+            }
+
+            ORCA_OMP(omp for schedule(static))
+            for (long n = 0; n < (long)count; n++) {
+                size_t m = mine[offsets[n] >> shift]++;
+                sorted_offsets[m] = offsets[n];
+                order[m] = n;
+            }
+        }
+
+        delete[] histogram;
+    }
+
+    // prohibit copy constructor
+    access_batch(access_batch &);
+
+    // prohibit assignment operator
+    access_batch &operator=(access_batch &);
+};
+
+////////////// end class access_batch /////////////////////
+
+// value[n] = element at position n of the batch. With ADDRESS_ORDER and
+// a sorted batch the m-th value is that of batch position order_data()[m]
+// instead, and the array is read in address order.
+template <class T, int N>
+void gather(const arraynd<T, N> &source, const access_batch<N> &batch,
+            T *value, value_order values = BATCH_ORDER) {
+    batch.check_shape(source);
+    if (batch.sorted() && values == ADDRESS_ORDER) {
+        gather_offsets(value, source.data(), batch.sorted_offset_data(),
+                       batch.num_positions());
+    } else {
+        gather_offsets(value, source.data(), batch.offset_data(),
+                       batch.num_positions());
+    }
+}
+
+// element at position n of the batch = value[n], with value_order as for
+// gather(). If several positions are the same element, the value of the
+// last one in batch order is stored.
+template <class T, int N>
+void scatter(arraynd<T, N> &target, const access_batch<N> &batch,
+             const T *value, value_order values = BATCH_ORDER) {
+    batch.check_shape(target);
+    size_t count = batch.num_positions();
+    T *base = target.data();
+
+    if (!batch.sorted() || values == BATCH_ORDER) {
+        scatter_offsets(base, batch.num_elements(), batch.offset_data(),
+                        value, count);
+        return;
+    }
+
+    // blocks end where a bin ends, so every element is written by one
+    // thread, in batch order since the sort is stable
+    const size_t *offset = batch.sorted_offset_data();
+    long blocks = (count + gather_block - 1) / gather_block;
+    ORCA_OMP(omp parallel for schedule(static))
+    for (long b = 0; b < blocks; b++) {
+        size_t first = batch.bin_begin(b * gather_block);
+        size_t last = batch.bin_begin((b + 1) * gather_block);
+        for (size_t m = first; m < last; m++) {
+            base[offset[m]] = value[m];
+        }
+    }
+}
+
+// value[n] = element of source at indices index[n*N] ... index[n*N+N-1]
+template <class T, int N>
+void gather(const arraynd<T, N> &source, size_t count, const int *index,
+            T *value) {
+    access_batch<N> batch(source, count, index);
+    gather(source, batch, value);
+}
+
+// value[n] = element of source at linear offset offset[n]
+template <class T, int N>
+void gather(const arraynd<T, N> &source, size_t count, const size_t *offset,
+            T *value) {
+#if ARRAY_BOUNDS_CHECK == 1
+    check_offsets(count, offset, source.num_elements());
+#endif
+    gather_offsets(value, source.data(), offset, count);
+}
+
+// element of target at indices index[n*N] ... index[n*N+N-1] = value[n]
+template <class T, int N>
+void scatter(arraynd<T, N> &target, size_t count, const int *index,
+             const T *value) {
+    access_batch<N> batch(target, count, index);
+    scatter(target, batch, value);
+}
+
+// element of target at linear offset offset[n] = value[n]
+template <class T, int N>
+void scatter(arraynd<T, N> &target, size_t count, const size_t *offset,
+             const T *value) {
+#if ARRAY_BOUNDS_CHECK == 1
+    check_offsets(count, offset, target.num_elements());
+#endif
+    scatter_offsets(target.data(), target.num_elements(), offset, value,
+                    count);
+}
+
+} // namespace orca_array
+
+// endif ORCA_GATHER
+#endif
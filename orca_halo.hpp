@@ -0,0 +1,688 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// File: orca_halo.hpp
+//
+// Domain decomposition of a global rank N grid over a grid of processes,
+// with ghost layers around every local block and halo exchange.
+//
+// decomposition<N>   global extents, process grid, ghost width and the
+//                    block owned by one rank
+// halo_transport     moves packed faces between ranks. shm_transport
+//                    uses POSIX shared memory between processes on one
+//                    node; an MPI transport only has to implement
+//                    send(), recv() and barrier().
+// halo_array<T, N>   the local arraynd<T, N> including ghost layers and
+//                    the exchange itself
+//
+// Faces are packed and unpacked run by run along the fastest dimension,
+// so the copies are unit stride and vectorize.
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef ORCA_HALO
+#define ORCA_HALO
+
+#include "orca_array.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace orca_array {
+
+//////////////// start class decomposition /////////////////////
+
+template <int N> class decomposition {
+
+  private:
+    int global[N];
+    int procs[N];
+    bool periodic[N];
+    int ghost;
+
+    int my_rank;
+    int coords[N];
+
+    // owned block of this rank in global indices
+    int start[N];
+    int extent[N];
+
+  public:
+    // global_size[d]: extent of the global grid along dimension d+1
+    // process_grid[d]: number of processes along dimension d+1
+    // ghost_width: number of ghost layers on every side
+    // rank: this process, 0 ... product of process_grid - 1
+    // is_periodic: optional, true for periodic dimensions
+    decomposition(const int *global_size, const int *process_grid,
+                  int ghost_width, int rank, const bool *is_periodic = 0) {
+        ghost = ghost_width;
+        my_rank = rank;
+
+        check_extents(N, global_size);
+        check_extents(N, process_grid);
+
+        int ranks = 1;
+        for (int d = 0; d < N; d++) {
+            global[d] = global_size[d];
+            procs[d] = process_grid[d];
+            periodic[d] = (is_periodic != 0) && is_periodic[d];
+            ranks *= procs[d];
+        }
+
+        if ((rank < 0) || (rank >= ranks) || (ghost_width < 0)) {
+            printf("rank must be in 0 ... number of processes-1 and "
+                   "ghost_width must not be negative\n");
+            printf("rank=%d ranks=%d ghost_width=%d \n", rank, ranks,
+                   ghost_width);
+            printf("file %s, line %d.\n", __FILE__, __LINE__);
+            raise(SIGSEGV);
+        }
+
+        rank_to_coords(rank, coords);
+
+        for (int d = 0; d < N; d++) {
+            int base = global[d] / procs[d];
+            int extra = global[d] % procs[d];
+            extent[d] = base + ((coords[d] < extra) ? 1 : 0);
+            start[d] = coords[d] * base + ((coords[d] < extra) ? coords[d]
+                                                                : extra);
+
+            if (extent[d] < ghost) {
+                printf("every rank needs at least ghost_width cells along "
+                       "dimension %d\n",
+                       d + 1);
+                printf("extent=%d ghost_width=%d \n", extent[d], ghost);
+                printf("file %s, line %d.\n", __FILE__, __LINE__);
+                raise(SIGSEGV);
+            }
+        }
+    }
+
+    inline int rank(void) const { return my_rank; }
+
+    inline int num_ranks(void) const {
+        int ranks = 1;
+        for (int d = 0; d < N; d++) {
+            ranks *= procs[d];
+        }
+        return ranks;
+    }
+
+    inline int ghost_width(void) const { return ghost; }
+
+    inline int global_length(int dim) const { return global[dim - 1]; }
+
+    // position of this rank in the process grid along dimension dim
+    inline int coord(int dim) const { return coords[dim - 1]; }
+
+    // number of owned cells along dimension dim
+    inline int local_length(int dim) const { return extent[dim - 1]; }
+
+    // global index of the first owned cell along dimension dim
+    inline int local_start(int dim) const { return start[dim - 1]; }
+
+    // Rank of the neighbor along dimension dim, side 0 below and side 1
+    // above. -1 at a non periodic boundary.
+    int neighbor(int dim, int side) const {
+        int c[N];
+        for (int d = 0; d < N; d++) {
+            c[d] = coords[d];
+        }
+
+        int d = dim - 1;
+        c[d] += (side == 0) ? -1 : 1;
+
+        if ((c[d] < 0) || (c[d] >= procs[d])) {
+            if (!periodic[d]) {
+                return -1;
+            }
+            c[d] = (c[d] + procs[d]) % procs[d];
+        }
+        return coords_to_rank(c);
+    }
+
+    // largest number of elements in one ghost face over all ranks, used
+    // to size transport buffers
+    size_t max_face_elements(void) const {
+        size_t largest = 0;
+        for (int d = 0; d < N; d++) {
+            size_t face = ghost;
+            for (int e = 0; e < N; e++) {
+                if (e != d) {
+                    face *= (global[e] + procs[e] - 1) / procs[e] + 2 * ghost;
+                }
+            }
+            if (face > largest) {
+                largest = face;
+            }
+        }
+        return largest;
+    }
+
+    // ranks are numbered with the first process grid coordinate slowest
+    int coords_to_rank(const int *c) const {
+        int rank = 0;
+        for (int d = 0; d < N; d++) {
+            rank = rank * procs[d] + c[d];
+        }
+        return rank;
+    }
+
+    void rank_to_coords(int rank, int *c) const {
+        for (int d = N - 1; d >= 0; d--) {
+            c[d] = rank % procs[d];
+            rank /= procs[d];
+        }
+    }
+};
+
+////////////// end class decomposition /////////////////////
+
+//////////////// start class halo_transport /////////////////////
+
+// Point to point messages between the ranks of a decomposition. A message
+// is identified by its receiver and a tag in 0 ... 2N-1. send() may
+// return before the message is received but must not lose it; recv()
+// blocks until the message with that tag has arrived.
+class halo_transport {
+
+  public:
+    virtual ~halo_transport() {}
+
+    virtual void send(int to, int tag, const void *data, size_t bytes) = 0;
+
+    virtual void recv(int from, int tag, void *data, size_t bytes) = 0;
+
+    virtual void barrier(void) = 0;
+};
+
+////////////// end class halo_transport /////////////////////
+
+//////////////// start class shm_transport /////////////////////
+
+// halo_transport over one POSIX shared memory segment. Every rank has one
+// mailbox per tag; a mailbox holds one message at a time, so a sender
+// only waits if the previous message with the same tag has not been read.
+//
+// All ranks construct it with the same name, size, tags and max_bytes.
+// Rank 0 creates the segment, replacing one of the same name left behind
+// by a run that did not end cleanly, and removes it when it destroys its
+// transport.
+class shm_transport : public halo_transport {
+
+  private:
+    struct segment_header {
+        // sense reversing barrier
+        int arrived;
+        int generation;
+        // set by rank 0 before it removes a segment of an earlier run
+        int retired;
+        int unused;
+    };
+
+    char segment_name[256];
+    int my_rank;
+    int ranks;
+    int tags;
+    size_t mailbox_bytes;
+
+    void *segment;
+    size_t header_bytes;
+    size_t segment_bytes;
+
+    inline segment_header *header(void) const {
+        return (segment_header *)segment;
+    }
+
+    // token written by a rank other than 0 when it opens the segment, and
+    // the token rank 0 copies back once it has seen it
+    inline uint64_t *check_in(int rank) const {
+        return (uint64_t *)((char *)segment + sizeof(segment_header)) + rank;
+    }
+
+    inline uint64_t *acknowledged(int rank) const {
+        return check_in(ranks) + rank;
+    }
+
+    // state word of a mailbox: 0 empty, 1 full
+    inline int *mailbox_state(int rank, int tag) const {
+        return (int *)mailbox(rank, tag);
+    }
+
+    inline char *mailbox_data(int rank, int tag) const {
+        return mailbox(rank, tag) + 64;
+    }
+
+    inline char *mailbox(int rank, int tag) const {
+        return (char *)segment + header_bytes +
+               ((size_t)rank * tags + tag) * (mailbox_bytes + 64);
+    }
+
+    static inline void wait_for(int *state, int value) {
+        while (__atomic_load_n(state, __ATOMIC_ACQUIRE) != value) {
+            sched_yield();
+        }
+    }
+
+  public:
+    shm_transport(const char *name, int rank, int num_ranks, int num_tags,
+                  size_t max_bytes) {
+        snprintf(segment_name, sizeof(segment_name), "/%s", name);
+        my_rank = rank;
+        ranks = num_ranks;
+        tags = num_tags;
+        mailbox_bytes = (max_bytes + 63) / 64 * 64;
+        header_bytes = (sizeof(segment_header) +
+                        2 * (size_t)ranks * sizeof(uint64_t) + 63) /
+                       64 * 64;
+        segment_bytes =
+            header_bytes + (size_t)ranks * tags * (mailbox_bytes + 64);
+
+        // the check in doubles as the first barrier
+        if (my_rank == 0) {
+            create_segment();
+        } else {
+            join_segment();
+        }
+    }
+
+    ~shm_transport() {
+        barrier();
+        munmap(segment, segment_bytes);
+        if (my_rank == 0) {
+            shm_unlink(segment_name);
+        }
+    }
+
+    void send(int to, int tag, const void *data, size_t bytes) {
+        check_message(to, tag, bytes);
+
+        int *state = mailbox_state(to, tag);
+        wait_for(state, 0);
+        memcpy(mailbox_data(to, tag), data, bytes);
+        __atomic_store_n(state, 1, __ATOMIC_RELEASE);
+    }
+
+    void recv(int from, int tag, void *data, size_t bytes) {
+        // the mailbox is owned by the receiver, the sender is implied by
+        // the tag
+        (void)from;
+        check_message(my_rank, tag, bytes);
+
+        int *state = mailbox_state(my_rank, tag);
+        wait_for(state, 1);
+        memcpy(data, mailbox_data(my_rank, tag), bytes);
+        __atomic_store_n(state, 0, __ATOMIC_RELEASE);
+    }
+
+    void barrier(void) {
+        segment_header *h = header();
+        int generation = __atomic_load_n(&h->generation, __ATOMIC_ACQUIRE);
+
+        if (__atomic_add_fetch(&h->arrived, 1, __ATOMIC_ACQ_REL) == ranks) {
+            __atomic_store_n(&h->arrived, 0, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&h->generation, 1, __ATOMIC_RELEASE);
+        } else {
+            while (__atomic_load_n(&h->generation, __ATOMIC_ACQUIRE) ==
+                   generation) {
+                sched_yield();
+            }
+        }
+    }
+
+  private:
+    void map_segment(int fd) {
+        segment = mmap(0, segment_bytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+                       fd, 0);
+        close(fd);
+
+        if (segment == MAP_FAILED) {
+            printf("cannot map shared memory segment %s\n", segment_name);
+            printf("file %s, line %d.\n", __FILE__, __LINE__);
+            raise(SIGSEGV);
+        }
+    }
+
+    // Rank 0: retire and remove a segment left behind by an earlier run,
+    // so that ranks which opened it look again, then create a new one.
+    // Its pages read as zero, so the barrier and all mailboxes start
+    // empty. Returns once every other rank has checked in.
+    void create_segment(void) {
+        int fd = shm_open(segment_name, O_RDWR, 0600);
+        if (fd >= 0) {
+            struct stat st;
+            if (fstat(fd, &st) == 0 &&
+                (size_t)st.st_size >= sizeof(segment_header)) {
+                void *old = mmap(0, sizeof(segment_header),
+                                 PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                if (old != MAP_FAILED) {
+                    __atomic_store_n(&((segment_header *)old)->retired, 1,
+                                     __ATOMIC_RELEASE);
+                    munmap(old, sizeof(segment_header));
+                }
+            }
+            close(fd);
+            shm_unlink(segment_name);
+        }
+
+        fd = shm_open(segment_name, O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0 || ftruncate(fd, segment_bytes) != 0) {
+            printf("cannot create shared memory segment %s\n", segment_name);
+            printf("file %s, line %d.\n", __FILE__, __LINE__);
+            raise(SIGSEGV);
+        }
+        map_segment(fd);
+
+        for (int r = 1; r < ranks; r++) {
+            uint64_t token;
+            while ((token = __atomic_load_n(check_in(r), __ATOMIC_ACQUIRE)) ==
+                   0) {
+                sched_yield();
+            }
+            __atomic_store_n(acknowledged(r), token, __ATOMIC_RELEASE);
+        }
+    }
+
+    // Other ranks: open the segment once rank 0 has created and sized it
+    // and check in with a token no earlier process can have written.
+    // Only rank 0 acknowledges it, so a segment of an earlier run is never
+    // acknowledged; once rank 0 retires it the segment is opened again.
+    void join_segment(void) {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        uint64_t token = ((uint64_t)getpid() << 32) | (uint32_t)now.tv_nsec;
+
+        while (true) {
+            int fd = shm_open(segment_name, O_RDWR, 0600);
+            if (fd < 0) {
+                if (errno != ENOENT) {
+                    printf("cannot open shared memory segment %s\n",
+                           segment_name);
+                    printf("file %s, line %d.\n", __FILE__, __LINE__);
+                    raise(SIGSEGV);
+                }
+                sched_yield();
+                continue;
+            }
+
+            struct stat st;
+            if (fstat(fd, &st) != 0 || (size_t)st.st_size < segment_bytes) {
+                close(fd);
+                sched_yield();
+                continue;
+            }
+            map_segment(fd);
+
+            __atomic_store_n(check_in(my_rank), token, __ATOMIC_RELEASE);
+            while (true) {
+                if (__atomic_load_n(acknowledged(my_rank),
+                                    __ATOMIC_ACQUIRE) == token) {
+                    return;
+                }
+                if (__atomic_load_n(&header()->retired, __ATOMIC_ACQUIRE)) {
+                    break;
+                }
+                sched_yield();
+            }
+            munmap(segment, segment_bytes);
+        }
+    }
+
+    void check_message(int rank, int tag, size_t bytes) const {
+        if ((rank < 0) || (rank >= ranks) || (tag < 0) || (tag >= tags) ||
+            (bytes > mailbox_bytes)) {
+            printf("invalid message for shm_transport\n");
+            printf("rank=%d tag=%d bytes=%lu \n", rank, tag,
+                   (unsigned long)bytes);
+            printf("ranks=%d tags=%d max_bytes=%lu \n", ranks, tags,
+                   (unsigned long)mailbox_bytes);
+            printf("file %s, line %d.\n", __FILE__, __LINE__);
+            raise(SIGSEGV);
+        }
+    }
+
+    // prohibit copy constructor
+    shm_transport(shm_transport &);
+
+    // prohibit assignment operator
+    shm_transport &operator=(shm_transport &);
+};
+
+////////////// end class shm_transport /////////////////////
+
+//////////////// start class halo_array /////////////////////
+
+// The block of a decomposition owned by one rank plus ghost_width ghost
+// layers on every side. Owned cells have local indices ghost_width ...
+// ghost_width+local_length(d)-1 along every dimension d.
+template <class array_element_type, int N> class halo_array {
+
+  private:
+    const decomposition<N> &decomp;
+    halo_transport &transport;
+
+    arraynd<array_element_type, N> *local;
+
+    int size[N];
+    size_t F[N];
+    size_t C[N];
+    int ghost;
+
+    // one send and one receive buffer per face
+    array_element_type *send_buffer[2 * N];
+    array_element_type *recv_buffer[2 * N];
+    size_t face_elements;
+
+  public:
+    halo_array(const decomposition<N> &domain, halo_transport &messenger,
+               allocation_option option = ALLOC_DEFAULT)
+        : decomp(domain), transport(messenger) {
+        ghost = decomp.ghost_width();
+        for (int d = 0; d < N; d++) {
+            size[d] = decomp.local_length(d + 1) + 2 * ghost;
+        }
+        compute_factors(N, size, F, C);
+
+        local = new arraynd<array_element_type, N>(size, option);
+
+        face_elements = decomp.max_face_elements();
+        for (int f = 0; f < 2 * N; f++) {
+            send_buffer[f] = new array_element_type[face_elements];
+            recv_buffer[f] = new array_element_type[face_elements];
+        }
+    }
+
+    ~halo_array() {
+        for (int f = 0; f < 2 * N; f++) {
+            delete[] send_buffer[f];
+            delete[] recv_buffer[f];
+        }
+        delete local;
+    }
+
+    // local array including the ghost layers
+    inline arraynd<array_element_type, N> &array(void) { return *local; }
+
+    inline const arraynd<array_element_type, N> &array(void) const {
+        return *local;
+    }
+
+    // Cells with local indices interior_begin(d) ... interior_end(d)-1 in
+    // every dimension d are at least ghost_width away from the ghosts, so a
+    // stencil of that reach can update them while an exchange is running.
+    inline int interior_begin(int dim) const {
+        (void)dim;
+        return 2 * ghost;
+    }
+
+    inline int interior_end(int dim) const {
+        return size[dim - 1] - 2 * ghost;
+    }
+
+    // Fill all ghost layers, including edges and corners, from the
+    // neighbors. Dimensions are exchanged one after the other and each
+    // exchange includes the ghosts of the dimensions before it.
+    void exchange_halos(void) {
+        for (int d = 0; d < N; d++) {
+            post_faces(d, d);
+            receive_faces(d, d);
+        }
+    }
+
+    // Start filling the face ghost layers. Edges and corners are not
+    // filled, which is enough for stencils along the axes. Compute the
+    // interior, then call finish_exchange().
+    void begin_exchange(void) {
+        for (int d = 0; d < N; d++) {
+            post_faces(d, 0);
+        }
+    }
+
+    void finish_exchange(void) {
+        for (int d = 0; d < N; d++) {
+            receive_faces(d, 0);
+        }
+    }
+
+  private:
+    // The box of ghost or boundary layers on one side of dimension d. The
+    // dimensions before with_ghosts_below include their ghost layers, all
+    // others only the owned cells.
+    void face_box(int d, int side, bool ghosts, int with_ghosts_below,
+                  int *lo, int *hi) const {
+        for (int e = 0; e < N; e++) {
+            if (e == d) {
+                continue;
+            }
+            if (e < with_ghosts_below) {
+                lo[e] = 0;
+                hi[e] = size[e];
+            } else {
+                lo[e] = ghost;
+                hi[e] = size[e] - ghost;
+            }
+        }
+
+        if (side == 0) {
+            lo[d] = ghosts ? 0 : ghost;
+        } else {
+            lo[d] = ghosts ? size[d] - ghost : size[d] - 2 * ghost;
+        }
+        hi[d] = lo[d] + ghost;
+    }
+
+    // Copy the box lo ... hi-1 to (pack) or from (unpack) buffer, one
+    // contiguous run along the fastest dimension at a time. Returns the
+    // number of elements.
+    size_t copy_box(const int *lo, const int *hi, array_element_type *buffer,
+                    bool pack) {
+#if FORTRAN_ORDER == 1
+        const int fastest = 0;
+        const size_t *factor = F;
+#else
+        const int fastest = N - 1;
+        const size_t *factor = C;
+#endif
+        array_element_type *elements = local->data();
+        int index[N];
+        for (int e = 0; e < N; e++) {
+            index[e] = lo[e];
+        }
+
+        int run = hi[fastest] - lo[fastest];
+        size_t n = 0;
+        bool done = false;
+        while (!done) {
+            size_t offset = 0;
+            for (int e = 0; e < N; e++) {
+                offset += (size_t)index[e] * factor[e];
+            }
+
+            if (pack) {
+                memcpy(buffer + n, elements + offset,
+                       run * sizeof(array_element_type));
+            } else {
+                memcpy(elements + offset, buffer + n,
+                       run * sizeof(array_element_type));
+            }
+            n += run;
+
+            done = true;
+            for (int k = 0; k < N; k++) {
+#if FORTRAN_ORDER == 1
+                int e = k;
+#else
+                int e = N - 1 - k;
+#endif
+                if (e == fastest) {
+                    continue;
+                }
+                if (++index[e] < hi[e]) {
+                    done = false;
+                    break;
+                }
+                index[e] = lo[e];
+            }
+        }
+        return n;
+    }
+
+    // Pack and send both boundary layers of dimension d. The layer next to
+    // side s fills the ghost on the opposite side of the neighbor, which
+    // receives it with tag 2d+1-s.
+    void post_faces(int d, int with_ghosts_below) {
+        if (ghost == 0) {
+            return;
+        }
+        for (int side = 0; side < 2; side++) {
+            int to = decomp.neighbor(d + 1, side);
+            if (to < 0) {
+                continue;
+            }
+            int lo[N], hi[N];
+            face_box(d, side, false, with_ghosts_below, lo, hi);
+            size_t n = copy_box(lo, hi, send_buffer[2 * d + side], true);
+            transport.send(to, 2 * d + 1 - side, send_buffer[2 * d + side],
+                           n * sizeof(array_element_type));
+        }
+    }
+
+    void receive_faces(int d, int with_ghosts_below) {
+        if (ghost == 0) {
+            return;
+        }
+        for (int side = 0; side < 2; side++) {
+            int from = decomp.neighbor(d + 1, side);
+            if (from < 0) {
+                continue;
+            }
+            int lo[N], hi[N];
+            face_box(d, side, true, with_ghosts_below, lo, hi);
+
+            size_t n = 1;
+            for (int e = 0; e < N; e++) {
+                n *= hi[e] - lo[e];
+            }
+            transport.recv(from, 2 * d + side, recv_buffer[2 * d + side],
+                           n * sizeof(array_element_type));
+            copy_box(lo, hi, recv_buffer[2 * d + side], false);
+        }
+    }
+
+    // prohibit copy constructor
+    halo_array(halo_array &);
+
+    // prohibit assignment operator
+    halo_array &operator=(halo_array &);
+};
+
+////////////// end class halo_array /////////////////////
+
+} // namespace orca_array
+
+// endif ORCA_HALO
+#endif
@@ -0,0 +1,322 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// File: orca_histogram.hpp
+//
+// Binning of points into orca_array histograms of rank 1 to 7, e.g. phase
+// space plots or spectra of particle data. Every dimension of the
+// histogram has a bin_axis, with uniform bins between two values or with
+// explicit increasing bin edges. histogram_fill() adds one, or a weight,
+// to the bin of each of a batch of points.
+//
+// The batch is cut into blocks; for each block the bins are found one
+// axis at a time in vectorizable loops and the adds follow. Every OpenMP
+// thread adds into a private copy of the histogram and the copies are
+// merged in parallel at the end. Histograms too large to copy once per
+// thread (histogram_private_bytes) get atomic adds instead.
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef ORCA_HISTOGRAM
+#define ORCA_HISTOGRAM
+
+#include "orca_array.hpp"
+#include "orca_scatter.hpp"
+
+#include <vector>
+
+namespace orca_array {
+
+// largest total size of the private copies of all threads
+const size_t histogram_private_bytes = 256 * 1024 * 1024;
+
+// points binned at a time by one thread
+const int histogram_block = 256;
+
+//////////////// start class bin_axis /////////////////////
+
+// The bins of one dimension of a histogram. Bin k holds the values x with
+// edge(k) <= x < edge(k+1); values outside edge(0) ... edge(num_bins())
+// and NaN are in no bin.
+class bin_axis {
+
+  private:
+    int bins;
+    double lo;
+    double hi;
+    double scale;
+    // all bins+1 edges if not uniform, empty otherwise
+    std::vector<double> edges;
+    // if not uniform, the bin at the lower end of each of 4*bins equal
+    // cells between the first and last edge, where the search starts
+    std::vector<int> guess;
+
+    void check(void) const {
+        if (bins < 1 || !(lo < hi)) {
+            printf("bin_axis needs at least one bin and increasing edges\n");
+            printf("bins=%d first=%g last=%g \n", bins, lo, hi);
+            printf("file %s, line %d.\n", __FILE__, __LINE__);
+            raise(SIGSEGV);
+        }
+    }
+
+  public:
+    // num_bins bins of equal width from first to last
+    bin_axis(int num_bins, double first, double last)
+        : bins(num_bins), lo(first), hi(last),
+          scale(num_bins / (last - first)) {
+        check();
+    }
+
+    // num_bins bins between the num_bins+1 increasing values of edge
+    bin_axis(int num_bins, const double *edge)
+        : bins(num_bins), lo(edge[0]), hi(edge[num_bins]), scale(0),
+          edges(edge, edge + num_bins + 1) {
+        check();
+        for (int k = 0; k < bins; k++) {
+            if (!(edges[k] < edges[k + 1])) {
+                printf("bin edges must increase\n");
+                printf("edge %d=%g edge %d=%g \n", k, edges[k], k + 1,
+                       edges[k + 1]);
+                printf("file %s, line %d.\n", __FILE__, __LINE__);
+                raise(SIGSEGV);
+            }
+        }
+
+        int cells = 4 * bins;
+        scale = cells / (hi - lo);
+        guess.resize(cells + 1);
+        int k = 0;
+        for (int c = 0; c <= cells; c++) {
+            double x = lo + c / scale;
+            while (k < bins - 1 && edges[k + 1] <= x) {
+                k++;
+            }
+            guess[c] = k;
+        }
+    }
+
+    inline int num_bins(void) const { return bins; }
+
+    inline bool uniform(void) const { return edges.empty(); }
+
+    // lower edge of bin k, or the upper edge of the last bin if k is
+    // num_bins()
+    inline double edge(int k) const {
+        if (!uniform()) {
+            return edges[k];
+        }
+        return (k == bins) ? hi : lo + k / scale;
+    }
+
+    // bin of x, -1 if x is in no bin
+    inline int find(double x) const {
+        if (!(x >= lo && x < hi)) {
+            return -1;
+        }
+        int k = (int)((x - lo) * scale);
+        if (uniform()) {
+            return (k < bins) ? k : bins - 1;
+        }
+        // usually the guess is the bin of x or just before it
+        k = guess[k];
+        while (k > 0 && edges[k] > x) {
+            k--;
+        }
+        while (k < bins - 1 && edges[k + 1] <= x) {
+            k++;
+        }
+        return k;
+    }
+
+    // bin[i] = find(x[i*step]) for i = 0 ... n-1
+    template <class C>
+    inline void find(const C *x, size_t step, int n, int *bin) const {
+        if (!uniform()) {
+            for (int i = 0; i < n; i++) {
+                bin[i] = find(x[i * step]);
+            }
+            return;
+        }
+        // the same as find(x) written so that it vectorizes
+        const double first = lo;
+        const double last = hi;
+        const double factor = scale;
+        const int top = bins - 1;
+        for (int i = 0; i < n; i++) {
+            double v = x[i * step];
+            double u = (v >= first && v < last) ? (v - first) * factor : -1.0;
+            int k = (int)u;
+            bin[i] = (k < top) ? k : top;
+        }
+    }
+};
+
+////////////// end class bin_axis /////////////////////
+
+//////////////// start histogram helpers /////////////////////
+
+// coordinate d of point n at values(d)[n*step()], from count*N values
+template <class C, int N> class interleaved_coordinates {
+
+  private:
+    const C *coordinate;
+
+  public:
+    explicit interleaved_coordinates(const C *values) : coordinate(values) {}
+
+    inline const C *values(int d) const { return coordinate + d; }
+
+    inline size_t step(void) const { return N; }
+};
+
+// coordinate d of point n at values(d)[n], from one array per dimension
+template <class C> class axis_coordinates {
+
+  private:
+    const C *const *coordinate;
+
+  public:
+    explicit axis_coordinates(const C *const *values) : coordinate(values) {}
+
+    inline const C *values(int d) const { return coordinate[d]; }
+
+    inline size_t step(void) const { return 1; }
+};
+
+template <class T, int N>
+void check_bin_axes(const arraynd<T, N> &histogram,
+                    const bin_axis (&axis)[N]) {
+    for (int d = 0; d < N; d++) {
+        if (histogram.length(d + 1) != axis[d].num_bins()) {
+            printf("histogram extent must equal the number of bins\n");
+            printf("dim=%d extent=%d bins=%d \n", d + 1,
+                   histogram.length(d + 1), axis[d].num_bins());
+            printf("file %s, line %d.\n", __FILE__, __LINE__);
+            raise(SIGSEGV);
+        }
+    }
+}
+
+// offset[i] = linear offset of the bin of point first+i in the histogram,
+// or -1 if it is in no bin
+template <int N, class Coordinates>
+inline void bin_offsets(const bin_axis *axis, const long *stride,
+                        const Coordinates &coordinate, size_t first, int n,
+                        long *offset) {
+    int bin[histogram_block];
+    for (int i = 0; i < n; i++) {
+        offset[i] = 0;
+    }
+    for (int d = 0; d < N; d++) {
+        size_t step = coordinate.step();
+        axis[d].find(coordinate.values(d) + first * step, step, n, bin);
+        const long s = stride[d];
+        for (int i = 0; i < n; i++) {
+            offset[i] = (bin[i] < 0 || offset[i] < 0) ? -1
+                                                      : offset[i] + bin[i] * s;
+        }
+    }
+}
+
+// adds the points to target or to private copies of it, see
+// histogram_fill()
+template <class T, int N, class Coordinates>
+size_t histogram_fill_dispatch(arraynd<T, N> &histogram,
+                               const bin_axis (&axis)[N], size_t count,
+                               const Coordinates &coordinate,
+                               const T *weight) {
+    check_bin_axes(histogram, axis);
+
+    T *target = histogram.data();
+    size_t elements = histogram.num_elements();
+    long stride[N];
+    for (int d = 0; d < N; d++) {
+        stride[d] = histogram.stride(d + 1);
+    }
+
+    int threads = max_threads();
+    bool shared = (threads == 1);
+    bool atomic =
+        !shared && (size_t)threads * elements * sizeof(T) >
+                       histogram_private_bytes;
+    T *copies = (shared || atomic) ? NULL : new T[(size_t)threads * elements];
+
+    long blocks = (long)((count + histogram_block - 1) / histogram_block);
+    size_t outside = 0;
+
+    ORCA_OMP(omp parallel reduction(+ : outside))
+    {
+        T *mine = target;
+        if (copies != NULL) {
+            mine = copies + (size_t)thread_num() * elements;
+
+            // every thread zeroes its own copy, so the pages land near it
+            ORCA_OMP(omp for schedule(static, 1))
+            for (int u = 0; u < threads; u++) {
+                T *copy = copies + (size_t)u * elements;
+                for (size_t i = 0; i < elements; i++) {
+                    copy[i] = T();
+                }
+            }
+        }
+
+        long offset[histogram_block];
+
+        ORCA_OMP(omp for schedule(static))
+        for (long b = 0; b < blocks; b++) {
+            size_t first = (size_t)b * histogram_block;
+            int n = (count - first < (size_t)histogram_block)
+                        ? (int)(count - first)
+                        : histogram_block;
+            bin_offsets<N>(axis, stride, coordinate, first, n, offset);
+
+            for (int i = 0; i < n; i++) {
+                if (offset[i] < 0) {
+                    outside++;
+                    continue;
+                }
+                T w = (weight == NULL) ? T(1) : weight[first + i];
+                if (atomic) {
+                    atomic_add(mine[offset[i]], w);
+                } else {
+                    mine[offset[i]] += w;
+                }
+            }
+        }
+
+        if (copies != NULL) {
+            merge_private_copies(copies, threads, elements, target);
+        }
+    }
+
+    delete[] copies;
+    return outside;
+}
+
+////////////// end histogram helpers /////////////////////
+
+// For n = 0 ... count-1 add weight[n], or 1 if weight is NULL, to the bin
+// of histogram that holds the point coordinate[n*N] ... coordinate[n*N+N-1].
+// axis[d] gives the bins of dimension d+1. Returns the number of points
+// that are in no bin; they are not added anywhere.
+template <class T, int N, class C>
+size_t histogram_fill(arraynd<T, N> &histogram, const bin_axis (&axis)[N],
+                      size_t count, const C *coordinate,
+                      const T *weight = NULL) {
+    interleaved_coordinates<C, N> points(coordinate);
+    return histogram_fill_dispatch(histogram, axis, count, points, weight);
+}
+
+// As above with coordinate d of point n in coordinate[d][n], e.g. the x,
+// y and z arrays of a set of particles.
+template <class T, int N, class C>
+size_t histogram_fill(arraynd<T, N> &histogram, const bin_axis (&axis)[N],
+                      size_t count, const C *const *coordinate,
+                      const T *weight = NULL) {
+    axis_coordinates<C> points(coordinate);
+    return histogram_fill_dispatch(histogram, axis, count, points, weight);
+}
+
+} // namespace orca_array
+
+// endif ORCA_HISTOGRAM
+#endif
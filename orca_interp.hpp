@@ -0,0 +1,287 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// File: orca_interp.hpp
+//
+// Interpolation in rank 1 to 7 orca_array tables on regular grids:
+// nearest neighbor, multilinear (2^N corners) and cubic (Catmull-Rom,
+// 4^N corners).
+//
+// interpolator<T, N> keeps a reference to the table, the strides of its
+// Fortran or C order and the offsets of the 2^N corners of a cell relative
+// to the lowest one, so a lookup computes one base offset and adds the
+// corner offsets. Batched lookups sort the query points by the cell they
+// fall in before evaluating them, so neighboring queries reuse the cache
+// lines of the same corners, and split the points over the threads.
+//
+// Grid coordinates: index i of dimension d is at origin_d + i*spacing_d,
+// by default origin 0 and spacing 1, i.e. the query is a fractional
+// index. Queries outside the grid are clamped to its edges, a NaN
+// coordinate to the lower edge of its dimension.
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef ORCA_INTERP
+#define ORCA_INTERP
+
+#include "orca_array.hpp"
+
+#include <algorithm>
+
+namespace orca_array {
+
+enum interpolation_method {
+    INTERP_NEAREST = 0,
+    INTERP_LINEAR = 1,
+    INTERP_CUBIC = 2
+};
+
+//////////////// start class interpolator /////////////////////
+
+// Valid as long as the table is not resized or reshaped. The table may be
+// changed in between lookups.
+template <class array_element_type, int N> class interpolator {
+
+    static_assert(N >= 1 && N <= 7, "interpolator supports ranks 1 to 7");
+
+  private:
+    const arraynd<array_element_type, N> &table;
+    interpolation_method method;
+
+    int size[N];
+
+    // distance in elements between neighbors along each dimension
+    size_t stride[N];
+
+    double origin[N];
+    double inverse_spacing[N];
+
+    // offset of corner c of a cell from its lowest corner, bit d of c is
+    // set for the upper neighbor in dimension d
+    size_t corner[1 << N];
+
+    // queries per block of a batched lookup
+    static const int block_points = 64;
+
+  public:
+    static const int rank = N;
+
+    explicit interpolator(const arraynd<array_element_type, N> &values,
+                          interpolation_method how = INTERP_LINEAR)
+        : table(values), method(how) {
+        size_t F[N];
+        size_t C[N];
+        for (int d = 0; d < N; d++) {
+            size[d] = values.length(d + 1);
+            origin[d] = 0.0;
+            inverse_spacing[d] = 1.0;
+        }
+        compute_factors(N, size, F, C);
+
+        for (int d = 0; d < N; d++) {
+#if FORTRAN_ORDER == 1
+            stride[d] = F[d];
+#else
+            stride[d] = C[d];
+#endif
+        }
+
+        // a dimension of extent 1 has no upper neighbor
+        corner[0] = 0;
+        for (int d = 0; d < N; d++) {
+            size_t step = (size[d] > 1) ? stride[d] : 0;
+            for (int c = 0; c < (1 << d); c++) {
+                corner[c + (1 << d)] = corner[c] + step;
+            }
+        }
+    }
+
+    // index i of dimension dim (counted from 1) is at origin + i*spacing
+    void set_axis(int dim, double axis_origin, double spacing) {
+        if (spacing == 0.0) {
+            printf("spacing is 0\n");
+            printf("dim=%d \n", dim);
+            printf("file %s, line %d.\n", __FILE__, __LINE__);
+            raise(SIGSEGV);
+        }
+        origin[dim - 1] = axis_origin;
+        inverse_spacing[dim - 1] = 1.0 / spacing;
+    }
+
+    inline interpolation_method get_method(void) const { return method; }
+
+    // the table at the point with coordinates x1 ... xN
+    template <class... Coord> inline array_element_type at(Coord... x) const {
+        static_assert(sizeof...(Coord) == N, "at() needs N coordinates");
+        double point[N] = {static_cast<double>(x)...};
+        return evaluate(point);
+    }
+
+    // the table at the point with coordinates point[0] ... point[N-1]
+    array_element_type evaluate(const double *point) const {
+        switch (method) {
+        case INTERP_NEAREST:
+            return nearest(point);
+        case INTERP_CUBIC:
+            return cubic(point);
+        default:
+            return linear(point);
+        }
+    }
+
+    // For n = 0 ... count-1 values[n] = the table at the point whose N
+    // coordinates are points[n*N] ... points[n*N+N-1]. With sort_points
+    // the points are evaluated in the memory order of their cells.
+    void evaluate(size_t count, const double *points,
+                  array_element_type *values, bool sort_points = true) const {
+        if (!sort_points) {
+            ORCA_OMP(omp parallel for schedule(static))
+            for (long n = 0; n < (long)count; n++) {
+                values[n] = evaluate(points + (size_t)n * N);
+            }
+            return;
+        }
+
+        // cell offset of every point, then the points in order of it
+        size_t *key = new size_t[count];
+        size_t *order = new size_t[count];
+
+        ORCA_OMP(omp parallel for schedule(static))
+        for (long n = 0; n < (long)count; n++) {
+            key[n] = cell_offset(points + (size_t)n * N);
+            order[n] = n;
+        }
+
+        std::sort(order, order + count, key_less(key));
+
+        ORCA_OMP(omp parallel for schedule(static))
+        for (long b = 0; b < (long)count; b += block_points) {
+            size_t last = std::min((size_t)b + block_points, count);
+            for (size_t m = b; m < last; m++) {
+                size_t n = order[m];
+                values[n] = evaluate(points + n * N);
+            }
+        }
+
+        delete[] order;
+        delete[] key;
+    }
+
+    // note that even though interpolator is a template, inside defintion
+    // of interpolator interpolator means same as
+    // interpolator<array_element_type, N>
+  private:
+    class key_less {
+        const size_t *key;
+
+      public:
+        explicit key_less(const size_t *keys) : key(keys) {}
+
+        inline bool operator()(size_t a, size_t b) const {
+            return key[a] < key[b];
+        }
+    };
+
+    // fractional index of coordinate x in dimension d, clamped to the grid;
+    // NaN gives 0 so that no NaN is ever converted to an index
+    inline double grid_index(int d, double x) const {
+        double u = (x - origin[d]) * inverse_spacing[d];
+        double top = size[d] - 1;
+        return !(u > 0.0) ? 0.0 : ((u > top) ? top : u);
+    }
+
+    // lower cell index of u in dimension d, so that i+1 is still inside
+    inline int lower_index(int d, double u) const {
+        int i = (int)u;
+        return (i > size[d] - 2) ? ((size[d] > 1) ? size[d] - 2 : 0) : i;
+    }
+
+    inline size_t cell_offset(const double *point) const {
+        size_t offset = 0;
+        for (int d = 0; d < N; d++) {
+            offset += lower_index(d, grid_index(d, point[d])) * stride[d];
+        }
+        return offset;
+    }
+
+    array_element_type nearest(const double *point) const {
+        size_t offset = 0;
+        for (int d = 0; d < N; d++) {
+            int i = (int)(grid_index(d, point[d]) + 0.5);
+            offset += (size_t)i * stride[d];
+        }
+        return table.data()[offset];
+    }
+
+    array_element_type linear(const double *point) const {
+        // weight of every corner, built one dimension at a time
+        double weight[1 << N];
+        size_t offset = 0;
+        weight[0] = 1.0;
+        for (int d = 0; d < N; d++) {
+            double u = grid_index(d, point[d]);
+            int i = lower_index(d, u);
+            double t = u - i;
+            offset += (size_t)i * stride[d];
+
+            for (int c = 0; c < (1 << d); c++) {
+                weight[c + (1 << d)] = weight[c] * t;
+                weight[c] = weight[c] * (1.0 - t);
+            }
+        }
+
+        const array_element_type *base = table.data() + offset;
+        double sum = 0.0;
+        for (int c = 0; c < (1 << N); c++) {
+            sum += weight[c] * base[corner[c]];
+        }
+        return (array_element_type)sum;
+    }
+
+    array_element_type cubic(const double *point) const {
+        // offsets and Catmull-Rom weights of the 4 neighbors per dimension,
+        // the neighbors beyond the edges repeat the edge value
+        size_t offset[N][4];
+        double weight[N][4];
+        for (int d = 0; d < N; d++) {
+            double u = grid_index(d, point[d]);
+            int i = lower_index(d, u);
+            double t = u - i;
+
+            for (int k = 0; k < 4; k++) {
+                int j = i - 1 + k;
+                j = (j < 0) ? 0 : ((j > size[d] - 1) ? size[d] - 1 : j);
+                offset[d][k] = (size_t)j * stride[d];
+            }
+            weight[d][0] = ((-0.5 * t + 1.0) * t - 0.5) * t;
+            weight[d][1] = (1.5 * t - 2.5) * t * t + 1.0;
+            weight[d][2] = ((-1.5 * t + 2.0) * t + 0.5) * t;
+            weight[d][3] = (0.5 * t - 0.5) * t * t;
+        }
+
+        const array_element_type *base = table.data();
+        double sum = 0.0;
+        for (int n = 0; n < (1 << (2 * N)); n++) {
+            size_t o = 0;
+            double w = 1.0;
+            for (int d = 0; d < N; d++) {
+                int k = (n >> (2 * d)) & 3;
+                o += offset[d][k];
+                w *= weight[d][k];
+            }
+            sum += w * base[o];
+        }
+        return (array_element_type)sum;
+    }
+
+    // prohibit copy constructor
+    interpolator(interpolator &);
+
+    // prohibit assignment operator
+    interpolator &operator=(interpolator &);
+};
+
+////////////// end class interpolator /////////////////////
+
+} // namespace orca_array
+
+// endif ORCA_INTERP
+#endif
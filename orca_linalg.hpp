@@ -0,0 +1,406 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// File: orca_linalg.hpp
+//
+// Dense matrix products on orca_array arrays. array2d<T> A is the matrix
+// with elements A.at(i, j), row major with FORTRAN_ORDER 0 and column
+// major with FORTRAN_ORDER 1; array1d<T> is a vector.
+//
+// gemm()  C = alpha op(A) op(B) + beta C
+// gemv()  y = alpha op(A) x + beta y
+//
+// where op() is the matrix itself or its transpose.
+//
+// Without BLAS the products use a built in kernel: blocks of the
+// operands are packed into contiguous panels that fit the caches and
+// multiplied by a register tiled micro kernel, and the row blocks of C are
+// split over the OpenMP threads. With USE_CBLAS 1 float and double
+// products are handed to cblas_sgemm/dgemm and cblas_sgemv/dgemv (link
+// with -lopenblas, -lmkl_rt or similar); other element types still use
+// the built in kernel.
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef ORCA_LINALG
+#define ORCA_LINALG
+
+// Choose 0 or 1, or pass -DUSE_CBLAS=1
+#ifndef USE_CBLAS
+#define USE_CBLAS 0
+#endif
+
+#include "orca_array.hpp"
+
+#include <vector>
+
+#if USE_CBLAS == 1
+#include <cblas.h>
+#endif
+
+namespace orca_array {
+
+enum matrix_op { NO_TRANSPOSE = 0, TRANSPOSE = 1 };
+
+// Distance in elements between consecutive rows (FORTRAN_ORDER 0) or
+// columns (FORTRAN_ORDER 1) of A, the leading dimension BLAS and LAPACK
+// take together with A.data().
+template <class T> inline int leading_dimension(const arraynd<T, 2> &A) {
+#if FORTRAN_ORDER == 1
+    return A.stride(2);
+#else
+    return A.stride(1);
+#endif
+}
+
+//////////////// start matrix helpers /////////////////////
+
+// a matrix given by its first element and the distances between rows and
+// between columns
+template <class T> struct strided_matrix {
+    T *first;
+    ptrdiff_t row;
+    ptrdiff_t col;
+    int rows;
+    int cols;
+
+    inline T &operator()(int i, int j) const {
+        return first[i * row + j * col];
+    }
+};
+
+// op(A) as a strided_matrix
+template <class T>
+inline strided_matrix<const T> op_matrix(const arraynd<T, 2> &A,
+                                         matrix_op op) {
+    strided_matrix<const T> m;
+    m.first = A.data();
+    if (op == TRANSPOSE) {
+        m.row = A.stride(2);
+        m.col = A.stride(1);
+        m.rows = A.length(2);
+        m.cols = A.length(1);
+    } else {
+        m.row = A.stride(1);
+        m.col = A.stride(2);
+        m.rows = A.length(1);
+        m.cols = A.length(2);
+    }
+    return m;
+}
+
+inline void check_product_extents(const char *what, int a, int b) {
+    if (a != b) {
+        printf("matrix extents do not match: %s\n", what);
+        printf("%d != %d \n", a, b);
+        printf("file %s, line %d.\n", __FILE__, __LINE__);
+        raise(SIGSEGV);
+    }
+}
+
+// register tile of the micro kernel and cache blocks, in elements
+template <class T> struct gemm_blocking {
+    static const int MR = 4;
+    static const int NR = 64 / sizeof(T) > 4 ? 64 / sizeof(T) : 4;
+    static const int KC = 256;
+    static const int MC = 128;
+    static const int NC = 2048;
+};
+
+// C(0:mr, 0:nr) += alpha * the product of packed panels a (kc x MR) and
+// b (kc x NR); the accumulators stay in registers
+template <class T>
+inline void gemm_micro_kernel(int kc, const T *a, const T *b, T alpha,
+                              const strided_matrix<T> &C, int i0, int j0,
+                              int mr, int nr) {
+    const int MR = gemm_blocking<T>::MR;
+    const int NR = gemm_blocking<T>::NR;
+
+    T acc[MR][NR];
+    for (int i = 0; i < MR; i++) {
+        for (int j = 0; j < NR; j++) {
+            acc[i][j] = T(0);
+        }
+    }
+
+    for (int p = 0; p < kc; p++) {
+        const T *ap = a + p * MR;
+        const T *bp = b + p * NR;
+        for (int i = 0; i < MR; i++) {
+            T ai = ap[i];
+            for (int j = 0; j < NR; j++) {
+                acc[i][j] += ai * bp[j];
+            }
+        }
+    }
+
+    for (int i = 0; i < mr; i++) {
+        for (int j = 0; j < nr; j++) {
+            C(i0 + i, j0 + j) += alpha * acc[i][j];
+        }
+    }
+}
+
+// packs rows i0 ... i0+mc-1, columns p0 ... p0+kc-1 of A into panels of
+// MR rows, every panel column major, zero padded
+template <class T>
+void pack_a(const strided_matrix<const T> &A, int i0, int mc, int p0, int kc,
+            T *packed) {
+    const int MR = gemm_blocking<T>::MR;
+    for (int ir = 0; ir < mc; ir += MR) {
+        T *panel = packed + (size_t)ir * kc;
+        for (int p = 0; p < kc; p++) {
+            for (int i = 0; i < MR; i++) {
+                panel[p * MR + i] =
+                    (ir + i < mc) ? A(i0 + ir + i, p0 + p) : T(0);
+            }
+        }
+    }
+}
+
+// packs rows p0 ... p0+kc-1, columns j0 ... j0+nc-1 of B into panels of
+// NR columns, every panel row major, zero padded
+template <class T>
+void pack_b(const strided_matrix<const T> &B, int p0, int kc, int j0,
+            int jr, T *panel) {
+    const int NR = gemm_blocking<T>::NR;
+    int nc = B.cols - j0 - jr;
+    for (int p = 0; p < kc; p++) {
+        for (int j = 0; j < NR; j++) {
+            panel[p * NR + j] = (j < nc) ? B(p0 + p, j0 + jr + j) : T(0);
+        }
+    }
+}
+
+// C += alpha A B with the packed, blocked kernel
+template <class T>
+void gemm_blocked(T alpha, const strided_matrix<const T> &A,
+                  const strided_matrix<const T> &B,
+                  const strided_matrix<T> &C) {
+    typedef gemm_blocking<T> blk;
+    const int m = C.rows;
+    const int n = C.cols;
+    const int k = A.cols;
+
+    std::vector<T> packed_b((size_t)blk::KC * (blk::NC + blk::NR));
+
+    ORCA_OMP(omp parallel)
+    {
+        std::vector<T> packed_a((size_t)(blk::MC + blk::MR) * blk::KC);
+
+        for (int j0 = 0; j0 < n; j0 += blk::NC) {
+            int nc = (n - j0 < blk::NC) ? n - j0 : blk::NC;
+            for (int p0 = 0; p0 < k; p0 += blk::KC) {
+                int kc = (k - p0 < blk::KC) ? k - p0 : blk::KC;
+
+                // all threads pack the shared panels of B
+                ORCA_OMP(omp for schedule(static))
+                for (int jr = 0; jr < nc; jr += blk::NR) {
+                    pack_b(B, p0, kc, j0, jr, &packed_b[(size_t)jr * kc]);
+                }
+
+                ORCA_OMP(omp for schedule(dynamic, 1))
+                for (int i0 = 0; i0 < m; i0 += blk::MC) {
+                    int mc = (m - i0 < blk::MC) ? m - i0 : blk::MC;
+                    pack_a(A, i0, mc, p0, kc, &packed_a[0]);
+
+                    for (int jr = 0; jr < nc; jr += blk::NR) {
+                        int nr = (nc - jr < blk::NR) ? nc - jr : blk::NR;
+                        for (int ir = 0; ir < mc; ir += blk::MR) {
+                            int mr = (mc - ir < blk::MR) ? mc - ir : blk::MR;
+                            gemm_micro_kernel(
+                                kc, &packed_a[(size_t)ir * kc],
+                                &packed_b[(size_t)jr * kc], alpha, C, i0 + ir,
+                                j0 + jr, mr, nr);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+// C = beta C, beta 0 clears NaNs as BLAS does
+template <class T> void scale_matrix(const strided_matrix<T> &C, T beta) {
+    if (beta == T(1)) {
+        return;
+    }
+    ORCA_OMP(omp parallel for schedule(static))
+    for (int i = 0; i < C.rows; i++) {
+        for (int j = 0; j < C.cols; j++) {
+            C(i, j) = (beta == T(0)) ? T(0) : beta * C(i, j);
+        }
+    }
+}
+
+#if USE_CBLAS == 1
+
+inline CBLAS_ORDER cblas_order(void) {
+#if FORTRAN_ORDER == 1
+    return CblasColMajor;
+#else
+    return CblasRowMajor;
+#endif
+}
+
+inline CBLAS_TRANSPOSE cblas_op(matrix_op op) {
+    return (op == TRANSPOSE) ? CblasTrans : CblasNoTrans;
+}
+
+// true if BLAS did the product
+template <class T>
+inline bool blas_gemm(T, const arraynd<T, 2> &, matrix_op,
+                      const arraynd<T, 2> &, matrix_op, T, arraynd<T, 2> &) {
+    return false;
+}
+
+inline bool blas_gemm(double alpha, const arraynd<double, 2> &A,
+                      matrix_op op_a, const arraynd<double, 2> &B,
+                      matrix_op op_b, double beta, arraynd<double, 2> &C) {
+    int k = (op_a == TRANSPOSE) ? A.length(1) : A.length(2);
+    cblas_dgemm(cblas_order(), cblas_op(op_a), cblas_op(op_b), C.length(1),
+                C.length(2), k, alpha, A.data(), leading_dimension(A),
+                B.data(), leading_dimension(B), beta, C.data(),
+                leading_dimension(C));
+    return true;
+}
+
+inline bool blas_gemm(float alpha, const arraynd<float, 2> &A,
+                      matrix_op op_a, const arraynd<float, 2> &B,
+                      matrix_op op_b, float beta, arraynd<float, 2> &C) {
+    int k = (op_a == TRANSPOSE) ? A.length(1) : A.length(2);
+    cblas_sgemm(cblas_order(), cblas_op(op_a), cblas_op(op_b), C.length(1),
+                C.length(2), k, alpha, A.data(), leading_dimension(A),
+                B.data(), leading_dimension(B), beta, C.data(),
+                leading_dimension(C));
+    return true;
+}
+
+template <class T>
+inline bool blas_gemv(T, const arraynd<T, 2> &, matrix_op,
+                      const arraynd<T, 1> &, T, arraynd<T, 1> &) {
+    return false;
+}
+
+inline bool blas_gemv(double alpha, const arraynd<double, 2> &A,
+                      matrix_op op, const arraynd<double, 1> &x, double beta,
+                      arraynd<double, 1> &y) {
+    cblas_dgemv(cblas_order(), cblas_op(op), A.length(1), A.length(2), alpha,
+                A.data(), leading_dimension(A), x.data(), 1, beta, y.data(),
+                1);
+    return true;
+}
+
+inline bool blas_gemv(float alpha, const arraynd<float, 2> &A, matrix_op op,
+                      const arraynd<float, 1> &x, float beta,
+                      arraynd<float, 1> &y) {
+    cblas_sgemv(cblas_order(), cblas_op(op), A.length(1), A.length(2), alpha,
+                A.data(), leading_dimension(A), x.data(), 1, beta, y.data(),
+                1);
+    return true;
+}
+
+#endif
+
+////////////// end matrix helpers /////////////////////
+
+// C = alpha op_a(A) op_b(B) + beta C
+template <class T>
+void gemm(T alpha, const arraynd<T, 2> &A, matrix_op op_a,
+          const arraynd<T, 2> &B, matrix_op op_b, T beta, arraynd<T, 2> &C) {
+    strided_matrix<const T> a = op_matrix(A, op_a);
+    strided_matrix<const T> b = op_matrix(B, op_b);
+    check_product_extents("rows of C and rows of op(A)", C.length(1), a.rows);
+    check_product_extents("columns of C and columns of op(B)", C.length(2),
+                          b.cols);
+    check_product_extents("columns of op(A) and rows of op(B)", a.cols,
+                          b.rows);
+
+#if USE_CBLAS == 1
+    if (blas_gemm(alpha, A, op_a, B, op_b, beta, C)) {
+        return;
+    }
+#endif
+
+    strided_matrix<T> c;
+    c.first = C.data();
+    c.row = C.stride(1);
+    c.col = C.stride(2);
+    c.rows = C.length(1);
+    c.cols = C.length(2);
+
+    scale_matrix(c, beta);
+    if (a.cols > 0 && alpha != T(0)) {
+        gemm_blocked(alpha, a, b, c);
+    }
+}
+
+// C = A B
+template <class T>
+inline void gemm(const arraynd<T, 2> &A, const arraynd<T, 2> &B,
+                 arraynd<T, 2> &C) {
+    gemm(T(1), A, NO_TRANSPOSE, B, NO_TRANSPOSE, T(0), C);
+}
+
+// y = alpha op(A) x + beta y
+template <class T>
+void gemv(T alpha, const arraynd<T, 2> &A, matrix_op op,
+          const arraynd<T, 1> &x, T beta, arraynd<T, 1> &y) {
+    strided_matrix<const T> a = op_matrix(A, op);
+    check_product_extents("length of y and rows of op(A)", y.length(1),
+                          a.rows);
+    check_product_extents("length of x and columns of op(A)", x.length(1),
+                          a.cols);
+
+#if USE_CBLAS == 1
+    if (blas_gemv(alpha, A, op, x, beta, y)) {
+        return;
+    }
+#endif
+
+    const T *xv = x.data();
+    T *yv = y.data();
+    int m = a.rows;
+    int n = a.cols;
+
+    if (a.col == 1) {
+        // rows of op(A) are contiguous: one dot product per row
+        ORCA_OMP(omp parallel for schedule(static))
+        for (int i = 0; i < m; i++) {
+            const T *ai = a.first + i * a.row;
+            T sum = T(0);
+            for (int j = 0; j < n; j++) {
+                sum += ai[j] * xv[j];
+            }
+            yv[i] = alpha * sum + ((beta == T(0)) ? T(0) : beta * yv[i]);
+        }
+    } else {
+        // columns are contiguous: every thread adds all columns into its
+        // own block of y
+        ORCA_OMP(omp parallel for schedule(static))
+        for (int i0 = 0; i0 < m; i0 += 256) {
+            int rows = (m - i0 < 256) ? m - i0 : 256;
+            T *yi = yv + i0;
+            for (int i = 0; i < rows; i++) {
+                yi[i] = (beta == T(0)) ? T(0) : beta * yi[i];
+            }
+            for (int j = 0; j < n; j++) {
+                const T *aj = a.first + j * a.col + i0;
+                T s = alpha * xv[j];
+                for (int i = 0; i < rows; i++) {
+                    yi[i] += aj[i] * s;
+                }
+            }
+        }
+    }
+}
+
+// y = A x
+template <class T>
+inline void gemv(const arraynd<T, 2> &A, const arraynd<T, 1> &x,
+                 arraynd<T, 1> &y) {
+    gemv(T(1), A, NO_TRANSPOSE, x, T(0), y);
+}
+
+} // namespace orca_array
+
+// endif ORCA_LINALG
+#endif
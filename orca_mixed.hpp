@@ -0,0 +1,419 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// File: orca_mixed.hpp
+//
+// Mixed precision storage: mixed_array<S, C, N> keeps its elements in a
+// narrow storage type S (float, bfloat16 or half) and hands them out in
+// a wide compute type C (usually double). Single elements are widened and
+// narrowed through a proxy; load() and store() convert whole blocks with
+// the SIMD kernels, which is the fast path for sweeps.
+//
+// bfloat16 keeps the 8 bit exponent of float and 8 bits of mantissa, half
+// has a 5 bit exponent (largest finite value 65504) and 11 bits of
+// mantissa. Narrowing rounds to nearest even; a double is first rounded to
+// float, so a few ties round differently than a direct conversion would.
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef ORCA_MIXED
+#define ORCA_MIXED
+
+#include "orca_array.hpp"
+#include "orca_simd.hpp"
+
+#include <string.h>
+
+namespace orca_array {
+
+inline uint32_t float_bits(float f) {
+    uint32_t u;
+    memcpy(&u, &f, 4);
+    return u;
+}
+
+inline float bits_float(uint32_t u) {
+    float f;
+    memcpy(&f, &u, 4);
+    return f;
+}
+
+//////////////// start class bfloat16 /////////////////////
+
+struct bfloat16 {
+    uint16_t bits;
+
+    bfloat16() = default;
+
+    explicit bfloat16(float f) {
+        uint32_t u = float_bits(f);
+        if ((u & 0x7fffffff) > 0x7f800000) {
+            // keep NaN a quiet NaN
+            bits = (uint16_t)((u >> 16) | 0x40);
+        } else {
+            bits = (uint16_t)((u + 0x7fff + ((u >> 16) & 1)) >> 16);
+        }
+    }
+
+    inline operator float() const { return bits_float((uint32_t)bits << 16); }
+};
+
+////////////// end class bfloat16 /////////////////////
+
+//////////////// start class half /////////////////////
+
+struct half {
+    uint16_t bits;
+
+    half() = default;
+
+    explicit half(float f) {
+        uint32_t u = float_bits(f);
+        uint32_t sign = u & 0x80000000;
+        u ^= sign;
+
+        if (u >= (143u << 23)) {
+            // 65536 or more, inf or NaN
+            bits = (u > 0x7f800000) ? 0x7e00 : 0x7c00;
+        } else if (u < (113u << 23)) {
+            // below 2^-14, subnormal or zero: the float addition does the
+            // rounding
+            const uint32_t magic = 126u << 23;
+            bits = (uint16_t)(float_bits(bits_float(u) + bits_float(magic)) -
+                              magic);
+        } else {
+            uint32_t odd = (u >> 13) & 1;
+            u += ((uint32_t)(15 - 127) << 23) + 0xfff + odd;
+            bits = (uint16_t)(u >> 13);
+        }
+        bits |= (uint16_t)(sign >> 16);
+    }
+
+    inline operator float() const {
+        const uint32_t exponent = 0x7c00u << 13;
+        uint32_t u = ((uint32_t)bits & 0x7fff) << 13;
+        uint32_t e = u & exponent;
+        u += (uint32_t)(127 - 15) << 23;
+        if (e == exponent) {
+            // inf or NaN
+            u += (uint32_t)(128 - 16) << 23;
+        } else if (e == 0) {
+            // subnormal or zero
+            u += 1u << 23;
+            u = float_bits(bits_float(u) - bits_float(113u << 23));
+        }
+        return bits_float(u | (((uint32_t)bits & 0x8000) << 16));
+    }
+};
+
+////////////// end class half /////////////////////
+
+//////////////// start conversion kernels /////////////////////
+
+// elements converted per step of the two step double <-> 16 bit paths
+static const size_t mixed_chunk = 256;
+
+// y[i] = x[i] widened, generic version
+template <class To, class From>
+inline void widen_elements(To *y, const From *x, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        y[i] = (To)x[i];
+    }
+}
+
+// y[i] = x[i] narrowed, generic version
+template <class To, class From>
+inline void narrow_elements(To *y, const From *x, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        y[i] = (To)x[i];
+    }
+}
+
+inline void widen_elements(double *y, const float *x, size_t n) {
+    simd_convert(y, x, n);
+}
+
+inline void narrow_elements(float *y, const double *x, size_t n) {
+    simd_convert(y, x, n);
+}
+
+#if ORCA_SIMD_X86 == 1
+
+__attribute__((target("avx2"))) inline void
+avx2_widen(float *y, const bfloat16 *x, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i b = _mm_loadu_si128((const __m128i *)(x + i));
+        __m256i u = _mm256_slli_epi32(_mm256_cvtepu16_epi32(b), 16);
+        _mm256_storeu_si256((__m256i *)(y + i), u);
+    }
+    widen_elements<float, bfloat16>(y + i, x + i, n - i);
+}
+
+// round the 8 floats of f to the upper 16 bits of the 8 lanes
+__attribute__((target("avx2"))) inline __m256i avx2_round_bf16(__m256 f) {
+    __m256i u = _mm256_castps_si256(f);
+    __m256i odd = _mm256_and_si256(_mm256_srli_epi32(u, 16),
+                                   _mm256_set1_epi32(1));
+    __m256i r = _mm256_add_epi32(u, _mm256_set1_epi32(0x7fff));
+    r = _mm256_srli_epi32(_mm256_add_epi32(r, odd), 16);
+    __m256i quiet = _mm256_or_si256(_mm256_srli_epi32(u, 16),
+                                    _mm256_set1_epi32(0x40));
+    __m256i nan = _mm256_castps_si256(_mm256_cmp_ps(f, f, _CMP_UNORD_Q));
+    return _mm256_blendv_epi8(r, quiet, nan);
+}
+
+__attribute__((target("avx2"))) inline void
+avx2_narrow(bfloat16 *y, const float *x, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i a = avx2_round_bf16(_mm256_loadu_ps(x + i));
+        __m256i b = avx2_round_bf16(_mm256_loadu_ps(x + i + 8));
+        // packus interleaves the 128 bit lanes of a and b
+        __m256i p = _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), 0xd8);
+        _mm256_storeu_si256((__m256i *)(y + i), p);
+    }
+    narrow_elements<bfloat16, float>(y + i, x + i, n - i);
+}
+
+// every AVX2 CPU also has the F16C conversion instructions
+__attribute__((target("avx2,f16c"))) inline void
+avx2_widen(float *y, const half *x, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i h = _mm_loadu_si128((const __m128i *)(x + i));
+        _mm256_storeu_ps(y + i, _mm256_cvtph_ps(h));
+    }
+    widen_elements<float, half>(y + i, x + i, n - i);
+}
+
+__attribute__((target("avx2,f16c"))) inline void
+avx2_narrow(half *y, const float *x, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(x + i),
+                                    _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128((__m128i *)(y + i), h);
+    }
+    narrow_elements<half, float>(y + i, x + i, n - i);
+}
+
+inline void widen_elements(float *y, const bfloat16 *x, size_t n) {
+    if (current_simd_level() >= SIMD_AVX2) {
+        avx2_widen(y, x, n);
+    } else {
+        widen_elements<float, bfloat16>(y, x, n);
+    }
+}
+
+inline void narrow_elements(bfloat16 *y, const float *x, size_t n) {
+    if (current_simd_level() >= SIMD_AVX2) {
+        avx2_narrow(y, x, n);
+    } else {
+        narrow_elements<bfloat16, float>(y, x, n);
+    }
+}
+
+inline void widen_elements(float *y, const half *x, size_t n) {
+    if (current_simd_level() >= SIMD_AVX2) {
+        avx2_widen(y, x, n);
+    } else {
+        widen_elements<float, half>(y, x, n);
+    }
+}
+
+inline void narrow_elements(half *y, const float *x, size_t n) {
+    if (current_simd_level() >= SIMD_AVX2) {
+        avx2_narrow(y, x, n);
+    } else {
+        narrow_elements<half, float>(y, x, n);
+    }
+}
+
+#endif
+
+// double <-> 16 bit goes through a float buffer on the stack
+template <class S> inline void widen_through_float(double *y, const S *x,
+                                                   size_t n) {
+    float buffer[mixed_chunk];
+    for (size_t i = 0; i < n; i += mixed_chunk) {
+        size_t m = (n - i < mixed_chunk) ? n - i : mixed_chunk;
+        widen_elements(buffer, x + i, m);
+        simd_convert(y + i, buffer, m);
+    }
+}
+
+template <class S> inline void narrow_through_float(S *y, const double *x,
+                                                    size_t n) {
+    float buffer[mixed_chunk];
+    for (size_t i = 0; i < n; i += mixed_chunk) {
+        size_t m = (n - i < mixed_chunk) ? n - i : mixed_chunk;
+        simd_convert(buffer, x + i, m);
+        narrow_elements(y + i, buffer, m);
+    }
+}
+
+inline void widen_elements(double *y, const bfloat16 *x, size_t n) {
+    widen_through_float(y, x, n);
+}
+
+inline void narrow_elements(bfloat16 *y, const double *x, size_t n) {
+    narrow_through_float(y, x, n);
+}
+
+inline void widen_elements(double *y, const half *x, size_t n) {
+    widen_through_float(y, x, n);
+}
+
+inline void narrow_elements(half *y, const double *x, size_t n) {
+    narrow_through_float(y, x, n);
+}
+
+////////////// end conversion kernels /////////////////////
+
+//////////////// start class mixed_element /////////////////////
+
+// One element of a mixed_array, read and written in the compute type.
+// Obtained from mixed_array::at().
+template <class storage_type, class compute_type> class mixed_element {
+
+  private:
+    storage_type *element;
+
+  public:
+    explicit mixed_element(storage_type *stored) : element(stored) {}
+
+    inline operator compute_type() const { return (compute_type)*element; }
+
+    inline mixed_element &operator=(compute_type value) {
+        *element = (storage_type)value;
+        return *this;
+    }
+
+    inline mixed_element &operator=(const mixed_element &other) {
+        *element = *other.element;
+        return *this;
+    }
+
+    inline mixed_element &operator+=(compute_type value) {
+        return *this = (compute_type)(*this) + value;
+    }
+
+    inline mixed_element &operator-=(compute_type value) {
+        return *this = (compute_type)(*this) - value;
+    }
+
+    inline mixed_element &operator*=(compute_type value) {
+        return *this = (compute_type)(*this) * value;
+    }
+};
+
+////////////// end class mixed_element /////////////////////
+
+//////////////// start class mixed_array /////////////////////
+
+template <class storage_type, class compute_type, int N> class mixed_array {
+
+  private:
+    arraynd<storage_type, N> stored;
+
+  public:
+    static const int rank = N;
+
+    // constructor
+    // takes N extents optionally followed by an allocation_option
+    template <class... Args>
+    explicit mixed_array(Args... args) : stored(args...) {}
+
+    inline int length(int dim) const { return stored.length(dim); }
+
+    inline size_t num_elements(void) const { return stored.num_elements(); }
+
+    // the elements in the storage type
+    inline arraynd<storage_type, N> &storage(void) { return stored; }
+
+    inline const arraynd<storage_type, N> &storage(void) const {
+        return stored;
+    }
+
+    template <class... Index>
+    inline mixed_element<storage_type, compute_type> at(Index... x) {
+        return mixed_element<storage_type, compute_type>(&stored.at(x...));
+    }
+
+    template <class... Index> inline compute_type at(Index... x) const {
+        return (compute_type)stored.at(x...);
+    }
+
+    // Widen count elements starting at linear offset first (position in
+    // Fortran or C order) into values[0] ... values[count-1].
+    void load(size_t first, size_t count, compute_type *values) const {
+#if ARRAY_BOUNDS_CHECK == 1
+        check_range(first, count);
+#endif
+        widen_elements(values, stored.data() + first, count);
+    }
+
+    // Narrow values[0] ... values[count-1] into count elements starting at
+    // linear offset first.
+    void store(size_t first, size_t count, const compute_type *values) {
+#if ARRAY_BOUNDS_CHECK == 1
+        check_range(first, count);
+#endif
+        narrow_elements(stored.data() + first, values, count);
+    }
+
+    // out = all elements widened, split over the threads
+    void load(arraynd<compute_type, N> &out) const {
+        check_same_shape(out, stored);
+        size_t n = num_elements();
+        const storage_type *x = stored.data();
+        compute_type *y = out.data();
+
+        ORCA_OMP(omp parallel for schedule(static))
+        for (long i = 0; i < (long)n; i += 4096) {
+            size_t m = (n - i < 4096) ? n - i : 4096;
+            widen_elements(y + i, x + i, m);
+        }
+    }
+
+    // all elements = in narrowed, split over the threads
+    void store(const arraynd<compute_type, N> &in) {
+        check_same_shape(stored, in);
+        size_t n = num_elements();
+        storage_type *y = stored.data();
+        const compute_type *x = in.data();
+
+        ORCA_OMP(omp parallel for schedule(static))
+        for (long i = 0; i < (long)n; i += 4096) {
+            size_t m = (n - i < 4096) ? n - i : 4096;
+            narrow_elements(y + i, x + i, m);
+        }
+    }
+
+    // note that even though mixed_array is a template, inside defintion of
+    // mixed_array mixed_array means same as
+    // mixed_array<storage_type, compute_type, N>
+  private:
+    void check_range(size_t first, size_t count) const {
+        if (first + count > num_elements()) {
+            printf("elements are outside 0 ... num_elements()-1\n");
+            printf("first=%lu count=%lu num_elements=%lu \n",
+                   (unsigned long)first, (unsigned long)count,
+                   (unsigned long)num_elements());
+            printf("file %s, line %d.\n", __FILE__, __LINE__);
+            raise(SIGSEGV);
+        }
+    }
+
+    // prohibit copy constructor
+    mixed_array(mixed_array &);
+
+    // prohibit assignment operator
+    mixed_array &operator=(mixed_array &);
+};
+
+////////////// end class mixed_array /////////////////////
+
+} // namespace orca_array
+
+// endif ORCA_MIXED
+#endif
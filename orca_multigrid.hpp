@@ -0,0 +1,378 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// File: orca_multigrid.hpp
+//
+// Transfers between orca_array grids that differ by a factor 2 in every
+// dimension, the inner kernels of a multigrid V-cycle, and a pyramid of
+// successively coarser copies of an array.
+//
+// A coarse grid has (n+1)/2 elements along a dimension where the fine grid
+// has n. The grid_centering says where the values sit:
+//
+// CELL_CENTERED    coarse cell I covers fine cells 2I and 2I+1.
+//                  restrict_grid() averages the fine cells of a coarse
+//                  cell, prolong_grid() interpolates linearly with weights
+//                  3/4 and 1/4 from the two nearest coarse cells.
+// VERTEX_CENTERED  coarse point I is fine point 2I. restrict_grid()
+//                  injects, prolong_grid() copies the coarse points and
+//                  averages the two neighbors at the fine points between.
+//
+// In N dimensions the weights are products of the one dimensional ones.
+// Beyond the last coarse element the nearest one is used. The elements
+// are processed row by row along the contiguous dimension, with the rows
+// split over the OpenMP threads, so both storage orders run alike.
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef ORCA_MULTIGRID
+#define ORCA_MULTIGRID
+
+#include "orca_array.hpp"
+
+#include <vector>
+
+namespace orca_array {
+
+enum grid_centering { CELL_CENTERED = 0, VERTEX_CENTERED = 1 };
+
+//////////////// start multigrid helpers /////////////////////
+
+// extent of the grid coarser by 2 than one of extent n
+inline int coarse_length(int n) { return (n + 1) / 2; }
+
+template <class T, int N>
+void check_coarse_extents(const arraynd<T, N> &fine,
+                          const arraynd<T, N> &coarse) {
+    for (int d = 1; d <= N; d++) {
+        if (coarse.length(d) != coarse_length(fine.length(d))) {
+            printf("coarse extent must be (fine extent + 1) / 2\n");
+            printf("dim=%d fine=%d coarse=%d \n", d, fine.length(d),
+                   coarse.length(d));
+            printf("file %s, line %d.\n", __FILE__, __LINE__);
+            raise(SIGSEGV);
+        }
+    }
+}
+
+// The coarse elements fine element i interpolates from, with weights:
+// returns the count, 1 or 2.
+template <class T>
+inline int prolong_stencil(int i, int coarse_n, grid_centering centering,
+                           int *index, T *weight) {
+    int c = i / 2;
+    if (centering == VERTEX_CENTERED) {
+        if (i % 2 == 0 || c + 1 >= coarse_n) {
+            index[0] = c;
+            weight[0] = T(1);
+            return 1;
+        }
+        index[0] = c;
+        index[1] = c + 1;
+        weight[0] = weight[1] = T(0.5);
+        return 2;
+    }
+
+    int other = (i % 2 == 0) ? c - 1 : c + 1;
+    if (other < 0 || other >= coarse_n) {
+        index[0] = c;
+        weight[0] = T(1);
+        return 1;
+    }
+    index[0] = c;
+    index[1] = other;
+    weight[0] = T(0.75);
+    weight[1] = T(0.25);
+    return 2;
+}
+
+// The fine elements coarse element c restricts from, with weights
+template <class T>
+inline int restrict_stencil(int c, int fine_n, grid_centering centering,
+                            int *index, T *weight) {
+    index[0] = 2 * c;
+    if (centering == VERTEX_CENTERED || 2 * c + 1 >= fine_n) {
+        weight[0] = T(1);
+        return 1;
+    }
+    index[1] = 2 * c + 1;
+    weight[0] = weight[1] = T(0.5);
+    return 2;
+}
+
+// fine[0 ... n-1] (+)= prolongation of coarse[0 ... coarse_n-1]
+template <class T>
+void prolong_row(const T *coarse, int coarse_n, T *fine, int n,
+                 grid_centering centering, bool add) {
+    if (centering == VERTEX_CENTERED) {
+        // fine points 0 ... 2*pairs-1 lie before the last coarse point
+        int pairs = (n - 1) / 2;
+        if (add) {
+            for (int c = 0; c < pairs; c++) {
+                fine[2 * c] += coarse[c];
+                fine[2 * c + 1] += T(0.5) * (coarse[c] + coarse[c + 1]);
+            }
+        } else {
+            for (int c = 0; c < pairs; c++) {
+                fine[2 * c] = coarse[c];
+                fine[2 * c + 1] = T(0.5) * (coarse[c] + coarse[c + 1]);
+            }
+        }
+        for (int i = 2 * pairs; i < n; i++) {
+            T v = coarse[coarse_n - 1];
+            fine[i] = add ? fine[i] + v : v;
+        }
+        return;
+    }
+
+    // cell centered: the fine cells of interior coarse cells have both
+    // neighbors, the first and last two go through prolong_stencil()
+    int head = (n < 2) ? n : 2;
+    int tail = (2 * (coarse_n - 1) > head) ? 2 * (coarse_n - 1) : head;
+    for (int c = 1; c < coarse_n - 1; c++) {
+        T even = T(0.75) * coarse[c] + T(0.25) * coarse[c - 1];
+        T odd = T(0.75) * coarse[c] + T(0.25) * coarse[c + 1];
+        fine[2 * c] = add ? fine[2 * c] + even : even;
+        fine[2 * c + 1] = add ? fine[2 * c + 1] + odd : odd;
+    }
+    for (int i = 0; i < n; i++) {
+        if (i == head) {
+            i = tail;
+            if (i >= n) {
+                break;
+            }
+        }
+        int index[2];
+        T weight[2];
+        int count = prolong_stencil(i, coarse_n, centering, index, weight);
+        T v = weight[0] * coarse[index[0]];
+        if (count == 2) {
+            v += weight[1] * coarse[index[1]];
+        }
+        fine[i] = add ? fine[i] + v : v;
+    }
+}
+
+// coarse[0 ... coarse_n-1] = restriction of fine[0 ... n-1]
+template <class T>
+void restrict_row(const T *fine, int n, T *coarse, int coarse_n,
+                  grid_centering centering) {
+    if (centering == VERTEX_CENTERED) {
+        for (int c = 0; c < coarse_n; c++) {
+            coarse[c] = fine[2 * c];
+        }
+        return;
+    }
+    int pairs = n / 2;
+    for (int c = 0; c < pairs; c++) {
+        coarse[c] = T(0.5) * (fine[2 * c] + fine[2 * c + 1]);
+    }
+    if (n % 2 == 1) {
+        coarse[coarse_n - 1] = fine[n - 1];
+    }
+}
+
+// Calls f(offset, weight) for the rows of from that row r of to draws on
+// along the N-1 dimensions other than the contiguous one. stencil gives
+// the contributing indices of from for an index of to.
+template <class T, int N, class Stencil, class Function>
+inline void for_each_source_row(const arraynd<T, N> &to,
+                                const arraynd<T, N> &from, size_t r,
+                                Stencil stencil, Function f) {
+    const int fast = fastest_dimension<N>() - 1;
+    size_t first = r * (size_t)to.length(fast + 1);
+
+    int count[N];
+    int index[N][2];
+    T weight[N][2];
+    int combinations = 1;
+    for (int d = 0; d < N; d++) {
+        if (d == fast) {
+            count[d] = 1;
+            index[d][0] = 0;
+            weight[d][0] = T(1);
+            continue;
+        }
+        int x = (int)(first / to.stride(d + 1) % to.length(d + 1));
+        count[d] = stencil(x, from.length(d + 1), index[d], weight[d]);
+        combinations *= count[d];
+    }
+
+    for (int k = 0; k < combinations; k++) {
+        size_t offset = 0;
+        T w = T(1);
+        int rest = k;
+        for (int d = 0; d < N; d++) {
+            int j = rest % count[d];
+            rest /= count[d];
+            offset += (size_t)index[d][j] * from.stride(d + 1);
+            w *= weight[d][j];
+        }
+        f(offset, w);
+    }
+}
+
+////////////// end multigrid helpers /////////////////////
+
+// coarse = restriction of fine, see grid_centering
+template <class T, int N>
+void restrict_grid(const arraynd<T, N> &fine, arraynd<T, N> &coarse,
+                   grid_centering centering = CELL_CENTERED) {
+    check_coarse_extents(fine, coarse);
+    const int fast = fastest_dimension<N>();
+    const int n = fine.length(fast);
+    const int coarse_n = coarse.length(fast);
+    long rows = coarse.num_elements() / coarse_n;
+    const T *from = fine.data();
+    T *to = coarse.data();
+
+    auto stencil = [centering](int c, int fine_n, int *index, T *weight) {
+        return restrict_stencil(c, fine_n, centering, index, weight);
+    };
+
+    ORCA_OMP(omp parallel)
+    {
+        std::vector<T> sum(n);
+
+        ORCA_OMP(omp for schedule(static))
+        for (long r = 0; r < rows; r++) {
+            bool first = true;
+            for_each_source_row(coarse, fine, r, stencil,
+                                [&](size_t offset, T w) {
+                                    const T *row = from + offset;
+                                    if (first) {
+                                        for (int i = 0; i < n; i++) {
+                                            sum[i] = w * row[i];
+                                        }
+                                        first = false;
+                                    } else {
+                                        for (int i = 0; i < n; i++) {
+                                            sum[i] += w * row[i];
+                                        }
+                                    }
+                                });
+            restrict_row(&sum[0], n, to + r * (size_t)coarse_n, coarse_n,
+                         centering);
+        }
+    }
+}
+
+// fine = prolongation of coarse, or fine += prolongation of coarse if add
+// is true, e.g. to apply a coarse grid correction
+template <class T, int N>
+void prolong_grid(const arraynd<T, N> &coarse, arraynd<T, N> &fine,
+                  grid_centering centering = CELL_CENTERED,
+                  bool add = false) {
+    check_coarse_extents(fine, coarse);
+    const int fast = fastest_dimension<N>();
+    const int n = fine.length(fast);
+    const int coarse_n = coarse.length(fast);
+    long rows = fine.num_elements() / n;
+    const T *from = coarse.data();
+    T *to = fine.data();
+
+    auto stencil = [centering](int i, int from_n, int *index, T *weight) {
+        return prolong_stencil(i, from_n, centering, index, weight);
+    };
+
+    ORCA_OMP(omp parallel)
+    {
+        std::vector<T> sum(coarse_n);
+
+        ORCA_OMP(omp for schedule(static))
+        for (long r = 0; r < rows; r++) {
+            bool first = true;
+            for_each_source_row(fine, coarse, r, stencil,
+                                [&](size_t offset, T w) {
+                                    const T *row = from + offset;
+                                    if (first) {
+                                        for (int c = 0; c < coarse_n; c++) {
+                                            sum[c] = w * row[c];
+                                        }
+                                        first = false;
+                                    } else {
+                                        for (int c = 0; c < coarse_n; c++) {
+                                            sum[c] += w * row[c];
+                                        }
+                                    }
+                                });
+            prolong_row(&sum[0], coarse_n, to + r * (size_t)n, n, centering,
+                        add);
+        }
+    }
+}
+
+//////////////// start class grid_pyramid /////////////////////
+
+// An array and successively coarser restrictions of it, level 0 being the
+// array itself, down to a grid of one element or a chosen number of levels.
+template <class array_element_type, int N> class grid_pyramid {
+
+  private:
+    // level[0] is not owned
+    std::vector<arraynd<array_element_type, N> *> level;
+    grid_centering centering;
+
+  public:
+    // levels 0 for all levels down to one element
+    explicit grid_pyramid(arraynd<array_element_type, N> &fine,
+                          int levels = 0,
+                          grid_centering how = CELL_CENTERED)
+        : centering(how) {
+        level.push_back(&fine);
+        for (;;) {
+            if (levels > 0 && (int)level.size() >= levels) {
+                break;
+            }
+            const arraynd<array_element_type, N> &last = *level.back();
+            int size[N];
+            bool single = true;
+            for (int d = 0; d < N; d++) {
+                size[d] = coarse_length(last.length(d + 1));
+                single = single && (last.length(d + 1) == 1);
+            }
+            if (single) {
+                break;
+            }
+            level.push_back(new arraynd<array_element_type, N>(size));
+        }
+        update();
+    }
+
+    ~grid_pyramid() {
+        for (size_t k = 1; k < level.size(); k++) {
+            delete level[k];
+        }
+    }
+
+    inline int num_levels(void) const { return (int)level.size(); }
+
+    // level k, 0 is the array the pyramid was built from
+    inline arraynd<array_element_type, N> &at(int k) { return *level[k]; }
+
+    inline const arraynd<array_element_type, N> &at(int k) const {
+        return *level[k];
+    }
+
+    // recomputes levels 1 ... num_levels()-1 after level 0 changed
+    void update(void) {
+        for (size_t k = 1; k < level.size(); k++) {
+            restrict_grid(*level[k - 1], *level[k], centering);
+        }
+    }
+
+    // note that even though grid_pyramid is a template, inside defintion of
+    // grid_pyramid grid_pyramid means same as grid_pyramid<...>
+
+  private:
+    // prohibit copy constructor
+    grid_pyramid(grid_pyramid &);
+
+    // prohibit assignment operator
+    grid_pyramid &operator=(grid_pyramid &);
+};
+
+////////////// end class grid_pyramid /////////////////////
+
+} // namespace orca_array
+
+// endif ORCA_MULTIGRID
+#endif
@@ -0,0 +1,314 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// File: orca_scatter.hpp
+//
+// Thread safe accumulation into orca_array arrays, e.g. particle to grid
+// deposition. scatter_add() adds value[n] to the element at index n for a
+// batch of updates using one of several strategies:
+//
+// SCATTER_SERIAL      plain adds on the calling thread
+// SCATTER_ATOMIC      threads add directly into the array with atomic_add()
+// SCATTER_PRIVATIZED  every thread adds into a private copy of the array,
+//                     the copies are merged by a parallel tree reduction
+// SCATTER_TILED       updates are binned by the tile of the array that
+//                     owns them and every tile is added by one thread, so
+//                     no two threads ever touch the same element
+//
+// On one thread SCATTER_ATOMIC takes 2 to 3 times as long as
+// SCATTER_SERIAL because of its compare and swap loop, and the other two
+// strategies fall back to SCATTER_SERIAL. How the strategies rank with
+// more threads depends on the machine, the array size and how the indices
+// cluster; benchmarks/scatter_add.cpp times all of them on one machine.
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef ORCA_SCATTER
+#define ORCA_SCATTER
+
+#include "orca_array.hpp"
+
+namespace orca_array {
+
+enum scatter_strategy {
+    SCATTER_SERIAL = 0,
+    SCATTER_ATOMIC = 1,
+    SCATTER_PRIVATIZED = 2,
+    SCATTER_TILED = 3
+};
+
+// element += value as one atomic operation, for integer and floating point
+// element types
+template <class T> inline void atomic_add(T &element, T value) {
+#if defined(__GNUC__)
+    T expected;
+    T desired;
+    __atomic_load(&element, &expected, __ATOMIC_RELAXED);
+    do {
+        desired = expected + value;
+    } while (!__atomic_compare_exchange(&element, &expected, &desired, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+#else
+    ORCA_OMP(omp atomic)
+    element += value;
+#endif
+}
+
+//////////////// start scatter helpers /////////////////////
+
+// linear offset of update n from count*N indices, see scatter_add()
+template <int N> class index_offsets {
+
+  private:
+    const int *index;
+    int size[N];
+    size_t F[N];
+    size_t C[N];
+
+  public:
+    template <class T>
+    index_offsets(const arraynd<T, N> &target, const int *indices)
+        : index(indices) {
+        for (int d = 0; d < N; d++) {
+            size[d] = target.length(d + 1);
+        }
+        compute_factors(N, size, F, C);
+    }
+
+    inline size_t operator()(size_t n) const {
+        const int *x = index + n * N;
+
+#if ARRAY_BOUNDS_CHECK == 1
+        check_indices(N, x, size);
+#endif
+
+        size_t offset = 0;
+        for (int d = 0; d < N; d++) {
+#if FORTRAN_ORDER == 1
+            offset += (size_t)x[d] * F[d];
+#else
+            offset += (size_t)x[d] * C[d];
+#endif
+        }
+        return offset;
+    }
+};
+
+// linear offsets given directly by the caller
+class given_offsets {
+
+  private:
+    const size_t *offsets;
+    size_t elements;
+
+  public:
+    given_offsets(const size_t *offset, size_t num_elements)
+        : offsets(offset), elements(num_elements) {}
+
+    inline size_t operator()(size_t n) const {
+#if ARRAY_BOUNDS_CHECK == 1
+        check_offset(offsets[n], elements);
+#endif
+        return offsets[n];
+    }
+};
+
+template <class T, class Offsets>
+void scatter_add_serial(T *target, size_t count, const Offsets &offset_of,
+                        const T *value) {
+    for (size_t n = 0; n < count; n++) {
+        target[offset_of(n)] += value[n];
+    }
+}
+
+template <class T, class Offsets>
+void scatter_add_atomic(T *target, size_t count, const Offsets &offset_of,
+                        const T *value) {
+    ORCA_OMP(omp parallel for schedule(static))
+    for (long n = 0; n < (long)count; n++) {
+        atomic_add(target[offset_of(n)], value[n]);
+    }
+}
+
+// Adds the threads copies of elements each in copies to target, changing
+// the copies. Must be called by every thread of a parallel region.
+template <class T>
+void merge_private_copies(T *copies, int threads, size_t elements,
+                          T *target) {
+    // tree reduction: after the round with distance s, copy t holds the
+    // sum of copies t ... t+2s-1 for every t that is a multiple of 2s.
+    // Each round is split over all threads by element.
+    for (int s = 1; s < threads; s *= 2) {
+        ORCA_OMP(omp for schedule(static))
+        for (long i = 0; i < (long)elements; i++) {
+            for (int u = 0; u + s < threads; u += 2 * s) {
+                copies[(size_t)u * elements + i] +=
+                    copies[(size_t)(u + s) * elements + i];
+            }
+        }
+    }
+
+    ORCA_OMP(omp for schedule(static))
+    for (long i = 0; i < (long)elements; i++) {
+        target[i] += copies[i];
+    }
+}
+
+template <class T, class Offsets>
+void scatter_add_privatized(T *target, size_t elements, size_t count,
+                            const Offsets &offset_of, const T *value) {
+    int threads = max_threads();
+    if (threads == 1) {
+        scatter_add_serial(target, count, offset_of, value);
+        return;
+    }
+
+    T *copies = new T[(size_t)threads * elements];
+
+    ORCA_OMP(omp parallel)
+    {
+        T *mine = copies + (size_t)thread_num() * elements;
+
+        // with a full team every thread zeroes its own copy, so the pages
+        // land near it
+        ORCA_OMP(omp for schedule(static, 1))
+        for (int u = 0; u < threads; u++) {
+            T *copy = copies + (size_t)u * elements;
+            for (size_t i = 0; i < elements; i++) {
+                copy[i] = T();
+            }
+        }
+
+        ORCA_OMP(omp for schedule(static))
+        for (long n = 0; n < (long)count; n++) {
+            mine[offset_of(n)] += value[n];
+        }
+
+        merge_private_copies(copies, threads, elements, target);
+    }
+
+    delete[] copies;
+}
+
+template <class T, class Offsets>
+void scatter_add_tiled(T *target, size_t elements, size_t count,
+                       const Offsets &offset_of, const T *value) {
+    int threads = max_threads();
+    if (threads == 1) {
+        scatter_add_serial(target, count, offset_of, value);
+        return;
+    }
+
+    // contiguous tiles of whole cache lines, several per thread so that
+    // dynamic scheduling can balance uneven particle distributions
+    size_t line = (sizeof(T) < 64) ? 64 / sizeof(T) : 1;
+    size_t tiles = (size_t)threads * 8;
+    size_t tile_elements = (elements + tiles - 1) / tiles;
+    tile_elements = (tile_elements + line - 1) / line * line;
+    tiles = (elements + tile_elements - 1) / tile_elements;
+
+    // counting sort of the updates by tile, one histogram per thread
+    size_t *offsets = new size_t[count];
+    size_t *order = new size_t[count];
+    size_t *histogram = new size_t[(size_t)threads * tiles + 1];
+    for (size_t k = 0; k < (size_t)threads * tiles; k++) {
+        histogram[k] = 0;
+    }
+
+    // after the sort, the updates of tile k end where the last thread
+    // ended in tile k
+    const size_t *tile_end = histogram + (size_t)(threads - 1) * tiles;
+
+    ORCA_OMP(omp parallel)
+    {
+        size_t *mine = histogram + (size_t)thread_num() * tiles;
+
+        ORCA_OMP(omp for schedule(static))
+        for (long n = 0; n < (long)count; n++) {
+            offsets[n] = offset_of(n);
+            mine[offsets[n] / tile_elements]++;
+        }
+
+        // exclusive prefix sum in tile major, thread minor order
+        ORCA_OMP(omp single)
+        {
+            size_t sum = 0;
+            for (size_t k = 0; k < tiles; k++) {
+                for (int u = 0; u < threads; u++) {
+                    size_t c = histogram[(size_t)u * tiles + k];
+                    histogram[(size_t)u * tiles + k] = sum;
+                    sum += c;
+                }
+            }
+            histogram[(size_t)threads * tiles] = sum;
+        }
+
+        // the same static schedule as above, so every thread sees the
+        // same updates again and the sort is stable
+        ORCA_OMP(omp for schedule(static))
+        for (long n = 0; n < (long)count; n++) {
+            order[mine[offsets[n] / tile_elements]++] = n;
+        }
+
+        ORCA_OMP(omp for schedule(dynamic, 1))
+        for (long k = 0; k < (long)tiles; k++) {
+            size_t first = (k == 0) ? 0 : tile_end[k - 1];
+            size_t last = tile_end[k];
+            for (size_t m = first; m < last; m++) {
+                size_t n = order[m];
+                target[offsets[n]] += value[n];
+            }
+        }
+    }
+
+    delete[] histogram;
+    delete[] order;
+    delete[] offsets;
+}
+
+template <class T, class Offsets>
+void scatter_add_dispatch(T *target, size_t elements, size_t count,
+                          const Offsets &offset_of, const T *value,
+                          scatter_strategy strategy) {
+    switch (strategy) {
+    case SCATTER_ATOMIC:
+        scatter_add_atomic(target, count, offset_of, value);
+        break;
+    case SCATTER_PRIVATIZED:
+        scatter_add_privatized(target, elements, count, offset_of, value);
+        break;
+    case SCATTER_TILED:
+        scatter_add_tiled(target, elements, count, offset_of, value);
+        break;
+    default:
+        scatter_add_serial(target, count, offset_of, value);
+        break;
+    }
+}
+
+////////////// end scatter helpers /////////////////////
+
+// For n = 0 ... count-1 add value[n] to the element of target whose N
+// indices are index[n*N] ... index[n*N+N-1].
+//
+// A cloud in cell deposit is 2^N updates per particle, one per corner.
+template <class T, int N>
+void scatter_add(arraynd<T, N> &target, size_t count, const int *index,
+                 const T *value, scatter_strategy strategy = SCATTER_ATOMIC) {
+    index_offsets<N> offset_of(target, index);
+    scatter_add_dispatch(target.data(), target.num_elements(), count,
+                         offset_of, value, strategy);
+}
+
+// For n = 0 ... count-1 add value[n] to the element of target at linear
+// offset offset[n] (position in Fortran or C order).
+template <class T, int N>
+void scatter_add(arraynd<T, N> &target, size_t count, const size_t *offset,
+                 const T *value, scatter_strategy strategy = SCATTER_ATOMIC) {
+    given_offsets offset_of(offset, target.num_elements());
+    scatter_add_dispatch(target.data(), target.num_elements(), count,
+                         offset_of, value, strategy);
+}
+
+} // namespace orca_array
+
+// endif ORCA_SCATTER
+#endif
@@ -0,0 +1,459 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// File: orca_simd.hpp
+//
+// Explicit SIMD kernels over the contiguous elements of orca_array
+// arrays: fill, copy, scale, axpy, elementwise min and max, and float <->
+// double conversion.
+//
+// Every kernel exists as SSE2, AVX2 and AVX-512 code compiled with
+// function target attributes, plus a scalar fallback. The best level the
+// CPU supports is detected once at run time, so one binary built without
+// -mavx2 or -mavx512f still uses the widest instructions of the machine it
+// runs on. Element types other than float and double use the scalar code.
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef ORCA_SIMD
+#define ORCA_SIMD
+
+#include "orca_array.hpp"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define ORCA_SIMD_X86 1
+#include <immintrin.h>
+#else
+#define ORCA_SIMD_X86 0
+#endif
+
+namespace orca_array {
+
+enum simd_level {
+    SIMD_SCALAR = 0,
+    SIMD_SSE2 = 1,
+    SIMD_AVX2 = 2,
+    SIMD_AVX512 = 3
+};
+
+// widest instruction set the CPU supports
+inline simd_level detected_simd_level(void) {
+#if ORCA_SIMD_X86 == 1
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return SIMD_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return SIMD_AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return SIMD_SSE2;
+    }
+#endif
+    return SIMD_SCALAR;
+}
+
+// level used by the kernels, detected on first use
+inline simd_level &selected_simd_level(void) {
+    static simd_level level = detected_simd_level();
+    return level;
+}
+
+inline simd_level current_simd_level(void) { return selected_simd_level(); }
+
+// Use at most level from now on, e.g. to compare the code paths. Levels
+// above detected_simd_level() are lowered to it.
+inline void set_simd_level(simd_level level) {
+    simd_level widest = detected_simd_level();
+    selected_simd_level() = (level > widest) ? widest : level;
+}
+
+//////////////// start scalar kernels /////////////////////
+
+template <class T> void scalar_fill(T *x, size_t n, T value) {
+    for (size_t i = 0; i < n; i++) {
+        x[i] = value;
+    }
+}
+
+template <class T> void scalar_copy(T *y, const T *x, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        y[i] = x[i];
+    }
+}
+
+template <class T> void scalar_scale(T *x, size_t n, T alpha) {
+    for (size_t i = 0; i < n; i++) {
+        x[i] = alpha * x[i];
+    }
+}
+
+template <class T> void scalar_axpy(T *y, T alpha, const T *x, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        y[i] = y[i] + alpha * x[i];
+    }
+}
+
+// min and max return the second operand if either one is NaN, like the
+// SSE and AVX instructions
+template <class T> void scalar_min(T *z, const T *x, const T *y, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        z[i] = (x[i] < y[i]) ? x[i] : y[i];
+    }
+}
+
+template <class T> void scalar_max(T *z, const T *x, const T *y, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        z[i] = (x[i] > y[i]) ? x[i] : y[i];
+    }
+}
+
+template <class To, class From>
+void scalar_convert(To *y, const From *x, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        y[i] = (To)x[i];
+    }
+}
+
+////////////// end scalar kernels /////////////////////
+
+#if ORCA_SIMD_X86 == 1
+
+//////////////// start x86 kernels /////////////////////
+
+// GCC 12 reports the deliberately undefined pass-through operands inside
+// the AVX-512 intrinsics as maybe uninitialized
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+// ORCA_SIMD_KERNELS stamps out the arithmetic kernels of one instruction
+// set for one element type. The remainder after the last full vector is
+// handled by the scalar kernels.
+#define ORCA_SIMD_KERNELS(ISA, TARGET, T, V, W, LOADU, STOREU, SET1, ADD,     \
+                          MUL, MIN, MAX)                                      \
+    __attribute__((target(TARGET))) inline void ISA##_fill(T *x, size_t n,    \
+                                                           T value) {         \
+        V v = SET1(value);                                                    \
+        size_t i = 0;                                                         \
+        for (; i + W <= n; i += W) {                                          \
+            STOREU(x + i, v);                                                 \
+        }                                                                     \
+        scalar_fill(x + i, n - i, value);                                     \
+    }                                                                         \
+                                                                              \
+    __attribute__((target(TARGET))) inline void ISA##_copy(T *y, const T *x,  \
+                                                           size_t n) {        \
+        size_t i = 0;                                                         \
+        for (; i + W <= n; i += W) {                                          \
+            STOREU(y + i, LOADU(x + i));                                      \
+        }                                                                     \
+        scalar_copy(y + i, x + i, n - i);                                     \
+    }                                                                         \
+                                                                              \
+    __attribute__((target(TARGET))) inline void ISA##_scale(T *x, size_t n,   \
+                                                            T alpha) {        \
+        V a = SET1(alpha);                                                    \
+        size_t i = 0;                                                         \
+        for (; i + W <= n; i += W) {                                          \
+            STOREU(x + i, MUL(a, LOADU(x + i)));                              \
+        }                                                                     \
+        scalar_scale(x + i, n - i, alpha);                                    \
+    }                                                                         \
+                                                                              \
+    __attribute__((target(TARGET))) inline void ISA##_axpy(                   \
+        T *y, T alpha, const T *x, size_t n) {                                \
+        V a = SET1(alpha);                                                    \
+        size_t i = 0;                                                         \
+        for (; i + W <= n; i += W) {                                          \
+            STOREU(y + i, ADD(LOADU(y + i), MUL(a, LOADU(x + i))));           \
+        }                                                                     \
+        scalar_axpy(y + i, alpha, x + i, n - i);                              \
+    }                                                                         \
+                                                                              \
+    __attribute__((target(TARGET))) inline void ISA##_min(                    \
+        T *z, const T *x, const T *y, size_t n) {                             \
+        size_t i = 0;                                                         \
+        for (; i + W <= n; i += W) {                                          \
+            STOREU(z + i, MIN(LOADU(x + i), LOADU(y + i)));                   \
+        }                                                                     \
+        scalar_min(z + i, x + i, y + i, n - i);                               \
+    }                                                                         \
+                                                                              \
+    __attribute__((target(TARGET))) inline void ISA##_max(                    \
+        T *z, const T *x, const T *y, size_t n) {                             \
+        size_t i = 0;                                                         \
+        for (; i + W <= n; i += W) {                                          \
+            STOREU(z + i, MAX(LOADU(x + i), LOADU(y + i)));                   \
+        }                                                                     \
+        scalar_max(z + i, x + i, y + i, n - i);                               \
+    }
+
+ORCA_SIMD_KERNELS(sse2_double, "sse2", double, __m128d, 2, _mm_loadu_pd,
+                  _mm_storeu_pd, _mm_set1_pd, _mm_add_pd, _mm_mul_pd,
+                  _mm_min_pd, _mm_max_pd)
+ORCA_SIMD_KERNELS(sse2_float, "sse2", float, __m128, 4, _mm_loadu_ps,
+                  _mm_storeu_ps, _mm_set1_ps, _mm_add_ps, _mm_mul_ps,
+                  _mm_min_ps, _mm_max_ps)
+ORCA_SIMD_KERNELS(avx2_double, "avx2", double, __m256d, 4, _mm256_loadu_pd,
+                  _mm256_storeu_pd, _mm256_set1_pd, _mm256_add_pd,
+                  _mm256_mul_pd, _mm256_min_pd, _mm256_max_pd)
+ORCA_SIMD_KERNELS(avx2_float, "avx2", float, __m256, 8, _mm256_loadu_ps,
+                  _mm256_storeu_ps, _mm256_set1_ps, _mm256_add_ps,
+                  _mm256_mul_ps, _mm256_min_ps, _mm256_max_ps)
+ORCA_SIMD_KERNELS(avx512_double, "avx512f", double, __m512d, 8,
+                  _mm512_loadu_pd, _mm512_storeu_pd, _mm512_set1_pd,
+                  _mm512_add_pd, _mm512_mul_pd, _mm512_min_pd, _mm512_max_pd)
+ORCA_SIMD_KERNELS(avx512_float, "avx512f", float, __m512, 16,
+                  _mm512_loadu_ps, _mm512_storeu_ps, _mm512_set1_ps,
+                  _mm512_add_ps, _mm512_mul_ps, _mm512_min_ps, _mm512_max_ps)
+
+#undef ORCA_SIMD_KERNELS
+
+__attribute__((target("sse2"))) inline void
+sse2_convert(float *y, const double *x, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(x + i));
+        __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(x + i + 2));
+        _mm_storeu_ps(y + i, _mm_movelh_ps(lo, hi));
+    }
+    scalar_convert(y + i, x + i, n - i);
+}
+
+__attribute__((target("sse2"))) inline void
+sse2_convert(double *y, const float *x, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 v = _mm_loadu_ps(x + i);
+        _mm_storeu_pd(y + i, _mm_cvtps_pd(v));
+        _mm_storeu_pd(y + i + 2, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+    }
+    scalar_convert(y + i, x + i, n - i);
+}
+
+__attribute__((target("avx2"))) inline void
+avx2_convert(float *y, const double *x, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(y + i, _mm256_cvtpd_ps(_mm256_loadu_pd(x + i)));
+    }
+    scalar_convert(y + i, x + i, n - i);
+}
+
+__attribute__((target("avx2"))) inline void
+avx2_convert(double *y, const float *x, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(y + i, _mm256_cvtps_pd(_mm_loadu_ps(x + i)));
+    }
+    scalar_convert(y + i, x + i, n - i);
+}
+
+__attribute__((target("avx512f"))) inline void
+avx512_convert(float *y, const double *x, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(y + i, _mm512_cvtpd_ps(_mm512_loadu_pd(x + i)));
+    }
+    scalar_convert(y + i, x + i, n - i);
+}
+
+__attribute__((target("avx512f"))) inline void
+avx512_convert(double *y, const float *x, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm512_storeu_pd(y + i, _mm512_cvtps_pd(_mm256_loadu_ps(x + i)));
+    }
+    scalar_convert(y + i, x + i, n - i);
+}
+
+#pragma GCC diagnostic pop
+
+////////////// end x86 kernels /////////////////////
+
+#endif
+
+//////////////// start dispatching kernels /////////////////////
+
+// Pointer level kernels. The generic templates are the scalar code, the
+// float and double overloads dispatch on current_simd_level().
+
+template <class T> inline void simd_fill(T *x, size_t n, T value) {
+    scalar_fill(x, n, value);
+}
+
+template <class T> inline void simd_copy(T *y, const T *x, size_t n) {
+    scalar_copy(y, x, n);
+}
+
+template <class T> inline void simd_scale(T *x, size_t n, T alpha) {
+    scalar_scale(x, n, alpha);
+}
+
+template <class T>
+inline void simd_axpy(T *y, T alpha, const T *x, size_t n) {
+    scalar_axpy(y, alpha, x, n);
+}
+
+template <class T>
+inline void simd_min(T *z, const T *x, const T *y, size_t n) {
+    scalar_min(z, x, y, n);
+}
+
+template <class T>
+inline void simd_max(T *z, const T *x, const T *y, size_t n) {
+    scalar_max(z, x, y, n);
+}
+
+template <class To, class From>
+inline void simd_convert(To *y, const From *x, size_t n) {
+    scalar_convert(y, x, n);
+}
+
+#if ORCA_SIMD_X86 == 1
+
+// ORCA_SIMD_DISPATCH defines the float or double overload of one kernel
+#define ORCA_SIMD_DISPATCH(NAME, T, PARAMS, ARGS)                             \
+    inline void simd_##NAME PARAMS {                                          \
+        switch (current_simd_level()) {                                       \
+        case SIMD_AVX512:                                                     \
+            avx512_##T##_##NAME ARGS;                                         \
+            break;                                                            \
+        case SIMD_AVX2:                                                       \
+            avx2_##T##_##NAME ARGS;                                           \
+            break;                                                            \
+        case SIMD_SSE2:                                                       \
+            sse2_##T##_##NAME ARGS;                                           \
+            break;                                                            \
+        default:                                                              \
+            scalar_##NAME ARGS;                                               \
+            break;                                                            \
+        }                                                                     \
+    }
+
+ORCA_SIMD_DISPATCH(fill, double, (double *x, size_t n, double value),
+                   (x, n, value))
+ORCA_SIMD_DISPATCH(fill, float, (float *x, size_t n, float value),
+                   (x, n, value))
+ORCA_SIMD_DISPATCH(copy, double, (double *y, const double *x, size_t n),
+                   (y, x, n))
+ORCA_SIMD_DISPATCH(copy, float, (float *y, const float *x, size_t n),
+                   (y, x, n))
+ORCA_SIMD_DISPATCH(scale, double, (double *x, size_t n, double alpha),
+                   (x, n, alpha))
+ORCA_SIMD_DISPATCH(scale, float, (float *x, size_t n, float alpha),
+                   (x, n, alpha))
+ORCA_SIMD_DISPATCH(axpy, double,
+                   (double *y, double alpha, const double *x, size_t n),
+                   (y, alpha, x, n))
+ORCA_SIMD_DISPATCH(axpy, float,
+                   (float *y, float alpha, const float *x, size_t n),
+                   (y, alpha, x, n))
+ORCA_SIMD_DISPATCH(min, double,
+                   (double *z, const double *x, const double *y, size_t n),
+                   (z, x, y, n))
+ORCA_SIMD_DISPATCH(min, float,
+                   (float *z, const float *x, const float *y, size_t n),
+                   (z, x, y, n))
+ORCA_SIMD_DISPATCH(max, double,
+                   (double *z, const double *x, const double *y, size_t n),
+                   (z, x, y, n))
+ORCA_SIMD_DISPATCH(max, float,
+                   (float *z, const float *x, const float *y, size_t n),
+                   (z, x, y, n))
+
+#undef ORCA_SIMD_DISPATCH
+
+inline void simd_convert(float *y, const double *x, size_t n) {
+    switch (current_simd_level()) {
+    case SIMD_AVX512:
+        avx512_convert(y, x, n);
+        break;
+    case SIMD_AVX2:
+        avx2_convert(y, x, n);
+        break;
+    case SIMD_SSE2:
+        sse2_convert(y, x, n);
+        break;
+    default:
+        scalar_convert(y, x, n);
+        break;
+    }
+}
+
+inline void simd_convert(double *y, const float *x, size_t n) {
+    switch (current_simd_level()) {
+    case SIMD_AVX512:
+        avx512_convert(y, x, n);
+        break;
+    case SIMD_AVX2:
+        avx2_convert(y, x, n);
+        break;
+    case SIMD_SSE2:
+        sse2_convert(y, x, n);
+        break;
+    default:
+        scalar_convert(y, x, n);
+        break;
+    }
+}
+
+#endif
+
+////////////// end dispatching kernels /////////////////////
+
+//////////////// start array kernels /////////////////////
+
+// every element of a = value
+template <class T, int N> void simd_fill(arraynd<T, N> &a, T value) {
+    simd_fill(a.data(), a.num_elements(), value);
+}
+
+// y = x
+template <class T, int N>
+void simd_copy(arraynd<T, N> &y, const arraynd<T, N> &x) {
+    check_same_shape(y, x);
+    simd_copy(y.data(), x.data(), y.num_elements());
+}
+
+// x = alpha * x
+template <class T, int N> void simd_scale(arraynd<T, N> &x, T alpha) {
+    simd_scale(x.data(), x.num_elements(), alpha);
+}
+
+// y = y + alpha * x
+template <class T, int N>
+void simd_axpy(arraynd<T, N> &y, T alpha, const arraynd<T, N> &x) {
+    check_same_shape(y, x);
+    simd_axpy(y.data(), alpha, x.data(), y.num_elements());
+}
+
+// z = elementwise minimum of x and y
+template <class T, int N>
+void simd_min(arraynd<T, N> &z, const arraynd<T, N> &x,
+              const arraynd<T, N> &y) {
+    check_same_shape(z, x);
+    check_same_shape(z, y);
+    simd_min(z.data(), x.data(), y.data(), z.num_elements());
+}
+
+// z = elementwise maximum of x and y
+template <class T, int N>
+void simd_max(arraynd<T, N> &z, const arraynd<T, N> &x,
+              const arraynd<T, N> &y) {
+    check_same_shape(z, x);
+    check_same_shape(z, y);
+    simd_max(z.data(), x.data(), y.data(), z.num_elements());
+}
+
+// y = x converted to the element type of y
+template <class To, class From, int N>
+void simd_convert(arraynd<To, N> &y, const arraynd<From, N> &x) {
+    check_same_shape(y, x);
+    simd_convert(y.data(), x.data(), y.num_elements());
+}
+
+////////////// end array kernels /////////////////////
+
+} // namespace orca_array
+
+// endif ORCA_SIMD
+#endif
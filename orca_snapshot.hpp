@@ -0,0 +1,527 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// File: orca_snapshot.hpp
+//
+// Copy on write snapshots of orca_array arrays, e.g. for diagnostics or a
+// checkpoint of a consistent state while the solver keeps running.
+//
+// snapshot<T, N> s(a) takes a snapshot of a without copying its elements:
+// the whole pages of a are made read only, and the first write to one of
+// them (from any thread) stops in a SIGSEGV handler that copies the page
+// into the snapshot and makes it writable again. Every page is copied at
+// most once, so a snapshot costs as much memory and time as the pages the
+// solver changes while it lives.
+//
+// Arrays allocated with ALLOC_ZERO (or ALLOC_HUGE_PAGES, when large) own
+// all their pages and are protected whole. Arrays allocated with new[] may
+// share their first and last page with other heap data; those partial
+// pages are copied when the snapshot is taken instead, so they only match
+// the rest if nothing writes them at that moment.
+//
+// The handler passes every other SIGSEGV on to the handler installed
+// before it, so bounds check failures still end the program. While a
+// snapshot of a lives:
+//
+// - a must not be resized, reserved or destroyed;
+// - a must not be the destination of a system call such as read(), which
+//   fails with EFAULT on a read only page instead of faulting.
+//
+// On systems other than Linux the snapshot is a full copy.
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef ORCA_SNAPSHOT
+#define ORCA_SNAPSHOT
+
+#include "orca_array.hpp"
+
+#include <string.h>
+
+namespace orca_array {
+
+//////////////// start snapshot helpers /////////////////////
+
+// whole pages of a snapshot, first ... last-1
+struct snapshot_region {
+    uintptr_t first;
+    uintptr_t last;
+    size_t page;
+
+    // copies of the pages, same layout, only written pages are touched
+    char *shadow;
+
+    // per page: 0 not copied, 1 being copied, 2 copied
+    unsigned char *state;
+};
+
+#if defined(__linux__)
+
+// snapshots alive at the same time
+const int max_snapshots = 64;
+
+inline snapshot_region **snapshot_table(void) {
+    static snapshot_region *table[max_snapshots];
+    return table;
+}
+
+// Threads inside snapshot_fault() count up from 0; the top bit is set
+// while a snapshot is taken or released, which waits for the count to
+// drop to 0 and keeps new faults waiting. A fault can then never make a
+// page writable that a new snapshot has just protected.
+const unsigned snapshot_writer = 1u << 31;
+
+inline unsigned &snapshot_lock(void) {
+    static unsigned lock = 0;
+    return lock;
+}
+
+inline void enter_snapshot_fault(void) {
+    unsigned &lock = snapshot_lock();
+    for (;;) {
+        unsigned seen = __atomic_load_n(&lock, __ATOMIC_SEQ_CST);
+        if ((seen & snapshot_writer) == 0 &&
+            __atomic_compare_exchange_n(&lock, &seen, seen + 1, false,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+            return;
+        }
+    }
+}
+
+inline void leave_snapshot_fault(void) {
+    __atomic_sub_fetch(&snapshot_lock(), 1, __ATOMIC_SEQ_CST);
+}
+
+inline void lock_snapshots(void) {
+    unsigned &lock = snapshot_lock();
+    for (;;) {
+        unsigned seen = __atomic_load_n(&lock, __ATOMIC_SEQ_CST);
+        if ((seen & snapshot_writer) == 0 &&
+            __atomic_compare_exchange_n(&lock, &seen, seen | snapshot_writer,
+                                        false, __ATOMIC_SEQ_CST,
+                                        __ATOMIC_SEQ_CST)) {
+            break;
+        }
+    }
+    while (__atomic_load_n(&lock, __ATOMIC_SEQ_CST) != snapshot_writer) {
+    }
+}
+
+inline void unlock_snapshots(void) {
+    __atomic_store_n(&snapshot_lock(), 0u, __ATOMIC_SEQ_CST);
+}
+
+// The ranges of the last released snapshots. A write can fault just
+// before its snapshot is released and reach the handler just after;
+// such a fault is retried instead of passed on.
+const int released_ranges = 64;
+
+inline uintptr_t *released_snapshots(void) {
+    static uintptr_t range[2 * released_ranges];
+    return range;
+}
+
+inline unsigned &next_released(void) {
+    static unsigned next = 0;
+    return next;
+}
+
+inline bool recently_released(uintptr_t address) {
+    const uintptr_t *range = released_snapshots();
+    for (int k = 0; k < released_ranges; k++) {
+        uintptr_t first = __atomic_load_n(&range[2 * k], __ATOMIC_SEQ_CST);
+        uintptr_t last = __atomic_load_n(&range[2 * k + 1], __ATOMIC_SEQ_CST);
+        if (address >= first && address < last) {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline struct sigaction &previous_segv_action(void) {
+    static struct sigaction previous;
+    return previous;
+}
+
+// Copies page p of r into the shadow unless another thread does.
+inline void copy_page_before_write(snapshot_region *r, size_t p) {
+    unsigned char expected = 0;
+    if (__atomic_compare_exchange_n(&r->state[p], &expected, 1, false,
+                                    __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        memcpy(r->shadow + p * r->page, (char *)(r->first + p * r->page),
+               r->page);
+        __atomic_store_n(&r->state[p], 2, __ATOMIC_SEQ_CST);
+    }
+}
+
+// hands a SIGSEGV that is not ours to the previous disposition
+inline void chain_segv(int sig, siginfo_t *info, void *context) {
+    struct sigaction &previous = previous_segv_action();
+    if (previous.sa_flags & SA_SIGINFO) {
+        previous.sa_sigaction(sig, info, context);
+        return;
+    }
+    if (previous.sa_handler == SIG_IGN) {
+        return;
+    }
+    if (previous.sa_handler != SIG_DFL) {
+        previous.sa_handler(sig);
+        return;
+    }
+
+    // default action: a fault happens again on return, a raised signal
+    // is raised again and is delivered when the handler returns
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = SIG_DFL;
+    sigemptyset(&action.sa_mask);
+    sigaction(sig, &action, NULL);
+    if (info->si_code <= 0) {
+        raise(sig);
+    }
+}
+
+// Several snapshots of one array protect the same pages; the page is
+// made writable once all of them have their copy.
+inline void snapshot_fault(int sig, siginfo_t *info, void *context) {
+    bool handled = false;
+    if (info->si_code == SEGV_ACCERR) {
+        enter_snapshot_fault();
+
+        uintptr_t address = (uintptr_t)info->si_addr;
+        snapshot_region **table = snapshot_table();
+        snapshot_region *found[max_snapshots];
+        int count = 0;
+        for (int s = 0; s < max_snapshots; s++) {
+            snapshot_region *r = __atomic_load_n(&table[s], __ATOMIC_SEQ_CST);
+            if (r != NULL && address >= r->first && address < r->last) {
+                found[count++] = r;
+                copy_page_before_write(r, (address - r->first) / r->page);
+            }
+        }
+
+        if (count > 0) {
+            for (int s = 0; s < count; s++) {
+                size_t p = (address - found[s]->first) / found[s]->page;
+                while (__atomic_load_n(&found[s]->state[p],
+                                       __ATOMIC_SEQ_CST) != 2) {
+                }
+            }
+            size_t page = found[0]->page;
+            mprotect((void *)(address / page * page), page,
+                     PROT_READ | PROT_WRITE);
+            handled = true;
+        } else {
+            handled = recently_released(address);
+        }
+
+        leave_snapshot_fault();
+    }
+
+    if (!handled) {
+        chain_segv(sig, info, context);
+    }
+}
+
+// installs snapshot_fault() once, before the first page is protected
+inline void install_snapshot_handler(void) {
+    // 0 not installed, 1 being installed, 2 installed
+    static int installed = 0;
+    int expected = 0;
+    if (__atomic_compare_exchange_n(&installed, &expected, 1, false,
+                                    __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_sigaction = snapshot_fault;
+        action.sa_flags = SA_SIGINFO;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGSEGV, &action, &previous_segv_action());
+        __atomic_store_n(&installed, 2, __ATOMIC_SEQ_CST);
+    } else {
+        while (__atomic_load_n(&installed, __ATOMIC_SEQ_CST) != 2) {
+        }
+    }
+}
+
+inline int register_snapshot(snapshot_region *r) {
+    snapshot_region **table = snapshot_table();
+    for (int s = 0; s < max_snapshots; s++) {
+        snapshot_region *empty = NULL;
+        if (__atomic_compare_exchange_n(&table[s], &empty, r, false,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+            return s;
+        }
+    }
+    printf("more than %d snapshots alive at the same time\n", max_snapshots);
+    printf("file %s, line %d.\n", __FILE__, __LINE__);
+    raise(SIGSEGV);
+    return -1;
+}
+
+// Makes the pages of slot s writable, unless another snapshot still
+// protects them, and forgets the snapshot. The handler no longer uses its
+// shadow when this returns.
+inline void release_snapshot(int s) {
+    lock_snapshots();
+
+    snapshot_region **table = snapshot_table();
+    snapshot_region *r = table[s];
+    __atomic_store_n(&table[s], (snapshot_region *)NULL, __ATOMIC_SEQ_CST);
+
+    unsigned k = __atomic_fetch_add(&next_released(), 1, __ATOMIC_SEQ_CST);
+    uintptr_t *range = released_snapshots() + 2 * (k % released_ranges);
+    __atomic_store_n(&range[0], (uintptr_t)0, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&range[1], r->last, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&range[0], r->first, __ATOMIC_SEQ_CST);
+
+    // pages another snapshot has not copied yet stay read only, the
+    // others are made writable in runs of neighboring pages
+    size_t pages = (r->last - r->first) / r->page;
+    size_t run = 0;
+    for (size_t p = 0; p <= pages; p++) {
+        uintptr_t page = r->first + p * r->page;
+        bool protect = (p == pages);
+        for (int t = 0; t < max_snapshots && !protect; t++) {
+            snapshot_region *other = table[t];
+            if (other != NULL && page >= other->first && page < other->last &&
+                other->state[(page - other->first) / other->page] == 0) {
+                protect = true;
+            }
+        }
+        if (protect) {
+            if (p > run) {
+                mprotect((void *)(r->first + run * r->page),
+                         (p - run) * r->page, PROT_READ | PROT_WRITE);
+            }
+            run = p + 1;
+        }
+    }
+
+    unlock_snapshots();
+}
+
+#endif
+
+////////////// end snapshot helpers /////////////////////
+
+//////////////// start class snapshot /////////////////////
+
+template <class array_element_type, int N> class snapshot {
+
+    static_assert(std::is_trivially_copyable<array_element_type>::value,
+                  "snapshot needs trivially copyable elements");
+
+  private:
+    const arraynd<array_element_type, N> &live;
+
+    // the elements of live, total bytes from begin
+    const char *begin;
+    size_t total;
+
+    // bytes before the first whole page and from the last whole page on,
+    // copied into ends when the snapshot is taken
+    size_t head;
+    size_t tail;
+    char *ends;
+
+    snapshot_region region;
+
+    // slot of region in snapshot_table(), -1 if no page is protected
+    int slot;
+
+  public:
+    // takes a snapshot of a, which must outlive it
+    explicit snapshot(arraynd<array_element_type, N> &a)
+        : live(a), begin((const char *)a.data()),
+          total(a.num_elements() * sizeof(array_element_type)), slot(-1) {
+
+#if defined(__linux__)
+        size_t page = sysconf(_SC_PAGESIZE);
+        uintptr_t start = (uintptr_t)begin;
+        uintptr_t first = (start + page - 1) / page * page;
+        uintptr_t last = (start + total) / page * page;
+        if (a.owns_pages()) {
+            first = start / page * page;
+            last = (start + total + page - 1) / page * page;
+        }
+        if (last <= first) {
+            first = last = start + total;
+        }
+#else
+        uintptr_t first = (uintptr_t)begin + total;
+        uintptr_t last = first;
+#endif
+        // the region may extend past the elements if they own their pages
+        uintptr_t end = (uintptr_t)begin + total;
+        head = (first > (uintptr_t)begin) ? first - (uintptr_t)begin : 0;
+        tail = (last < end) ? end - last : 0;
+        ends = new char[head + tail + 1];
+        memcpy(ends, begin, head);
+        memcpy(ends + head, begin + total - tail, tail);
+
+        region.first = first;
+        region.last = last;
+        region.shadow = NULL;
+        region.state = NULL;
+
+#if defined(__linux__)
+        region.page = page;
+        if (last > first) {
+            size_t bytes = last - first;
+            region.shadow = (char *)map_pages(bytes);
+            region.state = (unsigned char *)map_pages(bytes / page);
+
+            install_snapshot_handler();
+            lock_snapshots();
+            slot = register_snapshot(&region);
+            int failed = mprotect((void *)first, bytes, PROT_READ);
+            unlock_snapshots();
+            if (failed != 0) {
+                printf("cannot protect the pages of the array\n");
+                printf("file %s, line %d.\n", __FILE__, __LINE__);
+                raise(SIGSEGV);
+            }
+        }
+#endif
+    }
+
+    ~snapshot() {
+#if defined(__linux__)
+        if (slot >= 0) {
+            release_snapshot(slot);
+            size_t bytes = region.last - region.first;
+            munmap(region.shadow, bytes);
+            munmap(region.state, bytes / region.page);
+        }
+#endif
+        delete[] ends;
+    }
+
+    inline int length(int dim) const { return live.length(dim); }
+
+    inline size_t num_elements(void) const { return live.num_elements(); }
+
+    // element x1 ... xN as it was when the snapshot was taken
+    template <class... Index> array_element_type at(Index... x) const {
+        static_assert(sizeof...(Index) == N, "at() needs N indices");
+        array_element_type value;
+        read_bytes(live.offset(x...) * sizeof(array_element_type),
+                   sizeof(array_element_type), (char *)&value);
+        return value;
+    }
+
+    // copies the snapshot into out, e.g. to write a checkpoint
+    void copy_to(arraynd<array_element_type, N> &out) const {
+        check_same_shape(out, live);
+        char *to = (char *)out.data();
+        memcpy(to, ends, head);
+        memcpy(to + total - tail, ends + head, tail);
+
+#if defined(__linux__)
+        // page p holds bytes first ... first+page-1 of the region
+        long pages = (region.last - region.first) / region.page;
+        ORCA_OMP(omp parallel for schedule(static))
+        for (long p = 0; p < pages; p++) {
+            uintptr_t first = region.first + p * region.page;
+            uintptr_t last = first + region.page;
+            uintptr_t start = (uintptr_t)begin + head;
+            uintptr_t end = (uintptr_t)begin + total - tail;
+            first = (first > start) ? first : start;
+            last = (last < end) ? last : end;
+            if (first < last) {
+                read_bytes(first - (uintptr_t)begin, last - first,
+                           to + (first - (uintptr_t)begin));
+            }
+        }
+#endif
+    }
+
+    // pages copied so far because live was written
+    size_t pages_copied(void) const {
+        size_t copied = 0;
+#if defined(__linux__)
+        size_t pages = (region.last - region.first) / region.page;
+        for (size_t p = 0; p < pages; p++) {
+            copied += (__atomic_load_n(&region.state[p], __ATOMIC_SEQ_CST) ==
+                       2);
+        }
+#endif
+        return copied;
+    }
+
+    // note that even though snapshot is a template, inside defintion of
+    // snapshot snapshot means same as snapshot<array_element_type, N>
+
+  private:
+#if defined(__linux__)
+    static void *map_pages(size_t bytes) {
+        void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (p == MAP_FAILED) {
+            printf("cannot map %lu bytes for a snapshot\n",
+                   (unsigned long)bytes);
+            printf("file %s, line %d.\n", __FILE__, __LINE__);
+            raise(SIGSEGV);
+        }
+        return p;
+    }
+
+    // Copies count bytes of page p of the region, from offset within it,
+    // as they were. A page still marked 0 after reading has not been
+    // written yet, because its first write marks it before the page
+    // becomes writable.
+    void read_part(size_t p, size_t offset, size_t count, char *to) const {
+        const char *source = (const char *)region.first + p * region.page;
+        if (__atomic_load_n(&region.state[p], __ATOMIC_SEQ_CST) == 0) {
+            memcpy(to, source + offset, count);
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&region.state[p], __ATOMIC_SEQ_CST) == 0) {
+                return;
+            }
+        }
+        while (__atomic_load_n(&region.state[p], __ATOMIC_SEQ_CST) != 2) {
+        }
+        memcpy(to, region.shadow + p * region.page + offset, count);
+    }
+
+#endif
+
+    // count bytes of the elements from byte position as they were
+    void read_bytes(size_t position, size_t count, char *to) const {
+        while (count > 0) {
+            size_t n;
+            if (position < head) {
+                n = (head - position < count) ? head - position : count;
+                memcpy(to, ends + position, n);
+            } else if (position >= total - tail) {
+                n = count;
+                memcpy(to, ends + head + (position - (total - tail)), n);
+            } else {
+#if defined(__linux__)
+                size_t inner = (uintptr_t)begin + position - region.first;
+                size_t p = inner / region.page;
+                size_t offset = inner % region.page;
+                n = region.page - offset;
+                n = (n < count) ? n : count;
+                read_part(p, offset, n, to);
+#else
+                n = count;
+#endif
+            }
+            position += n;
+            count -= n;
+            to += n;
+        }
+    }
+
+    // prohibit copy constructor
+    snapshot(snapshot &);
+
+    // prohibit assignment operator
+    snapshot &operator=(snapshot &);
+};
+
+////////////// end class snapshot /////////////////////
+
+} // namespace orca_array
+
+// endif ORCA_SNAPSHOT
+#endif
@@ -0,0 +1,326 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// File: orca_soa.hpp
+//
+// Structure of arrays container soa_array<T, N, K, B> for fields with K
+// components (density, velocities, energy ...) on a rank N orca_array
+// shape. Every component uses the same extents and the same Fortran or C
+// order factors as arraynd<T, N>.
+//
+// B = 0 stores every component contiguously (SoA). B > 0 stores blocks of
+// B consecutive cells with the K components one after another inside a
+// block (AoSoA), which keeps all components of nearby cells within a few
+// cache lines while still giving B wide unit stride vectors per component.
+//
+// Components are numbered 0 ... K-1, usually through an enum. They can
+// also be given names and looked up by name, e.g. for output or for
+// components chosen at run time.
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef ORCA_SOA
+#define ORCA_SOA
+
+#include "orca_array.hpp"
+
+#include <string>
+
+namespace orca_array {
+
+//////////////// start class soa_cell /////////////////////
+
+// All K components of one cell, cell[c] is component c. Obtained from
+// soa_array::cell(), valid as long as the soa_array is not resized. From a
+// const soa_array the element type is const and store() is not available.
+template <class array_element_type> class soa_cell {
+
+  private:
+    array_element_type *first;
+    size_t stride;
+
+  public:
+    soa_cell(array_element_type *component0, size_t component_stride)
+        : first(component0), stride(component_stride) {}
+
+    inline array_element_type &operator[](int component) const {
+        return first[component * stride];
+    }
+
+    // copy the components of the cell to values[0] ... values[count-1]
+    inline void
+    load(typename std::remove_const<array_element_type>::type *values,
+         int count) const {
+        for (int c = 0; c < count; c++) {
+            values[c] = first[c * stride];
+        }
+    }
+
+    // copy values[0] ... values[count-1] into the components of the cell
+    inline void store(const array_element_type *values, int count) const {
+        for (int c = 0; c < count; c++) {
+            first[c * stride] = values[c];
+        }
+    }
+};
+
+////////////// end class soa_cell /////////////////////
+
+//////////////// start class soa_array /////////////////////
+
+template <class array_element_type, int N, int K, int B = 0> class soa_array {
+
+    static_assert(N >= 1, "soa_array needs at least one dimension");
+    static_assert(K >= 1, "soa_array needs at least one component");
+    static_assert(B >= 0 && (B & (B - 1)) == 0,
+                  "block size B must be 0 or a power of 2");
+
+  private:
+    int size[N];
+
+    // factors for Fortran order
+    size_t F[N];
+
+    // factors for C order
+    size_t C[N];
+
+    // number of cells, product of the sizes
+    size_t cells;
+
+    // distance between two components of the same cell
+    size_t component_stride;
+
+    // first element aligned to 64 bytes
+    array_element_type *internal_array;
+
+    // start of the allocation, internal_array may be a few elements later
+    array_element_type *allocated;
+
+    // how allocated was allocated
+    allocation_record record;
+
+    // names of the components, empty until set_component_names()
+    std::string name[K];
+
+  public:
+    static const int rank = N;
+    static const int components = K;
+    static const int block = B;
+
+    // constructor
+    // takes N extents optionally followed by an allocation_option
+    template <class... Args> explicit soa_array(Args... args) {
+        static_assert(sizeof...(Args) == N || sizeof...(Args) == N + 1,
+                      "soa_array needs N extents and an optional "
+                      "allocation_option");
+
+        allocation_option option = ALLOC_DEFAULT;
+        read_extents<N, 0>(size, option, args...);
+        check_extents(N, size);
+        compute_factors(N, size, F, C);
+
+        cells = count_elements(N, size);
+
+        // pad so that every component (SoA) or every block (AoSoA) starts
+        // on a 64 byte boundary when the element size divides 64
+        size_t align = 1;
+        if (sizeof(array_element_type) < 64 &&
+            64 % sizeof(array_element_type) == 0) {
+            align = 64 / sizeof(array_element_type);
+        }
+
+        size_t total;
+        if (B == 0) {
+            component_stride = (cells + align - 1) / align * align;
+            total = component_stride * K;
+        } else {
+            component_stride = B;
+            total = num_blocks() * K * B;
+        }
+
+        allocated = allocate_elements<array_element_type>(total + align - 1,
+                                                          option, record);
+
+        uintptr_t bytes = align * sizeof(array_element_type);
+        uintptr_t start = ((uintptr_t)allocated + bytes - 1) / bytes * bytes;
+        internal_array = (array_element_type *)start;
+    }
+
+    // destructor
+    ~soa_array() { free_elements(allocated, record); }
+
+    inline int length(int dim) const { return size[dim - 1]; }
+
+    // number of cells, product of the extents
+    inline size_t num_cells(void) const { return cells; }
+
+    // number of AoSoA blocks, the last one may be partly used
+    inline size_t num_blocks(void) const {
+        return (B == 0) ? 0 : (cells + B - 1) / B;
+    }
+
+    // true if the array is currently backed by transparent huge pages
+    inline bool uses_huge_pages(void) const {
+        return huge_pages_in_use(record);
+    }
+
+    // component c of the cell x1 ... xN
+    template <class... Index>
+    inline array_element_type &at(int c, Index... x) {
+        return internal_array[element_offset(c, x...)];
+    }
+
+    // overloaded at() const
+    template <class... Index>
+    inline const array_element_type &at(int c, Index... x) const {
+        return internal_array[element_offset(c, x...)];
+    }
+
+    // component called label of the cell x1 ... xN
+    template <class... Index>
+    inline array_element_type &at(const char *label, Index... x) {
+        return internal_array[element_offset(component_index(label), x...)];
+    }
+
+    template <class... Index>
+    inline const array_element_type &at(const char *label, Index... x) const {
+        return internal_array[element_offset(component_index(label), x...)];
+    }
+
+    // all components of the cell x1 ... xN
+    template <class... Index>
+    inline soa_cell<array_element_type> cell(Index... x) {
+        return soa_cell<array_element_type>(
+            internal_array + element_offset(0, x...), component_stride);
+    }
+
+    // overloaded cell() const
+    template <class... Index>
+    inline soa_cell<const array_element_type> cell(Index... x) const {
+        return soa_cell<const array_element_type>(
+            internal_array + element_offset(0, x...), component_stride);
+    }
+
+    // names[c] becomes the name of component c
+    void set_component_names(const char *const (&names)[K]) {
+        for (int c = 0; c < K; c++) {
+            name[c] = names[c];
+        }
+    }
+
+    // name of component c, empty if none was set
+    inline const char *component_name(int c) const {
+#if ARRAY_BOUNDS_CHECK == 1
+        check_component(c);
+#endif
+        return name[c].c_str();
+    }
+
+    // number of the component called label, which must exist
+    int component_index(const char *label) const {
+        for (int c = 0; c < K; c++) {
+            if (name[c] == label) {
+                return c;
+            }
+        }
+        printf("soa_array has no component called %s\n", label);
+        printf("file %s, line %d.\n", __FILE__, __LINE__);
+        raise(SIGSEGV);
+        return -1;
+    }
+
+    // Contiguous data of component c in Fortran or C order. Only available
+    // for the SoA layout (B = 0).
+    inline array_element_type *component(int c) {
+        static_assert(B == 0, "component() needs the SoA layout, use "
+                              "block_component() for AoSoA");
+#if ARRAY_BOUNDS_CHECK == 1
+        check_component(c);
+#endif
+        return internal_array + c * component_stride;
+    }
+
+    inline const array_element_type *component(int c) const {
+        static_assert(B == 0, "component() needs the SoA layout, use "
+                              "block_component() for AoSoA");
+#if ARRAY_BOUNDS_CHECK == 1
+        check_component(c);
+#endif
+        return internal_array + c * component_stride;
+    }
+
+    inline array_element_type *component(const char *label) {
+        return component(component_index(label));
+    }
+
+    inline const array_element_type *component(const char *label) const {
+        return component(component_index(label));
+    }
+
+    // The B values of component c in AoSoA block b, covering the cells with
+    // linear offsets b*B ... b*B+B-1.
+    inline array_element_type *block_component(size_t b, int c) {
+        static_assert(B > 0, "block_component() needs the AoSoA layout");
+#if ARRAY_BOUNDS_CHECK == 1
+        check_component(c);
+#endif
+        return internal_array + (b * K + c) * B;
+    }
+
+    inline const array_element_type *block_component(size_t b, int c) const {
+        static_assert(B > 0, "block_component() needs the AoSoA layout");
+#if ARRAY_BOUNDS_CHECK == 1
+        check_component(c);
+#endif
+        return internal_array + (b * K + c) * B;
+    }
+
+    // note that even though soa_array is a template, inside defintion of
+    // soa_array soa_array means same as soa_array<array_element_type, N, K, B>
+  private:
+    template <class... Index>
+    inline size_t element_offset(int c, Index... x) const {
+        static_assert(sizeof...(Index) == N, "soa_array needs N indices");
+
+#if ARRAY_BOUNDS_CHECK == 1
+        int index[N] = {static_cast<int>(x)...};
+        check_component(c);
+        check_indices(N, index, size);
+#endif
+
+#if FORTRAN_ORDER == 1
+        size_t cell_offset = fortran_offset(F, x...);
+#else
+        size_t cell_offset = c_offset(C, x...);
+#endif
+
+        if (B == 0) {
+            return c * component_stride + cell_offset;
+        } else {
+            // B is a power of 2 so these are a shift and a mask
+            return (cell_offset / B * K + c) * B + cell_offset % B;
+        }
+    }
+
+    void check_component(int c) const {
+        if ((c < 0) || (c >= K)) {
+            printf("component c is less than 0 or equal to K or greater "
+                   "than K\n");
+            printf("c=%d \n", c);
+            printf("K=%d \n", K);
+            printf("file %s, line %d.\n", __FILE__, __LINE__);
+            raise(SIGSEGV);
+        }
+    }
+
+    // prohibit copy constructor
+    soa_array(soa_array &);
+
+    // prohibit assignment operator
+    soa_array &operator=(soa_array &);
+};
+
+////////////// end class soa_array /////////////////////
+
+} // namespace orca_array
+
+// endif ORCA_SOA
+#endif
@@ -0,0 +1,383 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// File: orca_sparse.hpp
+//
+// Sparse N dimensional arrays for tables that are mostly zeros.
+//
+// sparse_builder<T, N> collects the nonzero elements in a hash table, in
+// any order, through the usual at(). sparse_array<T, N> is built from a
+// sparse_builder (or from a dense arraynd) and stores only the nonzeros
+// sorted by their linear offset in Fortran or C order, i.e. in the order a
+// dense loop would visit them. at() finds an element with a binary search
+// inside one slice of the slowest dimension and returns zero for elements
+// that are not stored.
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef ORCA_SPARSE
+#define ORCA_SPARSE
+
+#include "orca_array.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+namespace orca_array {
+
+template <class array_element_type, int N> class sparse_array;
+
+//////////////// start class sparse_builder /////////////////////
+
+template <class array_element_type, int N> class sparse_builder {
+
+  private:
+    int size[N];
+
+    // factors for Fortran order
+    size_t F[N];
+
+    // factors for C order
+    size_t C[N];
+
+    // element at each linear offset written so far
+    std::unordered_map<size_t, array_element_type> entries;
+
+    friend class sparse_array<array_element_type, N>;
+
+  public:
+    static const int rank = N;
+
+    // constructor
+    // takes N extents
+    template <class... Args> explicit sparse_builder(Args... dims) {
+        static_assert(sizeof...(Args) == N, "sparse_builder needs N extents");
+        int extents[N] = {static_cast<int>(dims)...};
+        init(extents);
+    }
+
+    // constructor from an array of N extents, for code that is generic in N
+    explicit sparse_builder(const int (&dims)[N]) { init(dims); }
+
+    inline int length(int dim) const { return size[dim - 1]; }
+
+    // number of elements written so far, including ones set to zero
+    inline size_t num_entries(void) const { return entries.size(); }
+
+    // make room for count elements without rehashing
+    void reserve(size_t count) { entries.reserve(count); }
+
+    // Element x1 ... xN, zero the first time it is used. Writes in any
+    // order, e.g. at(s, e, a) += contribution.
+    template <class... Index> inline array_element_type &at(Index... x) {
+        static_assert(sizeof...(Index) == N, "at() needs N indices");
+
+#if ARRAY_BOUNDS_CHECK == 1
+        int index[N] = {static_cast<int>(x)...};
+        check_indices(N, index, size);
+#endif
+
+#if FORTRAN_ORDER == 1
+        size_t offset = fortran_offset(F, x...);
+#else
+        size_t offset = c_offset(C, x...);
+#endif
+
+        typename std::unordered_map<size_t, array_element_type>::iterator it =
+            entries.find(offset);
+        if (it == entries.end()) {
+            it = entries.insert(std::make_pair(offset, array_element_type()))
+                     .first;
+        }
+        return it->second;
+    }
+
+    // forget all elements
+    void clear(void) { entries.clear(); }
+
+    // note that even though sparse_builder is a template, inside defintion
+    // of sparse_builder sparse_builder means same as
+    // sparse_builder<array_element_type, N>
+  private:
+    void init(const int *dims) {
+        for (int d = 0; d < N; d++) {
+            size[d] = dims[d];
+        }
+        check_extents(N, size);
+        compute_factors(N, size, F, C);
+    }
+
+    // prohibit copy constructor
+    sparse_builder(sparse_builder &);
+
+    // prohibit assignment operator
+    sparse_builder &operator=(sparse_builder &);
+};
+
+////////////// end class sparse_builder /////////////////////
+
+//////////////// start class sparse_array /////////////////////
+
+template <class array_element_type, int N> class sparse_array {
+
+  private:
+    int size[N];
+
+    // factors for Fortran order
+    size_t F[N];
+
+    // factors for C order
+    size_t C[N];
+
+    size_t nonzeros;
+
+    // linear offsets of the nonzeros, ascending, and their values
+    size_t *offsets;
+    array_element_type *values;
+
+    // The nonzeros of slice s of the slowest dimension (x1 in C order, xN
+    // in Fortran order) are first[s] ... first[s+1]-1.
+    size_t *first;
+
+    // number of elements in one slice of the slowest dimension
+    size_t slice_elements;
+
+  public:
+    static const int rank = N;
+
+    // Take the nonzero elements of builder, elements that were set to zero
+    // are dropped. builder is left unchanged.
+    explicit sparse_array(
+        const sparse_builder<array_element_type, N> &builder) {
+        init(builder.size);
+
+        std::vector<std::pair<size_t, array_element_type> > sorted;
+        sorted.reserve(builder.entries.size());
+        typename std::unordered_map<size_t,
+                                    array_element_type>::const_iterator it;
+        for (it = builder.entries.begin(); it != builder.entries.end(); ++it) {
+            if (!(it->second == array_element_type())) {
+                sorted.push_back(*it);
+            }
+        }
+        std::sort(sorted.begin(), sorted.end(), offset_less);
+
+        fill(sorted);
+    }
+
+    // take the nonzero elements of a dense array of the same rank
+    explicit sparse_array(const arraynd<array_element_type, N> &dense) {
+        int dims[N];
+        for (int d = 0; d < N; d++) {
+            dims[d] = dense.length(d + 1);
+        }
+        init(dims);
+
+        std::vector<std::pair<size_t, array_element_type> > sorted;
+        const array_element_type *x = dense.data();
+        size_t elements = dense.num_elements();
+        for (size_t i = 0; i < elements; i++) {
+            if (!(x[i] == array_element_type())) {
+                sorted.push_back(std::make_pair(i, x[i]));
+            }
+        }
+
+        fill(sorted);
+    }
+
+    // destructor
+    ~sparse_array() {
+        delete[] first;
+        delete[] values;
+        delete[] offsets;
+    }
+
+    // extent of dimension dim, counted from 1 like length1() ... lengthN()
+    inline int length(int dim) const { return size[dim - 1]; }
+
+    inline int length1(void) const { return size[0]; }
+
+    inline int length2(void) const {
+        static_assert(N >= 2, "length2() needs at least 2 dimensions");
+        return size[1];
+    }
+
+    inline int length3(void) const {
+        static_assert(N >= 3, "length3() needs at least 3 dimensions");
+        return size[2];
+    }
+
+    inline int length4(void) const {
+        static_assert(N >= 4, "length4() needs at least 4 dimensions");
+        return size[3];
+    }
+
+    inline int length5(void) const {
+        static_assert(N >= 5, "length5() needs at least 5 dimensions");
+        return size[4];
+    }
+
+    inline int length6(void) const {
+        static_assert(N >= 6, "length6() needs at least 6 dimensions");
+        return size[5];
+    }
+
+    inline int length7(void) const {
+        static_assert(N >= 7, "length7() needs at least 7 dimensions");
+        return size[6];
+    }
+
+    // number of elements of the dense array, product of the extents
+    inline size_t num_elements(void) const { return count_elements(N, size); }
+
+    inline size_t num_nonzeros(void) const { return nonzeros; }
+
+    // bytes used by the nonzeros and the slice table
+    inline size_t memory_bytes(void) const {
+        return nonzeros * (sizeof(size_t) + sizeof(array_element_type)) +
+               (slices() + 1) * sizeof(size_t);
+    }
+
+    // element x1 ... xN, zero if it is not stored
+    template <class... Index> inline array_element_type at(Index... x) const {
+        const array_element_type *element = find(x...);
+        return element ? *element : array_element_type();
+    }
+
+    // the stored element x1 ... xN, 0 if it is not stored
+    template <class... Index>
+    inline const array_element_type *find(Index... x) const {
+        static_assert(sizeof...(Index) == N, "find() needs N indices");
+
+#if ARRAY_BOUNDS_CHECK == 1
+        int index[N] = {static_cast<int>(x)...};
+        check_indices(N, index, size);
+#endif
+
+#if FORTRAN_ORDER == 1
+        size_t offset = fortran_offset(F, x...);
+#else
+        size_t offset = c_offset(C, x...);
+#endif
+
+        size_t s = offset / slice_elements;
+        const size_t *begin = offsets + first[s];
+        const size_t *end = offsets + first[s + 1];
+        const size_t *p = std::lower_bound(begin, end, offset);
+        if (p == end || *p != offset) {
+            return 0;
+        }
+        return values + (p - offsets);
+    }
+
+    // Nonzeros n = 0 ... num_nonzeros()-1 in Fortran or C order: values,
+    // linear offsets and N indices. The values may be changed in place.
+    inline array_element_type *nonzero_values(void) { return values; }
+
+    inline const array_element_type *nonzero_values(void) const {
+        return values;
+    }
+
+    inline const size_t *nonzero_offsets(void) const { return offsets; }
+
+    void nonzero_index(size_t n, int *index) const {
+        size_t offset = offsets[n];
+        for (int d = 0; d < N; d++) {
+#if FORTRAN_ORDER == 1
+            index[d] = (int)(offset / F[d] % size[d]);
+#else
+            index[d] = (int)(offset / C[d] % size[d]);
+#endif
+        }
+    }
+
+    // Nonzeros of slice s of the slowest dimension are first_in_slice(s)
+    // ... first_in_slice(s+1)-1.
+    inline size_t first_in_slice(int s) const { return first[s]; }
+
+    // copy into a dense array of the same extents, zeros included
+    void to_dense(arraynd<array_element_type, N> &dense) const {
+        for (int d = 0; d < N; d++) {
+            if (dense.length(d + 1) != size[d]) {
+                printf("dense extents differ from the sparse extents\n");
+                printf("length%d=%d size%d=%d \n", d + 1, dense.length(d + 1),
+                       d + 1, size[d]);
+                printf("file %s, line %d.\n", __FILE__, __LINE__);
+                raise(SIGSEGV);
+            }
+        }
+
+        array_element_type *x = dense.data();
+        size_t elements = dense.num_elements();
+        for (size_t i = 0; i < elements; i++) {
+            x[i] = array_element_type();
+        }
+        for (size_t n = 0; n < nonzeros; n++) {
+            x[offsets[n]] = values[n];
+        }
+    }
+
+    // note that even though sparse_array is a template, inside defintion
+    // of sparse_array sparse_array means same as
+    // sparse_array<array_element_type, N>
+  private:
+    void init(const int *dims) {
+        for (int d = 0; d < N; d++) {
+            size[d] = dims[d];
+        }
+        check_extents(N, size);
+        compute_factors(N, size, F, C);
+
+#if FORTRAN_ORDER == 1
+        slice_elements = F[N - 1];
+#else
+        slice_elements = C[0];
+#endif
+    }
+
+    inline int slices(void) const {
+#if FORTRAN_ORDER == 1
+        return size[N - 1];
+#else
+        return size[0];
+#endif
+    }
+
+    static bool offset_less(const std::pair<size_t, array_element_type> &a,
+                            const std::pair<size_t, array_element_type> &b) {
+        return a.first < b.first;
+    }
+
+    // store the nonzeros of sorted, which is ordered by offset
+    void
+    fill(const std::vector<std::pair<size_t, array_element_type> > &sorted) {
+        nonzeros = sorted.size();
+        offsets = new size_t[nonzeros];
+        values = new array_element_type[nonzeros];
+        first = new size_t[slices() + 1];
+
+        int s = 0;
+        for (size_t n = 0; n < nonzeros; n++) {
+            offsets[n] = sorted[n].first;
+            values[n] = sorted[n].second;
+            while (s <= (int)(offsets[n] / slice_elements)) {
+                first[s++] = n;
+            }
+        }
+        while (s <= slices()) {
+            first[s++] = nonzeros;
+        }
+    }
+
+    // prohibit copy constructor
+    sparse_array(sparse_array &);
+
+    // prohibit assignment operator
+    sparse_array &operator=(sparse_array &);
+};
+
+////////////// end class sparse_array /////////////////////
+
+} // namespace orca_array
+
+// endif ORCA_SPARSE
+#endif
@@ -0,0 +1,234 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// File: orca_temporal.hpp
+//
+// Temporal blocking for repeated stencil sweeps over orca_array arrays,
+// e.g. hundreds of Jacobi iterations. Instead of streaming the whole grid
+// through memory once per step, run_time_blocked() runs several steps on
+// one cache sized tile before moving on to the next.
+//
+// Two arrays of equal extents hold alternate steps. The grid is cut into
+// tiles along the tiled dimensions and every time block is done in
+// phases (split tiling):
+//
+// - first every tile does all steps of the block on a region that shrinks
+//   by the stencil radius per step, so it needs nothing from other tiles;
+// - then the gaps between the shrunk regions, which grow by the radius
+//   per step around every tile boundary, are filled in from the values
+//   the first phase left in both arrays.
+//
+// With more than one tiled dimension there is one phase per combination
+// of shrinking and growing dimensions. The tiles of a phase are
+// independent and split over the OpenMP threads.
+//
+// The update is called on boxes of the interior, the elements at least
+// radius away from every face; the outer radius layers are never written.
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef ORCA_TEMPORAL
+#define ORCA_TEMPORAL
+
+#include "orca_array.hpp"
+
+#include <math.h>
+#include <vector>
+
+namespace orca_array {
+
+// bytes of both arrays one tile should take, about the L2 cache of a core
+const size_t temporal_tile_bytes = 512 * 1024;
+
+// steps per time block when the caller does not choose
+const int default_time_block = 8;
+
+//////////////// start temporal helpers /////////////////////
+
+// The tiles of one dimension: tile k is edge[k] ... edge[k+1]-1, every
+// tile at least width wide. One tile if the dimension is not tiled.
+inline void tile_edges(int lo, int hi, int width, std::vector<int> &edge) {
+    int interior = hi - lo;
+    int tiles = (width > 0) ? interior / width : 1;
+    tiles = (tiles < 1) ? 1 : tiles;
+    edge.resize(tiles + 1);
+    for (int k = 0; k <= tiles; k++) {
+        edge[k] = lo + (int)((long)interior * k / tiles);
+    }
+}
+
+// Tile widths along the tiled dimensions so that both arrays of one tile
+// take about temporal_tile_bytes, and at least 2*steps*radius, which
+// keeps the growing regions of neighboring boundaries apart.
+inline int default_tile_width(size_t untiled_elements, int tiled_dims,
+                              size_t element_bytes, int steps, int radius) {
+    double budget = (double)temporal_tile_bytes /
+                    (2.0 * element_bytes * untiled_elements);
+    int width = (int)pow(budget, 1.0 / tiled_dims);
+    return (width < 2 * steps * radius) ? 2 * steps * radius : width;
+}
+
+// Elements lo[d] ... hi[d]-1 of dimension d computed at step t of a time
+// block by the task that owns tile or boundary k, for a shrinking or a
+// growing dimension. Returns false if the range is empty.
+inline bool step_range(const std::vector<int> &edge, int k, bool growing,
+                       int t, int radius, int &lo, int &hi) {
+    int tiles = (int)edge.size() - 1;
+    if (growing) {
+        // around the boundary between tiles k and k+1
+        lo = edge[k + 1] - t * radius;
+        hi = edge[k + 1] + t * radius;
+    } else {
+        // faces of the interior stay put, tile boundaries move inwards
+        lo = (k == 0) ? edge[0] : edge[k] + t * radius;
+        hi = (k == tiles - 1) ? edge[tiles] : edge[k + 1] - t * radius;
+    }
+    return lo < hi;
+}
+
+////////////// end temporal helpers /////////////////////
+
+// Runs steps applications of update starting from a, using b for
+// alternate steps, and returns the array that holds the last one (a if
+// steps is even, b otherwise). update(in, out, lo, hi) must set out at
+// indices lo[0] ... hi[0]-1, ..., lo[N-1] ... hi[N-1]-1 from the
+// elements of in no more than radius away along any dimension, and must
+// not change in or other elements of out.
+//
+// b gets the outer radius layers of a first, which stay fixed. Every tile
+// runs steps_per_block steps at a time (0: default_time_block). tile[d]
+// is the tile width along dimension d+1, 0 for untiled (NULL: the two
+// slowest dimensions, the others left whole). Tiled widths must be at
+// least 2*steps_per_block*radius.
+template <class T, int N, class Update>
+arraynd<T, N> &run_time_blocked(arraynd<T, N> &a, arraynd<T, N> &b,
+                                int steps, int radius, Update update,
+                                int steps_per_block = 0,
+                                const int *tile = NULL) {
+    check_same_shape(a, b);
+    if (steps_per_block <= 0) {
+        steps_per_block = default_time_block;
+    }
+    if (radius < 0 || steps < 0) {
+        printf("radius and steps must not be negative\n");
+        printf("radius=%d steps=%d \n", radius, steps);
+        printf("file %s, line %d.\n", __FILE__, __LINE__);
+        raise(SIGSEGV);
+    }
+
+    T *from = a.data();
+    T *to = b.data();
+    ORCA_OMP(omp parallel for schedule(static))
+    for (long i = 0; i < (long)a.num_elements(); i++) {
+        to[i] = from[i];
+    }
+
+    int lo[N];
+    int hi[N];
+    for (int d = 0; d < N; d++) {
+        lo[d] = radius;
+        hi[d] = a.length(d + 1) - radius;
+        if (lo[d] >= hi[d]) {
+            return (steps % 2 == 0) ? a : b;
+        }
+    }
+
+    // tile widths, 0 for untiled dimensions
+    int width[N];
+    if (tile != NULL) {
+        for (int d = 0; d < N; d++) {
+            width[d] = tile[d];
+        }
+    } else {
+        int tiled = (N < 2) ? N : 2;
+        size_t untiled = 1;
+        for (int d = 0; d < N; d++) {
+#if FORTRAN_ORDER == 1
+            bool slow = (d >= N - tiled);
+#else
+            bool slow = (d < tiled);
+#endif
+            width[d] = slow ? -1 : 0;
+            untiled *= slow ? 1 : (size_t)(hi[d] - lo[d]);
+        }
+        int w = default_tile_width(untiled, tiled, sizeof(T),
+                                   steps_per_block, radius);
+        for (int d = 0; d < N; d++) {
+            width[d] = (width[d] < 0) ? w : 0;
+        }
+    }
+
+    std::vector<int> edge[N];
+    for (int d = 0; d < N; d++) {
+        if (width[d] > 0 && width[d] < 2 * steps_per_block * radius) {
+            printf("tile width is less than 2*steps_per_block*radius\n");
+            printf("dim=%d width=%d steps_per_block=%d radius=%d \n", d + 1,
+                   width[d], steps_per_block, radius);
+            printf("file %s, line %d.\n", __FILE__, __LINE__);
+            raise(SIGSEGV);
+        }
+        tile_edges(lo[d], hi[d], width[d], edge[d]);
+    }
+
+    arraynd<T, N> *buffer[2] = {&a, &b};
+
+    for (int done = 0; done < steps; done += steps_per_block) {
+        int block = (steps - done < steps_per_block) ? steps - done
+                                                     : steps_per_block;
+
+        // phases in order of the number of growing dimensions; bit d of
+        // growing is set if dimension d+1 grows around tile boundaries
+        for (int count = 0; count <= N; count++) {
+            for (int growing = 0; growing < (1 << N); growing++) {
+                int bits = 0;
+                for (int d = 0; d < N; d++) {
+                    bits += growing >> d & 1;
+                }
+                if (bits != count) {
+                    continue;
+                }
+
+                long tasks = 1;
+                int per_dim[N];
+                for (int d = 0; d < N; d++) {
+                    int tiles = (int)edge[d].size() - 1;
+                    per_dim[d] = (growing >> d & 1) ? tiles - 1 : tiles;
+                    tasks *= per_dim[d];
+                }
+
+                ORCA_OMP(omp parallel for schedule(dynamic, 1))
+                for (long task = 0; task < tasks; task++) {
+                    int k[N];
+                    long rest = task;
+                    for (int d = 0; d < N; d++) {
+                        k[d] = (int)(rest % per_dim[d]);
+                        rest /= per_dim[d];
+                    }
+
+                    for (int t = 1; t <= block; t++) {
+                        int box_lo[N];
+                        int box_hi[N];
+                        bool empty = false;
+                        for (int d = 0; d < N && !empty; d++) {
+                            empty = !step_range(edge[d], k[d],
+                                                (growing >> d & 1) != 0, t,
+                                                radius, box_lo[d], box_hi[d]);
+                        }
+                        if (!empty) {
+                            int s = done + t;
+                            const arraynd<T, N> &in = *buffer[(s - 1) % 2];
+                            const int *first = box_lo;
+                            const int *last = box_hi;
+                            update(in, *buffer[s % 2], first, last);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    return *buffer[steps % 2];
+}
+
+} // namespace orca_array
+
+// endif ORCA_TEMPORAL
+#endif
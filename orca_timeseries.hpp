@@ -0,0 +1,345 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// File: orca_timeseries.hpp
+//
+// snapshot_log<T, N> records a sequence of arraynd<T, N> snapshots, one
+// per timestep, at a fixed memory cost. The newest `window` snapshots are
+// kept in memory; every snapshot is also appended to a file by a
+// background thread, so append() only costs one memcpy.
+//
+// File layout: a 256 byte header followed by the snapshots, each one the
+// raw elements of the array in Fortran or C order.
+//
+// Compile with -pthread.
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef ORCA_TIMESERIES
+#define ORCA_TIMESERIES
+
+#include "orca_array.hpp"
+
+#include <condition_variable>
+#include <fcntl.h>
+#include <mutex>
+#include <string.h>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+
+namespace orca_array {
+
+//////////////// start class snapshot_log /////////////////////
+
+template <class array_element_type, int N> class snapshot_log {
+
+  private:
+    static const size_t header_bytes = 256;
+
+    struct file_header {
+        char magic[8];
+        int rank;
+        int element_bytes;
+        int fortran_order;
+        int size[N];
+    };
+
+    static_assert(sizeof(file_header) <= header_bytes,
+                  "snapshot_log header does not fit");
+
+    int size[N];
+    size_t F[N];
+    size_t C[N];
+
+    size_t snapshot_elements;
+    size_t snapshot_bytes;
+
+    int fd;
+
+    // ring of the newest snapshots, step s is in slot s % window_steps
+    int window_steps;
+    array_element_type *ring;
+
+    // steps appended so far and steps already written to the file
+    long appended;
+    long written;
+
+    bool stopping;
+    std::mutex lock;
+    std::condition_variable changed;
+    std::thread writer;
+
+  public:
+    // Create or truncate the file at path for snapshots with the extents
+    // dims and keep the newest window snapshots in memory.
+    snapshot_log(const char *path, const int (&dims)[N], int window) {
+        check_extents(N, dims);
+        if (window <= 0) {
+            printf("window is less than or equal to 0\n");
+            printf("window=%d \n", window);
+            printf("file %s, line %d.\n", __FILE__, __LINE__);
+            raise(SIGSEGV);
+        }
+
+        for (int d = 0; d < N; d++) {
+            size[d] = dims[d];
+        }
+        compute_factors(N, size, F, C);
+
+        snapshot_elements = count_elements(N, size);
+        snapshot_bytes = snapshot_elements * sizeof(array_element_type);
+
+        fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            printf("cannot open %s\n", path);
+            printf("file %s, line %d.\n", __FILE__, __LINE__);
+            raise(SIGSEGV);
+        }
+
+        char header[header_bytes];
+        memset(header, 0, header_bytes);
+        file_header *h = (file_header *)header;
+        memcpy(h->magic, "ORCATS01", 8);
+        h->rank = N;
+        h->element_bytes = sizeof(array_element_type);
+        h->fortran_order = FORTRAN_ORDER;
+        for (int d = 0; d < N; d++) {
+            h->size[d] = size[d];
+        }
+        write_at(header, header_bytes, 0);
+
+        window_steps = window;
+        ring = new array_element_type[(size_t)window * snapshot_elements];
+
+        appended = 0;
+        written = 0;
+        stopping = false;
+        writer = std::thread(&snapshot_log::write_loop, this);
+    }
+
+    // destructor
+    // waits until every snapshot is in the file
+    ~snapshot_log() {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            stopping = true;
+        }
+        changed.notify_all();
+        writer.join();
+
+        close(fd);
+        delete[] ring;
+    }
+
+    inline long num_steps(void) const { return appended; }
+
+    inline int window(void) const { return window_steps; }
+
+    // Copy snapshot into the log as the next step. Only waits if the
+    // writer is a whole window behind.
+    void append(const arraynd<array_element_type, N> &snapshot) {
+        check_shape(snapshot);
+
+        std::unique_lock<std::mutex> guard(lock);
+        while (appended - written >= window_steps) {
+            changed.wait(guard);
+        }
+        long step = appended;
+        guard.unlock();
+
+        // the writer never touches this slot until appended is advanced
+        memcpy(slot(step), snapshot.data(), snapshot_bytes);
+
+        guard.lock();
+        appended = step + 1;
+        guard.unlock();
+        changed.notify_all();
+    }
+
+    // wait until all appended snapshots are in the file
+    void flush(void) {
+        std::unique_lock<std::mutex> guard(lock);
+        while (written < appended) {
+            changed.wait(guard);
+        }
+    }
+
+    // copy the snapshot of step into out
+    void read_step(long step, arraynd<array_element_type, N> &out) {
+        check_shape(out);
+        check_step(step, 1);
+
+        if (in_window(step)) {
+            memcpy(out.data(), slot(step), snapshot_bytes);
+        } else {
+            read_at(out.data(), snapshot_bytes,
+                    header_bytes + step * snapshot_bytes);
+        }
+    }
+
+    // Copy the element x1 ... xN of steps first ... first+count-1 into
+    // values[0] ... values[count-1]. Steps that left the window are read
+    // through one read only mapping of the file.
+    template <class... Index>
+    void read_point(long first, long count, array_element_type *values,
+                    Index... x) {
+        static_assert(sizeof...(Index) == N, "read_point() needs N indices");
+        check_step(first, count);
+
+#if ARRAY_BOUNDS_CHECK == 1
+        int index[N] = {static_cast<int>(x)...};
+        check_indices(N, index, size);
+#endif
+
+#if FORTRAN_ORDER == 1
+        size_t offset = fortran_offset(F, x...);
+#else
+        size_t offset = c_offset(C, x...);
+#endif
+
+        // steps before first_in_memory come from the file
+        long first_in_memory = appended - window_steps;
+        long from_file = first_in_memory - first;
+        if (from_file > count) {
+            from_file = count;
+        }
+
+        if (from_file > 0) {
+            flush_until(first + from_file);
+
+            // map whole pages covering the requested steps
+            size_t begin = header_bytes + first * snapshot_bytes;
+            size_t end = header_bytes + (first + from_file) * snapshot_bytes;
+            size_t page = sysconf(_SC_PAGESIZE);
+            size_t map_begin = begin / page * page;
+
+            void *map = mmap(0, end - map_begin, PROT_READ, MAP_SHARED, fd,
+                             map_begin);
+            if (map == MAP_FAILED) {
+                printf("cannot map the snapshot file\n");
+                printf("file %s, line %d.\n", __FILE__, __LINE__);
+                raise(SIGSEGV);
+            }
+
+            const char *base = (const char *)map + (begin - map_begin);
+            for (long n = 0; n < from_file; n++) {
+                memcpy(values + n,
+                       base + n * snapshot_bytes +
+                           offset * sizeof(array_element_type),
+                       sizeof(array_element_type));
+            }
+            munmap(map, end - map_begin);
+        } else {
+            from_file = 0;
+        }
+
+        for (long n = from_file; n < count; n++) {
+            values[n] = slot(first + n)[offset];
+        }
+    }
+
+    // note that even though snapshot_log is a template, inside defintion of
+    // snapshot_log snapshot_log means same as
+    // snapshot_log<array_element_type, N>
+  private:
+    inline array_element_type *slot(long step) {
+        return ring + (size_t)(step % window_steps) * snapshot_elements;
+    }
+
+    inline bool in_window(long step) const {
+        return step >= appended - window_steps;
+    }
+
+    // background thread: write every appended step to the file in order
+    void write_loop(void) {
+        std::unique_lock<std::mutex> guard(lock);
+        while (true) {
+            while (written == appended && !stopping) {
+                changed.wait(guard);
+            }
+            if (written == appended) {
+                return;
+            }
+
+            long step = written;
+            guard.unlock();
+            write_at(slot(step), snapshot_bytes,
+                     header_bytes + step * snapshot_bytes);
+            guard.lock();
+
+            written = step + 1;
+            changed.notify_all();
+        }
+    }
+
+    void flush_until(long steps) {
+        std::unique_lock<std::mutex> guard(lock);
+        while (written < steps) {
+            changed.wait(guard);
+        }
+    }
+
+    void write_at(const void *data, size_t bytes, size_t offset) {
+        const char *p = (const char *)data;
+        while (bytes > 0) {
+            ssize_t n = pwrite(fd, p, bytes, offset);
+            if (n <= 0) {
+                printf("cannot write the snapshot file\n");
+                printf("file %s, line %d.\n", __FILE__, __LINE__);
+                raise(SIGSEGV);
+            }
+            p += n;
+            bytes -= n;
+            offset += n;
+        }
+    }
+
+    void read_at(void *data, size_t bytes, size_t offset) {
+        char *p = (char *)data;
+        while (bytes > 0) {
+            ssize_t n = pread(fd, p, bytes, offset);
+            if (n <= 0) {
+                printf("cannot read the snapshot file\n");
+                printf("file %s, line %d.\n", __FILE__, __LINE__);
+                raise(SIGSEGV);
+            }
+            p += n;
+            bytes -= n;
+            offset += n;
+        }
+    }
+
+    void check_shape(const arraynd<array_element_type, N> &a) const {
+        for (int d = 0; d < N; d++) {
+            if (a.length(d + 1) != size[d]) {
+                printf("array extents differ from the snapshot extents\n");
+                printf("length%d=%d size%d=%d \n", d + 1, a.length(d + 1),
+                       d + 1, size[d]);
+                printf("file %s, line %d.\n", __FILE__, __LINE__);
+                raise(SIGSEGV);
+            }
+        }
+    }
+
+    void check_step(long first, long count) const {
+        if ((first < 0) || (count < 0) || (first + count > appended)) {
+            printf("steps are outside 0 ... num_steps()-1\n");
+            printf("first=%ld count=%ld num_steps=%ld \n", first, count,
+                   appended);
+            printf("file %s, line %d.\n", __FILE__, __LINE__);
+            raise(SIGSEGV);
+        }
+    }
+
+    // prohibit copy constructor
+    snapshot_log(snapshot_log &);
+
+    // prohibit assignment operator
+    snapshot_log &operator=(snapshot_log &);
+};
+
+////////////// end class snapshot_log /////////////////////
+
+} // namespace orca_array
+
+// endif ORCA_TIMESERIES
+#endif
@@ -0,0 +1,438 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// File: orca_tridiagonal.hpp
+//
+// Solvers for the independent linear systems along every line of one
+// dimension of an orca_array array, e.g. the implicit steps of ADI
+// diffusion. For every line along dim with n = length(dim) elements
+//
+//   lower(k) x(k-1) + diag(k) x(k) + upper(k) x(k+1) = rhs(k)
+//
+// solve_tridiagonal()          Thomas algorithm, lower(0) and upper(n-1)
+//                              are ignored
+// solve_cyclic_tridiagonal()   periodic lines, lower(0) multiplies x(n-1)
+//                              and upper(n-1) multiplies x(0)
+// solve_banded()               kl lower and ku upper diagonals
+//
+// rhs is overwritten with the solution. The coefficients are arrays of
+// the extents of rhs or constants. There is no pivoting, so the systems
+// should be diagonally dominant, as the ones of implicit diffusion are.
+//
+// Lines are solved in panels of up to 64 neighboring lines, the loops
+// over a panel run across its lines and vectorize. Along a strided
+// dimension the lines of a panel are contiguous in memory; along the
+// fastest dimension a panel is transposed into a per thread buffer
+// first. The panels are split over the OpenMP threads, so all dimensions
+// run at a similar speed with either FORTRAN_ORDER.
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef ORCA_TRIDIAGONAL
+#define ORCA_TRIDIAGONAL
+
+#include "orca_array.hpp"
+
+#include <vector>
+
+namespace orca_array {
+
+//////////////// start line solver helpers /////////////////////
+
+// lines solved together
+static const int line_panel_width = 64;
+
+// Band b of row k of lane w of a panel. Band kl is the diagonal, band
+// kl+j is the j-th upper diagonal.
+template <class T> class panel_bands {
+
+  private:
+    const T *const *base;
+    size_t row;
+
+  public:
+    panel_bands(const T *const *band_base, size_t row_stride)
+        : base(band_base), row(row_stride) {}
+
+    inline T operator()(int b, size_t k, int w) const {
+        return base[b][k * row + w];
+    }
+};
+
+template <class T> class constant_bands {
+
+  private:
+    const T *value;
+
+  public:
+    explicit constant_bands(const T *band_value) : value(band_value) {}
+
+    inline T operator()(int b, size_t, int) const { return value[b]; }
+};
+
+// Thomas algorithm on a panel of lanes lines of n rows, rhs element (k, w)
+// at d[k*row + w], work holds n*lanes elements
+template <class T, class Bands>
+void thomas_panel(const Bands &A, T *d, size_t row, size_t n, int lanes,
+                  T *work) {
+    T *cp = work;
+    for (int w = 0; w < lanes; w++) {
+        T inverse = T(1) / A(1, 0, w);
+        cp[w] = A(2, 0, w) * inverse;
+        d[w] = d[w] * inverse;
+    }
+    for (size_t k = 1; k < n; k++) {
+        T *dk = d + k * row;
+        const T *dp = dk - row;
+        T *ck = cp + k * lanes;
+        const T *cq = ck - lanes;
+        for (int w = 0; w < lanes; w++) {
+            T a = A(0, k, w);
+            T inverse = T(1) / (A(1, k, w) - a * cq[w]);
+            ck[w] = A(2, k, w) * inverse;
+            dk[w] = (dk[w] - a * dp[w]) * inverse;
+        }
+    }
+    for (size_t k = n - 1; k > 0; k--) {
+        T *dk = d + (k - 1) * row;
+        const T *dn = dk + row;
+        const T *ck = cp + (k - 1) * lanes;
+        for (int w = 0; w < lanes; w++) {
+            dk[w] -= ck[w] * dn[w];
+        }
+    }
+}
+
+struct thomas_kernel {
+    inline size_t scratch(size_t n, int lanes) const { return n * lanes; }
+
+    template <class T, class Bands>
+    inline void operator()(const Bands &A, T *d, size_t row, size_t n,
+                           int lanes, T *work) const {
+        thomas_panel(A, d, row, n, lanes, work);
+    }
+};
+
+// the bands of a cyclic system with the diagonal corrected for the
+// Sherman-Morrison update
+template <class T, class Bands> class cyclic_bands {
+
+  private:
+    const Bands &A;
+    const T *gamma;
+    const T *alpha;
+    const T *beta;
+    size_t last;
+
+  public:
+    cyclic_bands(const Bands &bands, const T *g, const T *a, const T *b,
+                 size_t n)
+        : A(bands), gamma(g), alpha(a), beta(b), last(n - 1) {}
+
+    inline T operator()(int b, size_t k, int w) const {
+        T value = A(b, k, w);
+        if (b == 1 && k == 0) {
+            value -= gamma[w];
+        }
+        if (b == 1 && k == last) {
+            value -= alpha[w] * beta[w] / gamma[w];
+        }
+        return value;
+    }
+};
+
+struct cyclic_kernel {
+    inline size_t scratch(size_t n, int lanes) const {
+        return 2 * n * lanes + 4 * lanes;
+    }
+
+    template <class T, class Bands>
+    void operator()(const Bands &A, T *d, size_t row, size_t n, int lanes,
+                    T *work) const {
+        T *z = work + n * lanes;
+        T *gamma = z + n * lanes;
+        T *alpha = gamma + lanes;
+        T *beta = alpha + lanes;
+
+        // corners: alpha = A(n-1, 0), beta = A(0, n-1)
+        for (int w = 0; w < lanes; w++) {
+            gamma[w] = -A(1, 0, w);
+            alpha[w] = A(2, n - 1, w);
+            beta[w] = A(0, 0, w);
+        }
+        cyclic_bands<T, Bands> M(A, gamma, alpha, beta, n);
+
+        thomas_panel(M, d, row, n, lanes, work);
+
+        for (size_t i = 0; i < n * lanes; i++) {
+            z[i] = T(0);
+        }
+        for (int w = 0; w < lanes; w++) {
+            z[w] = gamma[w];
+            z[(n - 1) * lanes + w] = alpha[w];
+        }
+        thomas_panel(M, z, lanes, n, lanes, work);
+
+        T *fact = beta + lanes;
+        for (int w = 0; w < lanes; w++) {
+            T ratio = beta[w] / gamma[w];
+            fact[w] = (d[w] + ratio * d[(n - 1) * row + w]) /
+                      (T(1) + z[w] + ratio * z[(n - 1) * lanes + w]);
+        }
+        for (size_t k = 0; k < n; k++) {
+            T *dk = d + k * row;
+            const T *zk = z + k * lanes;
+            for (int w = 0; w < lanes; w++) {
+                dk[w] -= fact[w] * zk[w];
+            }
+        }
+    }
+};
+
+// Gaussian elimination without pivoting on a band matrix with kl lower
+// and ku upper diagonals
+struct banded_kernel {
+    int kl;
+    int ku;
+
+    banded_kernel(int lower, int upper) : kl(lower), ku(upper) {}
+
+    inline size_t scratch(size_t n, int lanes) const {
+        return n * (kl + ku + 1) * lanes + lanes;
+    }
+
+    template <class T, class Bands>
+    void operator()(const Bands &A, T *d, size_t row, size_t n, int lanes,
+                    T *work) const {
+        int bw = kl + ku + 1;
+
+        // u(k, b) for lane w at u[(k*bw + b)*lanes + w]
+        T *u = work;
+        T *m = work + n * bw * lanes;
+        for (size_t k = 0; k < n; k++) {
+            for (int b = 0; b < bw; b++) {
+                T *ub = u + (k * bw + b) * lanes;
+                for (int w = 0; w < lanes; w++) {
+                    ub[w] = A(b, k, w);
+                }
+            }
+        }
+
+        for (size_t k = 0; k < n; k++) {
+            const T *uk = u + k * bw * lanes;
+            const T *dk = d + k * row;
+            for (int r = 1; r <= kl && k + r < n; r++) {
+                T *ur = u + (k + r) * bw * lanes;
+                T *dr = d + (k + r) * row;
+                for (int w = 0; w < lanes; w++) {
+                    m[w] = ur[(kl - r) * lanes + w] / uk[kl * lanes + w];
+                    dr[w] -= m[w] * dk[w];
+                }
+                for (int j = 1; j <= ku && k + j < n; j++) {
+                    T *urj = ur + (kl - r + j) * lanes;
+                    const T *ukj = uk + (kl + j) * lanes;
+                    for (int w = 0; w < lanes; w++) {
+                        urj[w] -= m[w] * ukj[w];
+                    }
+                }
+            }
+        }
+
+        for (size_t k = n; k-- > 0;) {
+            const T *uk = u + k * bw * lanes;
+            T *dk = d + k * row;
+            for (int j = 1; j <= ku && k + j < n; j++) {
+                const T *ukj = uk + (kl + j) * lanes;
+                const T *dj = dk + j * row;
+                for (int w = 0; w < lanes; w++) {
+                    dk[w] -= ukj[w] * dj[w];
+                }
+            }
+            for (int w = 0; w < lanes; w++) {
+                dk[w] /= uk[kl * lanes + w];
+            }
+        }
+    }
+};
+
+// Runs kernel on every panel of lines of rhs along dim. The num_bands
+// bands are the arrays bands[b] or, if bands is 0, the constants
+// values[b].
+template <class T, int N, class Kernel>
+void solve_lines(arraynd<T, N> &rhs, int dim, int num_bands,
+                 const arraynd<T, N> *const *bands, const T *values,
+                 const Kernel &kernel) {
+    if ((dim < 1) || (dim > N)) {
+        printf("dim is less than 1 or greater than the rank\n");
+        printf("dim=%d rank=%d \n", dim, N);
+        printf("file %s, line %d.\n", __FILE__, __LINE__);
+        raise(SIGSEGV);
+    }
+    if (bands) {
+        for (int b = 0; b < num_bands; b++) {
+            check_same_shape(*bands[b], rhs);
+        }
+    }
+
+    // the array is outer blocks of n rows of inner contiguous elements
+    const int width = line_panel_width;
+    size_t n = rhs.length(dim);
+    size_t inner = rhs.stride(dim);
+    size_t outer = rhs.num_elements() / (n * inner);
+
+    // along the fastest dimension a panel is width whole lines, otherwise
+    // up to width neighboring elements of one row
+    bool contiguous = (inner == 1);
+    size_t chunks = (inner + width - 1) / width;
+    long tasks = contiguous ? (outer + width - 1) / width : outer * chunks;
+
+    T *x = rhs.data();
+    int copies = contiguous ? 1 + (bands ? num_bands : 0) : 0;
+
+    ORCA_OMP(omp parallel)
+    {
+        std::vector<T> work(kernel.scratch(n, width));
+        std::vector<T> panel((size_t)copies * n * width);
+        std::vector<const T *> base(num_bands);
+
+        ORCA_OMP(omp for schedule(static))
+        for (long t = 0; t < tasks; t++) {
+            if (contiguous) {
+                size_t first = (size_t)t * width;
+                int lanes = (int)((outer - first < (size_t)width)
+                                      ? outer - first
+                                      : width);
+
+                // transpose the lines into rows of the panel
+                T *d = &panel[0];
+                for (int w = 0; w < lanes; w++) {
+                    const T *line = x + (first + w) * n;
+                    for (size_t k = 0; k < n; k++) {
+                        d[k * width + w] = line[k];
+                    }
+                }
+
+                if (bands) {
+                    for (int b = 0; b < num_bands; b++) {
+                        T *p = &panel[(size_t)(1 + b) * n * width];
+                        for (int w = 0; w < lanes; w++) {
+                            const T *line = bands[b]->data() + (first + w) * n;
+                            for (size_t k = 0; k < n; k++) {
+                                p[k * width + w] = line[k];
+                            }
+                        }
+                        base[b] = p;
+                    }
+                    kernel(panel_bands<T>(&base[0], width), d, width, n,
+                           lanes, &work[0]);
+                } else {
+                    kernel(constant_bands<T>(values), d, width, n, lanes,
+                           &work[0]);
+                }
+
+                for (int w = 0; w < lanes; w++) {
+                    T *line = x + (first + w) * n;
+                    for (size_t k = 0; k < n; k++) {
+                        line[k] = d[k * width + w];
+                    }
+                }
+            } else {
+                size_t offset = (t / chunks) * n * inner + (t % chunks) * width;
+                size_t left = inner - (t % chunks) * width;
+                int lanes = (int)((left < (size_t)width) ? left : width);
+
+                if (bands) {
+                    for (int b = 0; b < num_bands; b++) {
+                        base[b] = bands[b]->data() + offset;
+                    }
+                    kernel(panel_bands<T>(&base[0], inner), x + offset, inner,
+                           n, lanes, &work[0]);
+                } else {
+                    kernel(constant_bands<T>(values), x + offset, inner, n,
+                           lanes, &work[0]);
+                }
+            }
+        }
+    }
+}
+
+inline void check_cyclic_length(int n) {
+    if (n < 3) {
+        printf("cyclic lines need at least 3 elements\n");
+        printf("n=%d \n", n);
+        printf("file %s, line %d.\n", __FILE__, __LINE__);
+        raise(SIGSEGV);
+    }
+}
+
+inline void check_band_widths(int kl, int ku) {
+    if ((kl < 0) || (ku < 0)) {
+        printf("kl or ku is less than 0\n");
+        printf("kl=%d ku=%d \n", kl, ku);
+        printf("file %s, line %d.\n", __FILE__, __LINE__);
+        raise(SIGSEGV);
+    }
+}
+
+////////////// end line solver helpers /////////////////////
+
+// tridiagonal systems along dim with coefficient arrays
+template <class T, int N>
+void solve_tridiagonal(arraynd<T, N> &rhs, int dim, const arraynd<T, N> &lower,
+                       const arraynd<T, N> &diag,
+                       const arraynd<T, N> &upper) {
+    const arraynd<T, N> *bands[3] = {&lower, &diag, &upper};
+    solve_lines(rhs, dim, 3, bands, (const T *)0, thomas_kernel());
+}
+
+// tridiagonal systems along dim with the same coefficients in every row
+template <class T, int N>
+void solve_tridiagonal(arraynd<T, N> &rhs, int dim, T lower, T diag,
+                       T upper) {
+    T values[3] = {lower, diag, upper};
+    solve_lines(rhs, dim, 3, (const arraynd<T, N> *const *)0, values,
+                thomas_kernel());
+}
+
+// periodic tridiagonal systems along dim with coefficient arrays
+template <class T, int N>
+void solve_cyclic_tridiagonal(arraynd<T, N> &rhs, int dim,
+                              const arraynd<T, N> &lower,
+                              const arraynd<T, N> &diag,
+                              const arraynd<T, N> &upper) {
+    check_cyclic_length(rhs.length(dim));
+    const arraynd<T, N> *bands[3] = {&lower, &diag, &upper};
+    solve_lines(rhs, dim, 3, bands, (const T *)0, cyclic_kernel());
+}
+
+// periodic tridiagonal systems along dim with constant coefficients
+template <class T, int N>
+void solve_cyclic_tridiagonal(arraynd<T, N> &rhs, int dim, T lower, T diag,
+                              T upper) {
+    check_cyclic_length(rhs.length(dim));
+    T values[3] = {lower, diag, upper};
+    solve_lines(rhs, dim, 3, (const arraynd<T, N> *const *)0, values,
+                cyclic_kernel());
+}
+
+// Band systems along dim, bands[kl + j] holds diagonal j for j = -kl ...
+// ku, i.e. the coefficient of x(k+j) in row k.
+template <class T, int N>
+void solve_banded(arraynd<T, N> &rhs, int dim, int kl, int ku,
+                  const arraynd<T, N> *const *bands) {
+    check_band_widths(kl, ku);
+    solve_lines(rhs, dim, kl + ku + 1, bands, (const T *)0,
+                banded_kernel(kl, ku));
+}
+
+// band systems along dim with constant diagonals values[kl + j]
+template <class T, int N>
+void solve_banded(arraynd<T, N> &rhs, int dim, int kl, int ku,
+                  const T *values) {
+    check_band_widths(kl, ku);
+    solve_lines(rhs, dim, kl + ku + 1, (const arraynd<T, N> *const *)0,
+                values, banded_kernel(kl, ku));
+}
+
+} // namespace orca_array
+
+// endif ORCA_TRIDIAGONAL
+#endif
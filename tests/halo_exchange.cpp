@@ -0,0 +1,173 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// File: halo_exchange.cpp
+//
+// Forks one process per rank of a 2 x 2 x 1 decomposition of a 13 x 10 x 6
+// grid with two ghost layers, periodic along dimensions 1 and 3, and
+// exchanges halos over shm_transport for several steps. Every step writes
+// new values into the owned cells and checks every ghost cell against the
+// global grid afterwards: full exchanges fill faces, edges and corners,
+// begin_exchange() / finish_exchange() only the faces.
+//
+// Before forking, a segment of the same name filled with nonzero bytes is
+// left behind as by a run that crashed; the transport must replace it.
+//
+// g++ -O2 -std=c++11 halo_exchange.cpp -o halo_exchange -lrt
+// ./halo_exchange
+///////////////////////////////////////////////////////////////////////////
+
+#include "../orca_halo.hpp"
+
+#include <sys/wait.h>
+
+using namespace orca_array;
+
+const int global[3] = {13, 10, 6};
+const int procs[3] = {2, 2, 1};
+const bool periodic[3] = {true, false, true};
+const int ghost = 2;
+const int steps = 6;
+
+inline double cell_value(int step, const int *g) {
+    return step * 1e6 + g[0] * 1e4 + g[1] * 1e2 + g[2];
+}
+
+// exit status of one rank: 0 if all ghost cells held the expected values
+int run_rank(int rank, const char *name) {
+    // a hang is a failure
+    alarm(60);
+
+    decomposition<3> dec(global, procs, ghost, rank, periodic);
+    shm_transport transport(name, rank, dec.num_ranks(), 6,
+                            dec.max_face_elements() * sizeof(double));
+    halo_array<double, 3> u(dec, transport);
+    array3d<double> &a = u.array();
+
+    int errors = 0;
+    for (int step = 0; step < steps; step++) {
+        // owned cells get this step's values, ghosts a marker
+        int l[3];
+        int g[3];
+        for (l[0] = 0; l[0] < a.length1(); l[0]++) {
+            for (l[1] = 0; l[1] < a.length2(); l[1]++) {
+                for (l[2] = 0; l[2] < a.length3(); l[2]++) {
+                    bool owned = true;
+                    for (int d = 0; d < 3; d++) {
+                        g[d] = dec.local_start(d + 1) + l[d] - ghost;
+                        owned = owned && (l[d] >= ghost) &&
+                                (l[d] < ghost + dec.local_length(d + 1));
+                    }
+                    a.at(l[0], l[1], l[2]) =
+                        owned ? cell_value(step, g) : -1.0;
+                }
+            }
+        }
+
+        bool faces_only = (step % 2 == 1);
+        if (faces_only) {
+            u.begin_exchange();
+            u.finish_exchange();
+        } else {
+            u.exchange_halos();
+        }
+
+        for (l[0] = 0; l[0] < a.length1(); l[0]++) {
+            for (l[1] = 0; l[1] < a.length2(); l[1]++) {
+                for (l[2] = 0; l[2] < a.length3(); l[2]++) {
+                    // dimensions in which l is a ghost, and whether the
+                    // global cell exists
+                    int ghost_dims = 0;
+                    bool outside = false;
+                    for (int d = 0; d < 3; d++) {
+                        g[d] = dec.local_start(d + 1) + l[d] - ghost;
+                        if ((l[d] < ghost) ||
+                            (l[d] >= ghost + dec.local_length(d + 1))) {
+                            ghost_dims++;
+                        }
+                        if ((g[d] < 0) || (g[d] >= global[d])) {
+                            if (periodic[d]) {
+                                g[d] = (g[d] + global[d]) % global[d];
+                            } else {
+                                outside = true;
+                            }
+                        }
+                    }
+                    if (faces_only && ghost_dims > 1) {
+                        continue;
+                    }
+
+                    double expected =
+                        outside ? -1.0 : cell_value(step, g);
+                    double got = a.at(l[0], l[1], l[2]);
+                    if (got != expected) {
+                        if (errors < 5) {
+                            printf("rank %d step %d cell (%d, %d, %d): "
+                                   "%.0f, expected %.0f\n",
+                                   rank, step, l[0], l[1], l[2], got,
+                                   expected);
+                        }
+                        errors++;
+                    }
+                }
+            }
+        }
+    }
+    return (errors == 0) ? 0 : 1;
+}
+
+// a segment as left behind by a crashed run: barrier counters and all
+// mailbox states nonzero, stale data in the mailboxes
+void leave_stale_segment(const char *name) {
+    char path[256];
+    snprintf(path, sizeof(path), "/%s", name);
+    size_t bytes = 1 << 20;
+    int fd = shm_open(path, O_CREAT | O_RDWR, 0600);
+    if (fd < 0 || ftruncate(fd, bytes) != 0) {
+        printf("cannot create stale segment %s\n", path);
+        exit(1);
+    }
+    void *p = mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    memset(p, 1, bytes);
+    munmap(p, bytes);
+}
+
+int main(void) {
+    char name[64];
+    snprintf(name, sizeof(name), "orca_halo_test_%d", (int)getpid());
+    leave_stale_segment(name);
+
+    const int ranks = procs[0] * procs[1] * procs[2];
+    pid_t child[ranks];
+    for (int r = 0; r < ranks; r++) {
+        child[r] = fork();
+        if (child[r] == 0) {
+            _exit(run_rank(r, name));
+        }
+    }
+
+    int failed = 0;
+    for (int r = 0; r < ranks; r++) {
+        int status;
+        waitpid(child[r], &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            printf("rank %d failed\n", r);
+            failed++;
+        }
+    }
+
+    // rank 0 removed the segment
+    char path[256];
+    snprintf(path, sizeof(path), "/%s", name);
+    int fd = shm_open(path, O_RDWR, 0600);
+    if (fd >= 0) {
+        printf("segment %s was not removed\n", path);
+        close(fd);
+        shm_unlink(path);
+        failed++;
+    }
+
+    printf("halo exchange over %d processes, %d steps: %s\n", ranks, steps,
+           (failed == 0) ? "ok" : "FAILED");
+    return (failed == 0) ? 0 : 1;
+}
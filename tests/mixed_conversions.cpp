@@ -0,0 +1,297 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// File: mixed_conversions.cpp
+//
+// Accuracy of the bfloat16 and half conversions of orca_mixed.hpp on the
+// scalar path and, if the CPU has it, the AVX2 / F16C path:
+//   - every 16 bit pattern widened to float, compared with the exact value,
+//     and narrowed back
+//   - floats narrowed to 16 bits: all floats next to a rounding tie, all
+//     subnormal halves, and random floats, compared with round to nearest
+//     even computed independently in double
+//   - named cases: ties, overflow to Inf, the largest finite values,
+//     subnormals, signed zeros, Inf and NaN
+// NaN only has to stay NaN; its payload is not checked.
+//
+// g++ -O2 -std=c++11 mixed_conversions.cpp -o mixed_conversions
+// ./mixed_conversions
+///////////////////////////////////////////////////////////////////////////
+
+#include "../orca_mixed.hpp"
+
+#include <math.h>
+#include <random>
+#include <vector>
+
+using namespace orca_array;
+
+//////////////// start reference conversions /////////////////////
+
+// exact value of a 16 bit pattern with the given exponent and mantissa
+// bits; NaN for the all ones exponent with a nonzero mantissa
+float reference_widen(uint16_t bits, int exponent_bits, int mantissa_bits) {
+    int bias = (1 << (exponent_bits - 1)) - 1;
+    int e = (bits >> mantissa_bits) & ((1 << exponent_bits) - 1);
+    int m = bits & ((1 << mantissa_bits) - 1);
+    double value;
+    if (e == (1 << exponent_bits) - 1) {
+        value = (m == 0) ? INFINITY : NAN;
+    } else if (e == 0) {
+        value = ldexp((double)m, 1 - bias - mantissa_bits);
+    } else {
+        value = ldexp((double)(m + (1 << mantissa_bits)), e - bias -
+                                                              mantissa_bits);
+    }
+    return (float)((bits & 0x8000) ? -value : value);
+}
+
+// f rounded to nearest even with the given exponent and mantissa bits,
+// computed in double without any bit tricks
+uint16_t reference_narrow(float f, int exponent_bits, int mantissa_bits) {
+    int bias = (1 << (exponent_bits - 1)) - 1;
+    uint16_t sign = signbit(f) ? 0x8000 : 0;
+    uint16_t inf = (uint16_t)(((1 << exponent_bits) - 1) << mantissa_bits);
+    if (isnan(f)) {
+        return sign | inf | 1;
+    }
+    double a = fabs((double)f);
+    if (isinf(a)) {
+        return sign | inf;
+    }
+
+    // exponent of a as a normal number, raised to the subnormal range
+    int e;
+    frexp(a, &e);
+    e -= 1;
+    if (e < 1 - bias) {
+        e = 1 - bias;
+    }
+    // nearbyint rounds ties to even in the default rounding mode
+    double q = nearbyint(ldexp(a, mantissa_bits - e));
+    if (q >= ldexp(1.0, mantissa_bits + 1)) {
+        q /= 2;
+        e++;
+    }
+    if (q < ldexp(1.0, mantissa_bits)) {
+        // subnormal, q is the whole pattern below the sign
+        return sign | (uint16_t)q;
+    }
+    if (e + bias >= (1 << exponent_bits) - 1) {
+        return sign | inf;
+    }
+    return sign | (uint16_t)(((e + bias) << mantissa_bits) +
+                             ((int)q - (1 << mantissa_bits)));
+}
+
+////////////// end reference conversions /////////////////////
+
+int failures = 0;
+
+void report(const char *what, const char *path, uint32_t input,
+            uint32_t got, uint32_t expected) {
+    if (failures < 20) {
+        printf("%s (%s): input 0x%08x gave 0x%08x, expected 0x%08x\n", what,
+               path, input, got, expected);
+    }
+    failures++;
+}
+
+inline bool is_nan16(uint16_t bits, uint16_t inf) {
+    return (bits & inf) == inf && (bits & ~(inf | 0x8000)) != 0;
+}
+
+// every 16 bit pattern widened by widen_elements() and narrowed back by
+// narrow_elements()
+template <class S>
+void check_all_patterns(const char *what, const char *path,
+                        int exponent_bits, int mantissa_bits) {
+    const uint16_t inf =
+        (uint16_t)(((1 << exponent_bits) - 1) << mantissa_bits);
+    std::vector<S> in(65536);
+    std::vector<float> wide(65536);
+    std::vector<S> back(65536);
+    for (int b = 0; b < 65536; b++) {
+        in[b].bits = (uint16_t)b;
+    }
+    widen_elements(wide.data(), in.data(), 65536);
+    narrow_elements(back.data(), wide.data(), 65536);
+
+    for (int b = 0; b < 65536; b++) {
+        float expected = reference_widen((uint16_t)b, exponent_bits,
+                                         mantissa_bits);
+        // the single element conversion must agree with the bulk one
+        float single = (float)in[b];
+        if (isnan(expected)) {
+            if (!isnan(wide[b]) || !isnan(single)) {
+                report(what, path, b, float_bits(wide[b]),
+                       float_bits(expected));
+            }
+            if (!is_nan16(back[b].bits, inf)) {
+                report(what, path, b, back[b].bits, b);
+            }
+            continue;
+        }
+        if (float_bits(wide[b]) != float_bits(expected) ||
+            float_bits(single) != float_bits(expected)) {
+            report(what, path, b, float_bits(wide[b]), float_bits(expected));
+        }
+        if (back[b].bits != b) {
+            report(what, path, b, back[b].bits, b);
+        }
+    }
+}
+
+// narrow_elements() and the single element constructor on every float of
+// x, compared with reference_narrow()
+template <class S>
+void check_floats(const char *what, const char *path,
+                  const std::vector<float> &x, int exponent_bits,
+                  int mantissa_bits) {
+    const uint16_t inf =
+        (uint16_t)(((1 << exponent_bits) - 1) << mantissa_bits);
+    std::vector<S> y(x.size());
+    narrow_elements(y.data(), x.data(), x.size());
+
+    for (size_t i = 0; i < x.size(); i++) {
+        uint16_t expected =
+            reference_narrow(x[i], exponent_bits, mantissa_bits);
+        uint16_t single = S(x[i]).bits;
+        if (isnan(x[i])) {
+            if (!is_nan16(y[i].bits, inf) || !is_nan16(single, inf)) {
+                report(what, path, float_bits(x[i]), y[i].bits, expected);
+            }
+        } else if (y[i].bits != expected || single != expected) {
+            report(what, path, float_bits(x[i]),
+                   (y[i].bits != expected) ? y[i].bits : single, expected);
+        }
+    }
+}
+
+// floats next to every rounding tie of a format that drops `dropped` low
+// mantissa bits, for all values of the bits above them
+std::vector<float> floats_near_ties(int dropped) {
+    const uint32_t half_unit = 1u << (dropped - 1);
+    const uint32_t low[6] = {0, 1, half_unit - 1, half_unit, half_unit + 1,
+                             2 * half_unit - 1};
+    std::vector<float> x;
+    for (uint32_t high = 0; high < (1u << (32 - dropped)); high++) {
+        for (int k = 0; k < 6; k++) {
+            x.push_back(bits_float((high << dropped) | low[k]));
+        }
+    }
+    return x;
+}
+
+std::vector<float> random_floats(size_t count) {
+    std::mt19937 random(2024);
+    std::vector<float> x(count);
+    for (size_t i = 0; i < count; i++) {
+        x[i] = bits_float((uint32_t)random());
+    }
+    return x;
+}
+
+// named cases with their expected 16 bit patterns
+struct named_case {
+    float x;
+    uint16_t bits;
+};
+
+void check_named(const char *path) {
+    const named_case half_cases[] = {
+        {0.0f, 0x0000},           {-0.0f, 0x8000},
+        {1.0f, 0x3c00},           {65504.0f, 0x7bff},
+        {65519.99f, 0x7bff},      {65520.0f, 0x7c00},
+        {1e10f, 0x7c00},          {-1e10f, 0xfc00},
+        {INFINITY, 0x7c00},       {-INFINITY, 0xfc00},
+        // 1 + 2^-11 is a tie between 1 and 1 + 2^-10: rounds to even 1
+        {1.00048828125f, 0x3c00}, {1.00146484375f, 0x3c02},
+        // smallest subnormal 2^-24, half of it ties to 0, a bit more is 1
+        {5.9604645e-8f, 0x0001},  {2.9802322e-8f, 0x0000},
+        {2.9802326e-8f, 0x0001},  {6.1035156e-5f, 0x0400},
+        {6.0975552e-5f, 0x03ff}};
+    const named_case bfloat16_cases[] = {
+        {0.0f, 0x0000},       {-0.0f, 0x8000},
+        {1.0f, 0x3f80},       {3.3895314e38f, 0x7f7f},
+        {3.4028235e38f, 0x7f80}, {INFINITY, 0x7f80},
+        {-INFINITY, 0xff80},
+        // 1 + 2^-8 ties to 1, 1 + 3 * 2^-8 ties up to 1 + 2^-6
+        {1.00390625f, 0x3f80}, {1.01171875f, 0x3f82},
+        // float subnormals
+        {1.4e-45f, 0x0000},   {9.1835e-41f, 0x0001}};
+
+    std::vector<float> x;
+    for (const named_case &c : half_cases) {
+        x.push_back(c.x);
+    }
+    std::vector<half> h(x.size());
+    narrow_elements(h.data(), x.data(), x.size());
+    for (size_t i = 0; i < x.size(); i++) {
+        if (h[i].bits != half_cases[i].bits) {
+            report("half named", path, float_bits(x[i]), h[i].bits,
+                   half_cases[i].bits);
+        }
+    }
+
+    x.clear();
+    for (const named_case &c : bfloat16_cases) {
+        x.push_back(c.x);
+    }
+    std::vector<bfloat16> b(x.size());
+    narrow_elements(b.data(), x.data(), x.size());
+    for (size_t i = 0; i < x.size(); i++) {
+        if (b[i].bits != bfloat16_cases[i].bits) {
+            report("bfloat16 named", path, float_bits(x[i]), b[i].bits,
+                   bfloat16_cases[i].bits);
+        }
+    }
+
+    std::vector<float> nan(17, NAN);
+    nan[3] = -NAN;
+    std::vector<half> hn(nan.size());
+    std::vector<bfloat16> bn(nan.size());
+    narrow_elements(hn.data(), nan.data(), nan.size());
+    narrow_elements(bn.data(), nan.data(), nan.size());
+    for (size_t i = 0; i < nan.size(); i++) {
+        if (!is_nan16(hn[i].bits, 0x7c00)) {
+            report("half NaN", path, float_bits(nan[i]), hn[i].bits, 0x7e00);
+        }
+        if (!is_nan16(bn[i].bits, 0x7f80)) {
+            report("bfloat16 NaN", path, float_bits(nan[i]), bn[i].bits,
+                   0x7fc0);
+        }
+    }
+}
+
+int main(void) {
+    // half drops 13 mantissa bits of a float, bfloat16 drops 16; all half
+    // subnormals come from floats below 2^-14 and are covered by the ties
+    std::vector<float> half_ties = floats_near_ties(13);
+    std::vector<float> bfloat16_ties = floats_near_ties(16);
+    std::vector<float> random = random_floats(1 << 22);
+
+    simd_level paths[2] = {SIMD_SCALAR, SIMD_AVX2};
+    const char *names[2] = {"scalar", "AVX2"};
+    for (int p = 0; p < 2; p++) {
+        if (paths[p] > detected_simd_level()) {
+            printf("%s path: not supported by this CPU, skipped\n",
+                   names[p]);
+            continue;
+        }
+        set_simd_level(paths[p]);
+        int before = failures;
+
+        check_all_patterns<half>("half patterns", names[p], 5, 10);
+        check_all_patterns<bfloat16>("bfloat16 patterns", names[p], 8, 7);
+        check_floats<half>("half ties", names[p], half_ties, 5, 10);
+        check_floats<bfloat16>("bfloat16 ties", names[p], bfloat16_ties, 8,
+                               7);
+        check_floats<half>("half random", names[p], random, 5, 10);
+        check_floats<bfloat16>("bfloat16 random", names[p], random, 8, 7);
+        check_named(names[p]);
+
+        printf("%s path: %s\n", names[p],
+               (failures == before) ? "ok" : "FAILED");
+    }
+    return (failures == 0) ? 0 : 1;
+}